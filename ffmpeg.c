@@ -2368,9 +2368,35 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     return err < 0 ? err : ret;
 }
 
+/*
+ * With accurate seeking, the frames between the seek point and the start
+ * time are decoded only to be dropped by the trim filter. Non-reference
+ * frames among them cannot affect any later frame, so the decoder may skip
+ * them entirely.
+ */
+static void update_seek_skip_frame(InputStream *ist, const AVPacket *pkt)
+{
+    InputFile *f = input_files[ist->file_index];
+    enum AVDiscard skip_frame = ist->user_skip_frame;
+    int64_t start = 0;
+
+    if (copy_ts) {
+        start = f->start_time;
+        if (!start_at_zero && f->ctx->start_time != AV_NOPTS_VALUE)
+            start += f->ctx->start_time;
+    }
+
+    if (pkt->pts != AV_NOPTS_VALUE &&
+        av_compare_ts(pkt->pts, ist->st->time_base, start, AV_TIME_BASE_Q) < 0)
+        skip_frame = FFMAX(skip_frame, AVDISCARD_NONREF);
+
+    ist->dec_ctx->skip_frame = skip_frame;
+}
+
 static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_t *duration_pts, int eof,
                         int *decode_failed)
 {
+    InputFile *f = input_files[ist->file_index];
     AVFrame *decoded_frame;
     int i, ret = 0, err = 0;
     int64_t best_effort_timestamp;
@@ -2393,6 +2419,10 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     if (pkt) {
         avpkt = *pkt;
         avpkt.dts = dts; // ffmpeg.c probably shouldn't do this
+
+        if (f->seek_skip_nonref && f->accurate_seek &&
+            f->start_time != AV_NOPTS_VALUE)
+            update_seek_skip_frame(ist, pkt);
     }
 
     // The old code used to set dts on the drain packet, which does not work
@@ -2929,6 +2959,7 @@ static int init_input_stream(int ist_index, char *error, int error_len)
             return ret;
         }
         assert_avoptions(ist->decoder_opts);
+        ist->user_skip_frame = ist->dec_ctx->skip_frame;
     }
 
     ist->next_pts = AV_NOPTS_VALUE;
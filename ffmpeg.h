@@ -127,6 +127,7 @@ typedef struct OptionsContext {
     int loop;
     int rate_emu;
     int accurate_seek;
+    int seek_skip_nonref;
     int thread_queue_size;
 
     SpecifierOpt *ts_scale;
@@ -304,6 +305,7 @@ typedef struct InputStream {
     AVStream *st;
     int discard;             /* true if stream data should be discarded */
     int user_set_discard;
+    enum AVDiscard user_skip_frame; /* decoder skip_frame as set by the user */
     int decoding_needed;     /* non zero if the packets must be decoded in 'raw_fifo', see DECODING_FOR_* */
 #define DECODING_FOR_OST    1
 #define DECODING_FOR_FILTER 2
@@ -418,6 +420,7 @@ typedef struct InputFile {
     int nb_streams_warn;  /* number of streams that the user was warned of */
     int rate_emu;
     int accurate_seek;
+    int seek_skip_nonref;
 
 #if HAVE_PTHREADS
     AVThreadMessageQueue *in_thread_queue;
@@ -27,6 +27,12 @@
 #include "libavutil/ffversion.h"
 
 #include <string.h>
+#if HAVE_IO_H
+#include <io.h>
+#endif
+#if HAVE_SETMODE
+#include <fcntl.h>
+#endif
 
 #include "libavformat/avformat.h"
 #include "libavcodec/avcodec.h"
@@ -1610,6 +1616,120 @@ static const Writer json_writer = {
     .priv_class           = &json_class,
 };
 
+/* CBOR output */
+
+/* CBOR major types, see RFC 7049 */
+#define CBOR_TYPE_UINT   0
+#define CBOR_TYPE_NINT   1
+#define CBOR_TYPE_TEXT   3
+#define CBOR_TYPE_ARRAY  4
+#define CBOR_TYPE_MAP    5
+
+#define CBOR_INDEFINITE  31
+#define CBOR_BREAK       0xff
+
+static void cbor_put_head(int major_type, uint64_t val)
+{
+    uint8_t buf[9];
+    int size;
+
+    if (val < 24) {
+        buf[0] = major_type << 5 | val;
+        size = 1;
+    } else if (val <= UINT8_MAX) {
+        buf[0] = major_type << 5 | 24;
+        buf[1] = val;
+        size = 2;
+    } else if (val <= UINT16_MAX) {
+        buf[0] = major_type << 5 | 25;
+        AV_WB16(buf + 1, val);
+        size = 3;
+    } else if (val <= UINT32_MAX) {
+        buf[0] = major_type << 5 | 26;
+        AV_WB32(buf + 1, val);
+        size = 5;
+    } else {
+        buf[0] = major_type << 5 | 27;
+        AV_WB64(buf + 1, val);
+        size = 9;
+    }
+    fwrite(buf, 1, size, stdout);
+}
+
+static void cbor_put_text(const char *str)
+{
+    size_t len = strlen(str);
+
+    cbor_put_head(CBOR_TYPE_TEXT, len);
+    fwrite(str, 1, len, stdout);
+}
+
+static av_cold int cbor_init(WriterContext *wctx)
+{
+#if HAVE_SETMODE
+    setmode(fileno(stdout), O_BINARY);
+#endif
+    return 0;
+}
+
+/* Maps and arrays are written with indefinite length, so that each
+ * section can be output as soon as it is complete without knowing the
+ * number of items it will contain. */
+static void cbor_print_section_header(WriterContext *wctx)
+{
+    const struct section *section = wctx->section[wctx->level];
+    const struct section *parent_section = wctx->level ?
+        wctx->section[wctx->level-1] : NULL;
+
+    if (section->flags & SECTION_FLAG_IS_WRAPPER) {
+        putchar(CBOR_TYPE_MAP << 5 | CBOR_INDEFINITE);
+    } else if (section->flags & SECTION_FLAG_IS_ARRAY) {
+        cbor_put_text(section->name);
+        putchar(CBOR_TYPE_ARRAY << 5 | CBOR_INDEFINITE);
+    } else if (parent_section && !(parent_section->flags & SECTION_FLAG_IS_ARRAY)) {
+        cbor_put_text(section->name);
+        putchar(CBOR_TYPE_MAP << 5 | CBOR_INDEFINITE);
+    } else {
+        putchar(CBOR_TYPE_MAP << 5 | CBOR_INDEFINITE);
+
+        /* this is required so the parser can distinguish between packets and frames */
+        if (parent_section && parent_section->id == SECTION_ID_PACKETS_AND_FRAMES) {
+            cbor_put_text("type");
+            cbor_put_text(section->name);
+        }
+    }
+}
+
+static void cbor_print_section_footer(WriterContext *wctx)
+{
+    putchar(CBOR_BREAK);
+}
+
+static void cbor_print_str(WriterContext *wctx, const char *key, const char *value)
+{
+    cbor_put_text(key);
+    cbor_put_text(value);
+}
+
+static void cbor_print_int(WriterContext *wctx, const char *key, long long int value)
+{
+    cbor_put_text(key);
+    if (value >= 0)
+        cbor_put_head(CBOR_TYPE_UINT, value);
+    else
+        cbor_put_head(CBOR_TYPE_NINT, -1 - value);
+}
+
+static const Writer cbor_writer = {
+    .name                 = "cbor",
+    .init                 = cbor_init,
+    .print_section_header = cbor_print_section_header,
+    .print_section_footer = cbor_print_section_footer,
+    .print_integer        = cbor_print_int,
+    .print_string         = cbor_print_str,
+    .flags = WRITER_FLAG_PUT_PACKETS_AND_FRAMES_IN_SAME_CHAPTER,
+};
+
 /* XML output */
 
 typedef struct XMLContext {
@@ -1797,6 +1917,7 @@ static void writer_register_all(void)
     writer_register(&ini_writer);
     writer_register(&json_writer);
     writer_register(&xml_writer);
+    writer_register(&cbor_writer);
 }
 
 #define print_fmt(k, f, ...) do {              \
@@ -2909,7 +3030,7 @@ static int open_input_file(InputFile *ifile, const char *filename)
                 // For loging it is needed to disable at least frame threads as otherwise
                 // the log information would need to be reordered and matches up to contexts and frames
                 // That is in fact possible but not trivial
-                av_dict_set(&codec_opts, "threads", "1", 0);
+                av_dict_set(&opts, "threads", "1", 0);
             }
 
             av_codec_set_pkt_timebase(ist->dec_ctx, stream->time_base);
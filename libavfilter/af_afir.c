@@ -35,79 +35,14 @@
 #include "internal.h"
 #include "af_afir.h"
 
-static void fcmul_add_c(float *sum, const float *t, const float *c, ptrdiff_t len)
-{
-    int n;
-
-    for (n = 0; n < len; n++) {
-        const float cre = c[2 * n    ];
-        const float cim = c[2 * n + 1];
-        const float tre = t[2 * n    ];
-        const float tim = t[2 * n + 1];
-
-        sum[2 * n    ] += tre * cre - tim * cim;
-        sum[2 * n + 1] += tre * cim + tim * cre;
-    }
-
-    sum[2 * n] += t[2 * n] * c[2 * n];
-}
-
 static int fir_channel(AVFilterContext *ctx, void *arg, int ch, int nb_jobs)
 {
     AudioFIRContext *s = ctx->priv;
     const float *src = (const float *)s->in[0]->extended_data[ch];
-    int index1 = (s->index + 1) % 3;
-    int index2 = (s->index + 2) % 3;
-    float *sum = s->sum[ch];
     AVFrame *out = arg;
-    float *block;
-    float *dst;
-    int n, i, j;
-
-    memset(sum, 0, sizeof(*sum) * s->fft_length);
-    block = s->block[ch] + s->part_index * s->block_size;
-    memset(block, 0, sizeof(*block) * s->fft_length);
-
-    s->fdsp->vector_fmul_scalar(block + s->part_size, src, s->dry_gain, FFALIGN(s->nb_samples, 4));
-    emms_c();
-
-    av_rdft_calc(s->rdft[ch], block);
-    block[2 * s->part_size] = block[1];
-    block[1] = 0;
-
-    j = s->part_index;
-
-    for (i = 0; i < s->nb_partitions; i++) {
-        const int coffset = i * s->coeff_size;
-        const FFTComplex *coeff = s->coeff[ch * !s->one2many] + coffset;
-
-        block = s->block[ch] + j * s->block_size;
-        s->fcmul_add(sum, block, (const float *)coeff, s->part_size);
-
-        if (j == 0)
-            j = s->nb_partitions;
-        j--;
-    }
-
-    sum[1] = sum[2 * s->part_size];
-    av_rdft_calc(s->irdft[ch], sum);
-
-    dst = (float *)s->buffer->extended_data[ch] + index1 * s->part_size;
-    for (n = 0; n < s->part_size; n++) {
-        dst[n] += sum[n];
-    }
-
-    dst = (float *)s->buffer->extended_data[ch] + index2 * s->part_size;
-
-    memcpy(dst, sum + s->part_size, s->part_size * sizeof(*dst));
 
-    dst = (float *)s->buffer->extended_data[ch] + s->index * s->part_size;
-
-    if (out) {
-        float *ptr = (float *)out->extended_data[ch];
-        s->fdsp->vector_fmul_scalar(ptr, dst, s->gain * s->wet_gain, FFALIGN(out->nb_samples, 4));
-        emms_c();
-    }
+    ff_partconv_input(&s->conv, ch, src, s->nb_samples);
+    ff_partconv_output(&s->conv, ch, (float *)out->extended_data[ch]);
 
     return 0;
 }
@@ -116,15 +51,13 @@ static int fir_frame(AudioFIRContext *s, AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
     AVFrame *out = NULL;
-    int ret;
 
-    s->nb_samples = FFMIN(s->part_size, av_audio_fifo_size(s->fifo[0]));
+    s->nb_samples = FFMIN(s->conv.min_part_size, av_audio_fifo_size(s->fifo[0]));
 
-    if (!s->want_skip) {
-        out = ff_get_audio_buffer(outlink, s->nb_samples);
-        if (!out)
-            return AVERROR(ENOMEM);
-    }
+    out = ff_get_audio_buffer(outlink, s->conv.min_part_size);
+    if (!out)
+        return AVERROR(ENOMEM);
+    out->nb_samples = s->nb_samples;
 
     s->in[0] = ff_get_audio_buffer(ctx->inputs[0], s->nb_samples);
     if (!s->in[0]) {
@@ -132,131 +65,77 @@ static int fir_frame(AudioFIRContext *s, AVFilterLink *outlink)
         return AVERROR(ENOMEM);
     }
 
-    av_audio_fifo_peek(s->fifo[0], (void **)s->in[0]->extended_data, s->nb_samples);
+    av_audio_fifo_read(s->fifo[0], (void **)s->in[0]->extended_data, s->nb_samples);
 
     ctx->internal->execute(ctx, fir_channel, out, NULL, outlink->channels);
+    ff_partconv_next(&s->conv);
 
-    s->part_index = (s->part_index + 1) % s->nb_partitions;
-
-    av_audio_fifo_drain(s->fifo[0], s->nb_samples);
-
-    if (!s->want_skip) {
-        out->pts = s->pts;
-        if (s->pts != AV_NOPTS_VALUE)
-            s->pts += av_rescale_q(out->nb_samples, (AVRational){1, outlink->sample_rate}, outlink->time_base);
-    }
-
-    s->index++;
-    if (s->index == 3)
-        s->index = 0;
+    out->pts = s->pts;
+    if (s->pts != AV_NOPTS_VALUE)
+        s->pts += av_rescale_q(out->nb_samples, (AVRational){1, outlink->sample_rate}, outlink->time_base);
 
     av_frame_free(&s->in[0]);
 
-    if (s->want_skip == 1) {
-        s->want_skip = 0;
-        ret = 0;
-    } else {
-        ret = ff_filter_frame(outlink, out);
-    }
-
-    return ret;
+    return ff_filter_frame(outlink, out);
 }
 
 static int convert_coeffs(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
-    int i, ch, n, N;
+    int i, n, ch, ret, part_size, minp, maxp;
     float power = 0;
 
     s->nb_taps = av_audio_fifo_size(s->fifo[1]);
     if (s->nb_taps <= 0)
         return AVERROR(EINVAL);
 
+    /* unless set, use uniform partitions of half the IR length rounded up
+     * to a power of 2, which is what afir always did before */
     for (n = 4; (1 << n) < s->nb_taps; n++);
-    N = FFMIN(n, 16);
-    s->ir_length = 1 << n;
-    s->fft_length = (1 << (N + 1)) + 1;
-    s->part_size = 1 << (N - 1);
-    s->block_size = FFALIGN(s->fft_length, 32);
-    s->coeff_size = FFALIGN(s->part_size + 1, 32);
-    s->nb_partitions = (s->nb_taps + s->part_size - 1) / s->part_size;
-    s->nb_coeffs = s->ir_length + s->nb_partitions;
-
-    for (ch = 0; ch < ctx->inputs[0]->channels; ch++) {
-        s->sum[ch] = av_calloc(s->fft_length, sizeof(**s->sum));
-        if (!s->sum[ch])
-            return AVERROR(ENOMEM);
-    }
-
-    for (ch = 0; ch < ctx->inputs[1]->channels; ch++) {
-        s->coeff[ch] = av_calloc(s->nb_partitions * s->coeff_size, sizeof(**s->coeff));
-        if (!s->coeff[ch])
-            return AVERROR(ENOMEM);
-    }
-
-    for (ch = 0; ch < ctx->inputs[0]->channels; ch++) {
-        s->block[ch] = av_calloc(s->nb_partitions * s->block_size, sizeof(**s->block));
-        if (!s->block[ch])
-            return AVERROR(ENOMEM);
-    }
-
-    for (ch = 0; ch < ctx->inputs[0]->channels; ch++) {
-        s->rdft[ch]  = av_rdft_init(N, DFT_R2C);
-        s->irdft[ch] = av_rdft_init(N, IDFT_C2R);
-        if (!s->rdft[ch] || !s->irdft[ch])
-            return AVERROR(ENOMEM);
-    }
+    part_size = 1 << (FFMIN(n, 16) - 1);
+    minp = s->minp ? s->minp : s->maxp ? FFMIN(part_size, s->maxp) : part_size;
+    maxp = s->maxp ? s->maxp : FFMAX(part_size, minp);
+
+    ff_partconv_uninit(&s->conv);
+    ret = ff_partconv_init(&s->conv, s->nb_channels, s->nb_channels,
+                           s->nb_taps, minp, maxp);
+    if (ret < 0)
+        return ret;
+    s->conv.fcmul_add = s->fcmul_add;
 
     s->in[1] = ff_get_audio_buffer(ctx->inputs[1], s->nb_taps);
     if (!s->in[1])
         return AVERROR(ENOMEM);
 
-    s->buffer = ff_get_audio_buffer(ctx->inputs[0], s->part_size * 3);
-    if (!s->buffer)
-        return AVERROR(ENOMEM);
-
     av_audio_fifo_read(s->fifo[1], (void **)s->in[1]->extended_data, s->nb_taps);
 
     for (ch = 0; ch < ctx->inputs[1]->channels; ch++) {
-        float *time = (float *)s->in[1]->extended_data[!s->one2many * ch];
-        float *block = s->block[ch];
-        FFTComplex *coeff = s->coeff[ch];
+        float *time = (float *)s->in[1]->extended_data[ch];
 
         power += s->fdsp->scalarproduct_float(time, time, s->nb_taps);
 
         for (i = FFMAX(1, s->length * s->nb_taps); i < s->nb_taps; i++)
             time[i] = 0;
+    }
+    emms_c();
 
-        for (i = 0; i < s->nb_partitions; i++) {
-            const float scale = 1.f / s->part_size;
-            const int toffset = i * s->part_size;
-            const int coffset = i * s->coeff_size;
-            const int boffset = s->part_size;
-            const int remaining = s->nb_taps - (i * s->part_size);
-            const int size = remaining >= s->part_size ? s->part_size : remaining;
-
-            memset(block, 0, sizeof(*block) * s->fft_length);
-            memcpy(block + boffset, time + toffset, size * sizeof(*block));
-
-            av_rdft_calc(s->rdft[0], block);
-
-            coeff[coffset].re = block[0] * scale;
-            coeff[coffset].im = 0;
-            for (n = 1; n < s->part_size; n++) {
-                coeff[coffset + n].re = block[2 * n] * scale;
-                coeff[coffset + n].im = block[2 * n + 1] * scale;
-            }
-            coeff[coffset + s->part_size].re = block[1] * scale;
-            coeff[coffset + s->part_size].im = 0;
-        }
+    s->gain = s->again ? 1.f / sqrtf(power / ctx->inputs[1]->channels) : 1.f;
+
+    for (ch = 0; ch < s->nb_channels; ch++) {
+        const float *time = (const float *)s->in[1]->extended_data[!s->one2many * ch];
+
+        ret = ff_partconv_set_ir(&s->conv, ch, ch, time, s->nb_taps, 1,
+                                 s->dry_gain * s->wet_gain * s->gain);
+        if (ret < 0)
+            return ret;
     }
 
     av_frame_free(&s->in[1]);
-    s->gain = s->again ? 1.f / sqrtf(power / ctx->inputs[1]->channels) : 1.f;
     av_log(ctx, AV_LOG_DEBUG, "nb_taps: %d\n", s->nb_taps);
-    av_log(ctx, AV_LOG_DEBUG, "nb_partitions: %d\n", s->nb_partitions);
-    av_log(ctx, AV_LOG_DEBUG, "partition size: %d\n", s->part_size);
-    av_log(ctx, AV_LOG_DEBUG, "ir_length: %d\n", s->ir_length);
+    av_log(ctx, AV_LOG_DEBUG, "nb_segments: %d\n", s->conv.nb_segments);
+    for (i = 0; i < s->conv.nb_segments; i++)
+        av_log(ctx, AV_LOG_DEBUG, "segment %d: %d partitions of %d samples\n",
+               i, s->conv.seg[i].nb_partitions, s->conv.seg[i].part_size);
 
     s->have_coeffs = 1;
 
@@ -304,7 +183,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *frame)
     }
 
     if (s->have_coeffs) {
-        while (av_audio_fifo_size(s->fifo[0]) >= s->part_size) {
+        while (av_audio_fifo_size(s->fifo[0]) >= s->conv.min_part_size) {
             ret = fir_frame(s, outlink);
             if (ret < 0)
                 break;
@@ -329,17 +208,6 @@ static int request_frame(AVFilterLink *outlink)
     }
     ret = ff_request_frame(ctx->inputs[0]);
     if (ret == AVERROR_EOF && s->have_coeffs) {
-        if (s->need_padding) {
-            AVFrame *silence = ff_get_audio_buffer(outlink, s->part_size);
-
-            if (!silence)
-                return AVERROR(ENOMEM);
-            av_audio_fifo_write(s->fifo[0], (void **)silence->extended_data,
-                        silence->nb_samples);
-            av_frame_free(&silence);
-            s->need_padding = 0;
-        }
-
         while (av_audio_fifo_size(s->fifo[0]) > 0) {
             ret = fir_frame(s, outlink);
             if (ret < 0)
@@ -402,18 +270,8 @@ static int config_output(AVFilterLink *outlink)
     if (!s->fifo[0] || !s->fifo[1])
         return AVERROR(ENOMEM);
 
-    s->sum = av_calloc(outlink->channels, sizeof(*s->sum));
-    s->coeff = av_calloc(ctx->inputs[1]->channels, sizeof(*s->coeff));
-    s->block = av_calloc(ctx->inputs[0]->channels, sizeof(*s->block));
-    s->rdft = av_calloc(outlink->channels, sizeof(*s->rdft));
-    s->irdft = av_calloc(outlink->channels, sizeof(*s->irdft));
-    if (!s->sum || !s->coeff || !s->block || !s->rdft || !s->irdft)
-        return AVERROR(ENOMEM);
-
     s->nb_channels = outlink->channels;
     s->nb_coef_channels = ctx->inputs[1]->channels;
-    s->want_skip = 1;
-    s->need_padding = 1;
     s->pts = AV_NOPTS_VALUE;
 
     return 0;
@@ -422,46 +280,11 @@ static int config_output(AVFilterLink *outlink)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
-    int ch;
-
-    if (s->sum) {
-        for (ch = 0; ch < s->nb_channels; ch++) {
-            av_freep(&s->sum[ch]);
-        }
-    }
-    av_freep(&s->sum);
-
-    if (s->coeff) {
-        for (ch = 0; ch < s->nb_coef_channels; ch++) {
-            av_freep(&s->coeff[ch]);
-        }
-    }
-    av_freep(&s->coeff);
 
-    if (s->block) {
-        for (ch = 0; ch < s->nb_channels; ch++) {
-            av_freep(&s->block[ch]);
-        }
-    }
-    av_freep(&s->block);
-
-    if (s->rdft) {
-        for (ch = 0; ch < s->nb_channels; ch++) {
-            av_rdft_end(s->rdft[ch]);
-        }
-    }
-    av_freep(&s->rdft);
-
-    if (s->irdft) {
-        for (ch = 0; ch < s->nb_channels; ch++) {
-            av_rdft_end(s->irdft[ch]);
-        }
-    }
-    av_freep(&s->irdft);
+    ff_partconv_uninit(&s->conv);
 
     av_frame_free(&s->in[0]);
     av_frame_free(&s->in[1]);
-    av_frame_free(&s->buffer);
 
     av_audio_fifo_free(s->fifo[0]);
     av_audio_fifo_free(s->fifo[1]);
@@ -473,7 +296,7 @@ static av_cold int init(AVFilterContext *ctx)
 {
     AudioFIRContext *s = ctx->priv;
 
-    s->fcmul_add = fcmul_add_c;
+    s->fcmul_add = ff_partconv_fcmul_add_c;
 
     s->fdsp = avpriv_float_dsp_alloc(0);
     if (!s->fdsp)
@@ -516,6 +339,8 @@ static const AVOption afir_options[] = {
     { "wet",    "set wet gain",     OFFSET(wet_gain), AV_OPT_TYPE_FLOAT, {.dbl=1}, 0, 1, AF },
     { "length", "set IR length",    OFFSET(length),   AV_OPT_TYPE_FLOAT, {.dbl=1}, 0, 1, AF },
     { "again",  "enable auto gain", OFFSET(again),    AV_OPT_TYPE_BOOL,  {.i64=1}, 0, 1, AF },
+    { "minp",   "set min partition size", OFFSET(minp), AV_OPT_TYPE_INT, {.i64=0},    0, 32768, AF },
+    { "maxp",   "set max partition size", OFFSET(maxp), AV_OPT_TYPE_INT, {.i64=0},    0, 32768, AF },
     { NULL }
 };
 
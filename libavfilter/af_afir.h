@@ -31,6 +31,7 @@
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
+#include "partconv.h"
 
 #define MAX_IR_DURATION 30
 
@@ -41,37 +42,24 @@ typedef struct AudioFIRContext {
     float dry_gain;
     float length;
     int again;
+    int minp;
+    int maxp;
 
     float gain;
 
     int eof_coeffs;
     int have_coeffs;
-    int nb_coeffs;
     int nb_taps;
-    int part_size;
-    int part_index;
-    int coeff_size;
-    int block_size;
-    int nb_partitions;
     int nb_channels;
-    int ir_length;
-    int fft_length;
     int nb_coef_channels;
     int one2many;
     int nb_samples;
-    int want_skip;
-    int need_padding;
 
-    RDFTContext **rdft, **irdft;
-    float **sum;
-    float **block;
-    FFTComplex **coeff;
+    PartConvContext conv;
 
     AVAudioFifo *fifo[2];
     AVFrame *in[2];
-    AVFrame *buffer;
     int64_t pts;
-    int index;
 
     AVFloatDSPContext *fdsp;
     void (*fcmul_add)(float *sum, const float *t, const float *c,
@@ -48,6 +48,9 @@
 #define INPUT_ON       1    /**< input is active */
 #define INPUT_EOF      2    /**< input has reached EOF (may still be active) */
 
+/** number of elements of each input mixed at a time, a multiple of 16 */
+#define MIX_BLOCK_SIZE 1024
+
 #define DURATION_LONGEST  0
 #define DURATION_SHORTEST 1
 #define DURATION_FIRST    2
@@ -72,6 +75,7 @@ typedef struct FrameList {
     int nb_samples;
     FrameInfo *list;
     FrameInfo *end;
+    FrameInfo *unused;          /**< removed entries kept for reuse */
 } FrameList;
 
 static void frame_list_clear(FrameList *frame_list)
@@ -82,6 +86,11 @@ static void frame_list_clear(FrameList *frame_list)
             frame_list->list = info->next;
             av_free(info);
         }
+        while (frame_list->unused) {
+            FrameInfo *info = frame_list->unused;
+            frame_list->unused = info->next;
+            av_free(info);
+        }
         frame_list->nb_frames  = 0;
         frame_list->nb_samples = 0;
         frame_list->end        = NULL;
@@ -105,7 +114,14 @@ static int64_t frame_list_next_pts(FrameList *frame_list)
 static void frame_list_remove_samples(FrameList *frame_list, int nb_samples)
 {
     if (nb_samples >= frame_list->nb_samples) {
-        frame_list_clear(frame_list);
+        if (frame_list->end) {
+            frame_list->end->next = frame_list->unused;
+            frame_list->unused    = frame_list->list;
+        }
+        frame_list->list       = NULL;
+        frame_list->end        = NULL;
+        frame_list->nb_frames  = 0;
+        frame_list->nb_samples = 0;
     } else {
         int samples = nb_samples;
         while (samples > 0) {
@@ -118,7 +134,8 @@ static void frame_list_remove_samples(FrameList *frame_list, int nb_samples)
                     frame_list->end = NULL;
                 frame_list->nb_frames--;
                 frame_list->nb_samples -= info->nb_samples;
-                av_free(info);
+                info->next = frame_list->unused;
+                frame_list->unused = info;
             } else {
                 info->nb_samples       -= samples;
                 info->pts              += samples;
@@ -131,9 +148,15 @@ static void frame_list_remove_samples(FrameList *frame_list, int nb_samples)
 
 static int frame_list_add_frame(FrameList *frame_list, int nb_samples, int64_t pts)
 {
-    FrameInfo *info = av_malloc(sizeof(*info));
-    if (!info)
-        return AVERROR(ENOMEM);
+    FrameInfo *info = frame_list->unused;
+
+    if (info) {
+        frame_list->unused = info->next;
+    } else {
+        info = av_malloc(sizeof(*info));
+        if (!info)
+            return AVERROR(ENOMEM);
+    }
     info->nb_samples = nb_samples;
     info->pts        = pts;
     info->next       = NULL;
@@ -172,8 +195,15 @@ typedef struct MixContext {
     float scale_norm;           /**< normalization factor for all inputs */
     int64_t next_pts;           /**< calculated pts for next output frame */
     FrameList *frame_list;      /**< list of frame info for the first input */
+    AVFrame **in_bufs;          /**< samples read from the FIFO of each input */
+    int in_bufs_size;           /**< number of samples allocated in in_bufs */
 } MixContext;
 
+typedef struct ThreadData {
+    AVFrame *out;
+    int nb_samples;
+} ThreadData;
+
 #define OFFSET(x) offsetof(MixContext, x)
 #define A AV_OPT_FLAG_AUDIO_PARAM
 #define F AV_OPT_FLAG_FILTERING_PARAM
@@ -265,6 +295,98 @@ static int config_output(AVFilterLink *outlink)
     return 0;
 }
 
+/**
+ * Make sure each input has a buffer large enough for nb_samples samples,
+ * padded so that the mixing functions may process multiples of 16 elements.
+ */
+static int alloc_in_bufs(AVFilterLink *outlink, int nb_samples)
+{
+    MixContext *s = outlink->src->priv;
+    int i, ret;
+
+    if (s->in_bufs && s->in_bufs_size >= nb_samples)
+        return 0;
+
+    if (!s->in_bufs) {
+        s->in_bufs = av_mallocz_array(s->nb_inputs, sizeof(*s->in_bufs));
+        if (!s->in_bufs)
+            return AVERROR(ENOMEM);
+    }
+
+    s->in_bufs_size = 0;
+    for (i = 0; i < s->nb_inputs; i++) {
+        AVFrame *buf;
+
+        av_frame_free(&s->in_bufs[i]);
+        buf = s->in_bufs[i] = av_frame_alloc();
+        if (!buf)
+            return AVERROR(ENOMEM);
+
+        buf->format         = outlink->format;
+        buf->channel_layout = outlink->channel_layout;
+        buf->channels       = outlink->channels;
+        buf->nb_samples     = FFALIGN(nb_samples, 16);
+        ret = av_frame_get_buffer(buf, 0);
+        if (ret < 0)
+            return ret;
+    }
+    s->in_bufs_size = FFALIGN(nb_samples, 16);
+
+    return 0;
+}
+
+/**
+ * Mix all active inputs into a part of the output frame.
+ *
+ * Planar samples are split across jobs by channel, packed samples by
+ * ranges of 16 elements. Each job mixes MIX_BLOCK_SIZE elements of all
+ * inputs at a time, so that the output block stays in cache.
+ */
+static int mix_samples(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MixContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *out = td->out;
+    const int is_float = out->format == AV_SAMPLE_FMT_FLT ||
+                         out->format == AV_SAMPLE_FMT_FLTP;
+    const int plane_size = FFALIGN(td->nb_samples * (s->planar ? 1 : s->nb_channels), 16);
+    int p, start, end, i, len, pos;
+    int plane_start = 0, plane_end = 1;
+
+    if (s->planar) {
+        plane_start = (s->nb_channels *  jobnr   ) / nb_jobs;
+        plane_end   = (s->nb_channels * (jobnr+1)) / nb_jobs;
+        start       = 0;
+        end         = plane_size;
+    } else {
+        start = 16 * ((plane_size / 16 *  jobnr   ) / nb_jobs);
+        end   = 16 * ((plane_size / 16 * (jobnr+1)) / nb_jobs);
+    }
+
+    for (p = plane_start; p < plane_end; p++) {
+        for (pos = start; pos < end; pos += MIX_BLOCK_SIZE) {
+            len = FFMIN(MIX_BLOCK_SIZE, end - pos);
+
+            for (i = 0; i < s->nb_inputs; i++) {
+                if (!(s->input_state[i] & INPUT_ON))
+                    continue;
+
+                if (is_float) {
+                    s->fdsp->vector_fmac_scalar((float *)out->extended_data[p] + pos,
+                                                (float *)s->in_bufs[i]->extended_data[p] + pos,
+                                                s->input_scale[i], len);
+                } else {
+                    s->fdsp->vector_dmac_scalar((double *)out->extended_data[p] + pos,
+                                                (double *)s->in_bufs[i]->extended_data[p] + pos,
+                                                s->input_scale[i], len);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Read samples from the input FIFOs, mix, and write to the output link.
  */
@@ -272,8 +394,9 @@ static int output_frame(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
     MixContext      *s = ctx->priv;
-    AVFrame *out_buf, *in_buf;
-    int nb_samples, ns, i;
+    AVFrame *out_buf;
+    ThreadData td;
+    int nb_samples, nb_jobs, ns, i, ret;
 
     if (s->input_state[0] & INPUT_ON) {
         /* first input live: use the corresponding frame size */
@@ -313,44 +436,28 @@ static int output_frame(AVFilterLink *outlink)
     if (nb_samples == 0)
         return 0;
 
+    ret = alloc_in_bufs(outlink, nb_samples);
+    if (ret < 0)
+        return ret;
+
     out_buf = ff_get_audio_buffer(outlink, nb_samples);
     if (!out_buf)
         return AVERROR(ENOMEM);
 
-    in_buf = ff_get_audio_buffer(outlink, nb_samples);
-    if (!in_buf) {
-        av_frame_free(&out_buf);
-        return AVERROR(ENOMEM);
-    }
-
     for (i = 0; i < s->nb_inputs; i++) {
-        if (s->input_state[i] & INPUT_ON) {
-            int planes, plane_size, p;
-
-            av_audio_fifo_read(s->fifos[i], (void **)in_buf->extended_data,
+        if (s->input_state[i] & INPUT_ON)
+            av_audio_fifo_read(s->fifos[i], (void **)s->in_bufs[i]->extended_data,
                                nb_samples);
-
-            planes     = s->planar ? s->nb_channels : 1;
-            plane_size = nb_samples * (s->planar ? 1 : s->nb_channels);
-            plane_size = FFALIGN(plane_size, 16);
-
-            if (out_buf->format == AV_SAMPLE_FMT_FLT ||
-                out_buf->format == AV_SAMPLE_FMT_FLTP) {
-                for (p = 0; p < planes; p++) {
-                    s->fdsp->vector_fmac_scalar((float *)out_buf->extended_data[p],
-                                                (float *) in_buf->extended_data[p],
-                                                s->input_scale[i], plane_size);
-                }
-            } else {
-                for (p = 0; p < planes; p++) {
-                    s->fdsp->vector_dmac_scalar((double *)out_buf->extended_data[p],
-                                                (double *) in_buf->extended_data[p],
-                                                s->input_scale[i], plane_size);
-                }
-            }
-        }
     }
-    av_frame_free(&in_buf);
+
+    td.out        = out_buf;
+    td.nb_samples = nb_samples;
+    if (s->planar)
+        nb_jobs = FFMIN(s->nb_channels, ff_filter_get_nb_threads(ctx));
+    else
+        nb_jobs = FFMIN(FFALIGN(nb_samples * s->nb_channels, 16) / 16,
+                        ff_filter_get_nb_threads(ctx));
+    ctx->internal->execute(ctx, mix_samples, &td, NULL, nb_jobs);
 
     out_buf->pts = s->next_pts;
     if (s->next_pts != AV_NOPTS_VALUE)
@@ -527,6 +634,11 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->input_state);
     av_freep(&s->input_scale);
     av_freep(&s->fdsp);
+    if (s->in_bufs) {
+        for (i = 0; i < s->nb_inputs; i++)
+            av_frame_free(&s->in_bufs[i]);
+        av_freep(&s->in_bufs);
+    }
 
     for (i = 0; i < ctx->nb_inputs; i++)
         av_freep(&ctx->input_pads[i].name);
@@ -580,5 +692,5 @@ AVFilter ff_af_amix = {
     .query_formats  = query_formats,
     .inputs         = NULL,
     .outputs        = avfilter_af_amix_outputs,
-    .flags          = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .flags          = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -698,19 +698,23 @@ static double process_sample(FoSection *s1, double in)
     return p1;
 }
 
-static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
+static int filter_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    AVFilterContext *ctx = inlink->dst;
     AudioNEqualizerContext *s = ctx->priv;
-    AVFilterLink *outlink = ctx->outputs[0];
+    AVFrame *buf = arg;
+    const int start = (buf->channels * jobnr) / nb_jobs;
+    const int end = (buf->channels * (jobnr+1)) / nb_jobs;
     double *bptr;
     int i, n;
 
+    /* every channel only depends on its own filters, applied in order */
     for (i = 0; i < s->nb_filters; i++) {
         EqualizatorFilter *f = &s->filters[i];
 
         if (f->gain == 0. || f->ignore)
             continue;
+        if (f->channel < start || f->channel >= end)
+            continue;
 
         bptr = (double *)buf->extended_data[f->channel];
         for (n = 0; n < buf->nb_samples; n++) {
@@ -721,6 +725,18 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
         }
     }
 
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
+{
+    AVFilterContext *ctx = inlink->dst;
+    AudioNEqualizerContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+
+    ctx->internal->execute(ctx, filter_channels, buf, NULL,
+                           FFMIN(inlink->channels, ff_filter_get_nb_threads(ctx)));
+
     if (s->draw_curves) {
         const int64_t pts = buf->pts +
             av_rescale_q(buf->nb_samples, (AVRational){ 1, inlink->sample_rate },
@@ -757,6 +773,7 @@ AVFilter ff_af_anequalizer = {
     .query_formats = query_formats,
     .inputs        = inputs,
     .outputs       = NULL,
-    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS |
+                     AVFILTER_FLAG_SLICE_THREADS,
     .process_command = process_command,
 };
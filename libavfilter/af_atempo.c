@@ -66,10 +66,22 @@ typedef struct AudioFragment {
     int nsamples;
 
     // rDFT transform of the down-mixed mono fragment, used for
-    // fast waveform alignment via correlation in frequency domain:
+    // fast waveform alignment via correlation in frequency domain;
+    // with the coarse alignment search it holds the down-mixed
+    // mono fragment itself:
     FFTSample *xdat;
+
+    // rDFT transform of the decimated down-mixed mono fragment,
+    // used only by the coarse alignment search:
+    FFTSample *xdat_coarse;
 } AudioFragment;
 
+/**
+ * The coarse alignment search correlates fragments decimated
+ * by 1 << YAE_COARSE_LEVELS.
+ */
+#define YAE_COARSE_LEVELS 2
+
 /**
  * Filter state machine states
  */
@@ -123,6 +135,11 @@ typedef struct ATempoContext {
     // tempo scaling factor:
     double tempo;
 
+    // coarse-to-fine alignment search option, and whether it is used
+    // with the current window size:
+    int coarse;
+    int coarse_search;
+
     // a snapshot of previous fragment input and output position values
     // captured when the tempo scale factor was set most recently:
     int64_t origin[2];
@@ -141,6 +158,10 @@ typedef struct ATempoContext {
     RDFTContext *complex_to_real;
     FFTSample *correlation;
 
+    // for the coarse alignment search on decimated fragments:
+    RDFTContext *real_to_complex_coarse;
+    RDFTContext *complex_to_real_coarse;
+
     // for managing AVFilterPad.request_frame and AVFilterPad.filter_frame
     AVFrame *dst_buffer;
     uint8_t *dst;
@@ -155,6 +176,9 @@ static const AVOption atempo_options[] = {
     { "tempo", "set tempo scale factor",
       OFFSET(tempo), AV_OPT_TYPE_DOUBLE, { .dbl = 1.0 }, 0.5, 2.0,
       AV_OPT_FLAG_AUDIO_PARAM | AV_OPT_FLAG_FILTERING_PARAM },
+    { "coarse", "use a coarse-to-fine alignment search",
+      OFFSET(coarse), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1,
+      AV_OPT_FLAG_AUDIO_PARAM | AV_OPT_FLAG_FILTERING_PARAM },
     { NULL }
 };
 
@@ -221,6 +245,8 @@ static void yae_release_buffers(ATempoContext *atempo)
     av_freep(&atempo->frag[1].data);
     av_freep(&atempo->frag[0].xdat);
     av_freep(&atempo->frag[1].xdat);
+    av_freep(&atempo->frag[0].xdat_coarse);
+    av_freep(&atempo->frag[1].xdat_coarse);
 
     av_freep(&atempo->buffer);
     av_freep(&atempo->hann);
@@ -231,6 +257,12 @@ static void yae_release_buffers(ATempoContext *atempo)
 
     av_rdft_end(atempo->complex_to_real);
     atempo->complex_to_real = NULL;
+
+    av_rdft_end(atempo->real_to_complex_coarse);
+    atempo->real_to_complex_coarse = NULL;
+
+    av_rdft_end(atempo->complex_to_real_coarse);
+    atempo->complex_to_real_coarse = NULL;
 }
 
 /* av_realloc is not aligned enough; fortunately, the data does not need to
@@ -289,16 +321,47 @@ static int yae_reset(ATempoContext *atempo,
     av_rdft_end(atempo->complex_to_real);
     atempo->complex_to_real = NULL;
 
-    atempo->real_to_complex = av_rdft_init(nlevels + 1, DFT_R2C);
-    if (!atempo->real_to_complex) {
-        yae_release_buffers(atempo);
-        return AVERROR(ENOMEM);
-    }
+    av_rdft_end(atempo->real_to_complex_coarse);
+    atempo->real_to_complex_coarse = NULL;
 
-    atempo->complex_to_real = av_rdft_init(nlevels + 1, IDFT_C2R);
-    if (!atempo->complex_to_real) {
-        yae_release_buffers(atempo);
-        return AVERROR(ENOMEM);
+    av_rdft_end(atempo->complex_to_real_coarse);
+    atempo->complex_to_real_coarse = NULL;
+
+    // the decimated transform must not get too short to be meaningful:
+    atempo->coarse_search = atempo->coarse &&
+                            nlevels >= YAE_COARSE_LEVELS + 5;
+
+    if (atempo->coarse_search) {
+        const int nbits = nlevels + 1 - YAE_COARSE_LEVELS;
+        const int xdat_size = (atempo->window >> YAE_COARSE_LEVELS) *
+                              sizeof(FFTComplex);
+
+        RE_MALLOC_OR_FAIL(atempo->frag[0].xdat_coarse, xdat_size);
+        RE_MALLOC_OR_FAIL(atempo->frag[1].xdat_coarse, xdat_size);
+
+        atempo->real_to_complex_coarse = av_rdft_init(nbits, DFT_R2C);
+        if (!atempo->real_to_complex_coarse) {
+            yae_release_buffers(atempo);
+            return AVERROR(ENOMEM);
+        }
+
+        atempo->complex_to_real_coarse = av_rdft_init(nbits, IDFT_C2R);
+        if (!atempo->complex_to_real_coarse) {
+            yae_release_buffers(atempo);
+            return AVERROR(ENOMEM);
+        }
+    } else {
+        atempo->real_to_complex = av_rdft_init(nlevels + 1, DFT_R2C);
+        if (!atempo->real_to_complex) {
+            yae_release_buffers(atempo);
+            return AVERROR(ENOMEM);
+        }
+
+        atempo->complex_to_real = av_rdft_init(nlevels + 1, IDFT_C2R);
+        if (!atempo->complex_to_real) {
+            yae_release_buffers(atempo);
+            return AVERROR(ENOMEM);
+        }
     }
 
     RE_MALLOC_OR_FAIL(atempo->correlation, atempo->window * sizeof(FFTComplex));
@@ -347,50 +410,46 @@ static int yae_set_tempo(AVFilterContext *ctx, const char *arg_tempo)
 /**
  * A helper macro for initializing complex data buffer with scalar data
  * of a given type.
+ *
+ * Channels are visited one at a time, so that the per-sample loops carry
+ * no dependency between samples and can be vectorized.  The magnitude of
+ * the loudest channel so far is kept in the upper half of the buffer,
+ * which is zero padding for the rDFT and is cleared again afterwards.
  */
 #define yae_init_xdat(scalar_type, scalar_max)                          \
     do {                                                                \
-        const uint8_t *src_end = src +                                  \
-            frag->nsamples * atempo->channels * sizeof(scalar_type);    \
+        const scalar_type *src = (const scalar_type *)frag->data;       \
+        const int channels = atempo->channels;                          \
+        const int nsamples = frag->nsamples;                            \
                                                                         \
         FFTSample *xdat = frag->xdat;                                   \
-        scalar_type tmp;                                                \
+        FFTSample *smax = frag->xdat + atempo->window;                  \
+        int i, j;                                                       \
                                                                         \
-        if (atempo->channels == 1) {                                    \
-            for (; src < src_end; xdat++) {                             \
-                tmp = *(const scalar_type *)src;                        \
-                src += sizeof(scalar_type);                             \
-                                                                        \
-                *xdat = (FFTSample)tmp;                                 \
-            }                                                           \
+        if (channels == 1) {                                            \
+            for (i = 0; i < nsamples; i++)                              \
+                xdat[i] = (FFTSample)src[i];                            \
         } else {                                                        \
-            FFTSample s, max, ti, si;                                   \
-            int i;                                                      \
-                                                                        \
-            for (; src < src_end; xdat++) {                             \
-                tmp = *(const scalar_type *)src;                        \
-                src += sizeof(scalar_type);                             \
-                                                                        \
-                max = (FFTSample)tmp;                                   \
-                s = FFMIN((FFTSample)scalar_max,                        \
-                          (FFTSample)fabsf(max));                       \
-                                                                        \
-                for (i = 1; i < atempo->channels; i++) {                \
-                    tmp = *(const scalar_type *)src;                    \
-                    src += sizeof(scalar_type);                         \
+            for (i = 0; i < nsamples; i++) {                            \
+                xdat[i] = (FFTSample)src[i * channels];                 \
+                smax[i] = FFMIN((FFTSample)scalar_max,                  \
+                                (FFTSample)fabsf(xdat[i]));             \
+            }                                                           \
                                                                         \
-                    ti = (FFTSample)tmp;                                \
-                    si = FFMIN((FFTSample)scalar_max,                   \
-                               (FFTSample)fabsf(ti));                   \
+            for (j = 1; j < channels; j++) {                            \
+                for (i = 0; i < nsamples; i++) {                        \
+                    const FFTSample ti =                                \
+                        (FFTSample)src[i * channels + j];               \
+                    const FFTSample si =                                \
+                        FFMIN((FFTSample)scalar_max,                    \
+                              (FFTSample)fabsf(ti));                    \
                                                                         \
-                    if (s < si) {                                       \
-                        s   = si;                                       \
-                        max = ti;                                       \
-                    }                                                   \
+                    xdat[i] = smax[i] < si ? ti : xdat[i];              \
+                    smax[i] = smax[i] < si ? si : smax[i];              \
                 }                                                       \
-                                                                        \
-                *xdat = max;                                            \
             }                                                           \
+                                                                        \
+            memset(smax, 0, nsamples * sizeof(*smax));                  \
         }                                                               \
     } while (0)
 
@@ -400,11 +459,11 @@ static int yae_set_tempo(AVFilterContext *ctx, const char *arg_tempo)
  */
 static void yae_downmix(ATempoContext *atempo, AudioFragment *frag)
 {
-    // shortcuts:
-    const uint8_t *src = frag->data;
-
-    // init complex data buffer used for FFT and Correlation:
-    memset(frag->xdat, 0, sizeof(FFTComplex) * atempo->window);
+    // init complex data buffer used for FFT and Correlation,
+    // only the padding past the fragment samples needs to be cleared:
+    memset(frag->xdat + frag->nsamples, 0,
+           sizeof(FFTComplex) * atempo->window -
+           sizeof(FFTSample) * frag->nsamples);
 
     if (atempo->format == AV_SAMPLE_FMT_U8) {
         yae_init_xdat(uint8_t, 127);
@@ -419,6 +478,47 @@ static void yae_downmix(ATempoContext *atempo, AudioFragment *frag)
     }
 }
 
+/**
+ * Initialize the coarse complex data buffer of a given audio fragment
+ * with the down-mixed mono data decimated by 1 << YAE_COARSE_LEVELS.
+ */
+static void yae_decimate(ATempoContext *atempo, AudioFragment *frag)
+{
+    // shortcuts:
+    const int decimation = 1 << YAE_COARSE_LEVELS;
+    const int window = atempo->window >> YAE_COARSE_LEVELS;
+    const FFTSample *xdat = frag->xdat;
+    FFTSample *xdat_coarse = frag->xdat_coarse;
+    int i, j;
+
+    // a box filter is a poor anti-aliasing filter, but good enough
+    // for locating the correlation peak to within a few samples:
+    for (i = 0; i < window; i++, xdat += decimation) {
+        FFTSample sum = 0;
+
+        for (j = 0; j < decimation; j++)
+            sum += xdat[j];
+
+        xdat_coarse[i] = sum;
+    }
+
+    memset(xdat_coarse + window, 0, sizeof(FFTSample) * window);
+}
+
+/**
+ * Transform the down-mixed mono fragment for the alignment search.
+ */
+static void yae_transform(ATempoContext *atempo, AudioFragment *frag)
+{
+    if (atempo->coarse_search) {
+        // the down-mixed fragment is kept for the fine search:
+        yae_decimate(atempo, frag);
+        av_rdft_calc(atempo->real_to_complex_coarse, frag->xdat_coarse);
+    } else {
+        av_rdft_calc(atempo->real_to_complex, frag->xdat);
+    }
+}
+
 /**
  * Populate the internal data buffer on as-needed basis.
  *
@@ -631,6 +731,50 @@ static void yae_xcorr_via_rdft(FFTSample *xcorr,
     av_rdft_calc(complex_to_real, xcorr);
 }
 
+/**
+ * Find the best cross-correlation peak within the alignment search window.
+ *
+ * @return alignment offset of current fragment relative to previous.
+ */
+static int yae_find_peak(const FFTSample *correlation,
+                         const int window,
+                         const int delta_max,
+                         const int drift)
+{
+    int       best_offset = -drift;
+    FFTSample best_metric = -FLT_MAX;
+    const FFTSample *xcorr;
+
+    int i0;
+    int i1;
+    int i;
+
+    // identify search window boundaries:
+    i0 = FFMAX(window / 2 - delta_max - drift, 0);
+    i0 = FFMIN(i0, window);
+
+    i1 = FFMIN(window / 2 + delta_max - drift, window - window / 16);
+    i1 = FFMAX(i1, 0);
+
+    // identify cross-correlation peaks within search window:
+    xcorr = correlation + i0;
+
+    for (i = i0; i < i1; i++, xcorr++) {
+        FFTSample metric = *xcorr;
+
+        // normalize:
+        FFTSample drifti = (FFTSample)(drift + i);
+        metric *= drifti * (FFTSample)(i - i0) * (FFTSample)(i1 - i);
+
+        if (metric > best_metric) {
+            best_metric = metric;
+            best_offset = i - window / 2;
+        }
+    }
+
+    return best_offset;
+}
+
 /**
  * Calculate alignment offset for given fragment
  * relative to the previous fragment.
@@ -645,35 +789,77 @@ static int yae_align(AudioFragment *frag,
                      FFTSample *correlation,
                      RDFTContext *complex_to_real)
 {
+    yae_xcorr_via_rdft(correlation,
+                       complex_to_real,
+                       (const FFTComplex *)prev->xdat,
+                       (const FFTComplex *)frag->xdat,
+                       window);
+
+    return yae_find_peak(correlation, window, delta_max, drift);
+}
+
+/**
+ * Calculate alignment offset for given fragment relative to the previous
+ * fragment, first on the decimated fragments, then refined by direct
+ * correlation of the full rate down-mixed fragments around the coarse
+ * estimate.
+ *
+ * @return alignment offset of current fragment relative to previous.
+ */
+static int yae_align_coarse(AudioFragment *frag,
+                            const AudioFragment *prev,
+                            const int window,
+                            const int delta_max,
+                            const int drift,
+                            FFTSample *correlation,
+                            RDFTContext *complex_to_real)
+{
+    const int decimation = 1 << YAE_COARSE_LEVELS;
+    const FFTSample *xa = prev->xdat;
+    const FFTSample *xb = frag->xdat;
+
     int       best_offset = -drift;
     FFTSample best_metric = -FLT_MAX;
-    FFTSample *xcorr;
 
+    int center;
     int i0;
     int i1;
     int i;
+    int j;
 
     yae_xcorr_via_rdft(correlation,
                        complex_to_real,
-                       (const FFTComplex *)prev->xdat,
-                       (const FFTComplex *)frag->xdat,
-                       window);
+                       (const FFTComplex *)prev->xdat_coarse,
+                       (const FFTComplex *)frag->xdat_coarse,
+                       window >> YAE_COARSE_LEVELS);
 
-    // identify search window boundaries:
+    center = yae_find_peak(correlation,
+                           window >> YAE_COARSE_LEVELS,
+                           delta_max >> YAE_COARSE_LEVELS,
+                           drift / decimation) * decimation + window / 2;
+
+    // identify search window boundaries at full rate:
     i0 = FFMAX(window / 2 - delta_max - drift, 0);
     i0 = FFMIN(i0, window);
 
     i1 = FFMIN(window / 2 + delta_max - drift, window - window / 16);
     i1 = FFMAX(i1, 0);
 
-    // identify cross-correlation peaks within search window:
-    xcorr = correlation + i0;
+    if (i0 >= i1)
+        return best_offset;
 
-    for (i = i0; i < i1; i++, xcorr++) {
-        FFTSample metric = *xcorr;
+    // refine around the coarse estimate:
+    center = av_clip(center, i0, i1 - 1);
 
-        // normalize:
+    for (i = FFMAX(center - decimation, i0);
+         i <= FFMIN(center + decimation, i1 - 1); i++) {
+        FFTSample metric = 0;
         FFTSample drifti = (FFTSample)(drift + i);
+
+        for (j = 0; j < window - i; j++)
+            metric += xa[i + j] * xb[j];
+
+        // normalize:
         metric *= drifti * (FFTSample)(i - i0) * (FFTSample)(i1 - i);
 
         if (metric > best_metric) {
@@ -706,13 +892,21 @@ static int yae_adjust_position(ATempoContext *atempo)
     const int drift = (int)(prev_output_position - ideal_output_position);
 
     const int delta_max  = atempo->window / 2;
-    const int correction = yae_align(frag,
-                                     prev,
-                                     atempo->window,
-                                     delta_max,
-                                     drift,
-                                     atempo->correlation,
-                                     atempo->complex_to_real);
+    const int correction = atempo->coarse_search ?
+        yae_align_coarse(frag,
+                         prev,
+                         atempo->window,
+                         delta_max,
+                         drift,
+                         atempo->correlation,
+                         atempo->complex_to_real_coarse) :
+        yae_align(frag,
+                  prev,
+                  atempo->window,
+                  delta_max,
+                  drift,
+                  atempo->correlation,
+                  atempo->complex_to_real);
 
     if (correction) {
         // adjust fragment position:
@@ -736,25 +930,31 @@ static int yae_adjust_position(ATempoContext *atempo)
                                                                         \
         scalar_type *out     = (scalar_type *)dst;                      \
         scalar_type *out_end = (scalar_type *)dst_end;                  \
+        const int channels   = atempo->channels;                        \
+        const int64_t nframes = FFMIN(overlap,                          \
+                                      (out_end - out) / channels);      \
+        const int64_t head = av_clip64(-frag->position[0], 0, nframes); \
         int64_t i;                                                      \
                                                                         \
-        for (i = 0; i < overlap && out < out_end;                       \
-             i++, atempo->position[1]++, wa++, wb++) {                  \
-            float w0 = *wa;                                             \
-            float w1 = *wb;                                             \
-            int j;                                                      \
+        /* samples preceding the start of the stream pass through */    \
+        memcpy(out, aaa, head * atempo->stride);                        \
+        aaa += head * channels;                                         \
+        bbb += head * channels;                                         \
+        out += head * channels;                                         \
+        wa  += head;                                                    \
+        wb  += head;                                                    \
                                                                         \
-            for (j = 0; j < atempo->channels;                           \
-                 j++, aaa++, bbb++, out++) {                            \
-                float t0 = (float)*aaa;                                 \
-                float t1 = (float)*bbb;                                 \
+        for (i = head; i < nframes; i++, wa++, wb++,                    \
+             aaa += channels, bbb += channels, out += channels) {       \
+            const float w0 = *wa;                                       \
+            const float w1 = *wb;                                       \
+            int j;                                                      \
                                                                         \
-                *out =                                                  \
-                    frag->position[0] + i < 0 ?                         \
-                    *aaa :                                              \
-                    (scalar_type)(t0 * w0 + t1 * w1);                   \
-            }                                                           \
+            for (j = 0; j < channels; j++)                              \
+                out[j] = (scalar_type)((float)aaa[j] * w0 +             \
+                                       (float)bbb[j] * w1);             \
         }                                                               \
+        atempo->position[1] += nframes;                                 \
         dst = (uint8_t *)out;                                           \
     } while (0)
 
@@ -838,7 +1038,7 @@ yae_apply(ATempoContext *atempo,
             yae_downmix(atempo, yae_curr_frag(atempo));
 
             // apply rDFT:
-            av_rdft_calc(atempo->real_to_complex, yae_curr_frag(atempo)->xdat);
+            yae_transform(atempo, yae_curr_frag(atempo));
 
             // must load the second fragment before alignment can start:
             if (!atempo->nfrag) {
@@ -870,7 +1070,7 @@ yae_apply(ATempoContext *atempo,
             yae_downmix(atempo, yae_curr_frag(atempo));
 
             // apply rDFT:
-            av_rdft_calc(atempo->real_to_complex, yae_curr_frag(atempo)->xdat);
+            yae_transform(atempo, yae_curr_frag(atempo));
 
             atempo->state = YAE_OUTPUT_OVERLAP_ADD;
         }
@@ -934,7 +1134,7 @@ static int yae_flush(ATempoContext *atempo,
             yae_downmix(atempo, frag);
 
             // apply rDFT:
-            av_rdft_calc(atempo->real_to_complex, frag->xdat);
+            yae_transform(atempo, frag);
 
             // align current fragment to previous fragment:
             if (yae_adjust_position(atempo)) {
@@ -92,6 +92,7 @@ enum WidthType {
 typedef struct ChanCache {
     double i1, i2;
     double o1, o2;
+    int clippings;
 } ChanCache;
 
 typedef struct BiquadsContext {
@@ -111,12 +112,14 @@ typedef struct BiquadsContext {
     double b0, b1, b2;
 
     ChanCache *cache;
-    int clippings;
     int block_align;
 
     void (*filter)(struct BiquadsContext *s, const void *ibuf, void *obuf, int len,
                    double *i1, double *i2, double *o1, double *o2,
-                   double b0, double b1, double b2, double a1, double a2);
+                   double b0, double b1, double b2, double a1, double a2, int *clippings);
+    void (*filter2)(struct BiquadsContext *s, const void *const *ibuf, void *const *obuf, int len,
+                    ChanCache *const *cache,
+                    double b0, double b1, double b2, double a1, double a2, int *clippings);
 } BiquadsContext;
 
 static av_cold int init(AVFilterContext *ctx)
@@ -173,7 +176,7 @@ static void biquad_## name (BiquadsContext *s,                                \
                             double *in1, double *in2,                         \
                             double *out1, double *out2,                       \
                             double b0, double b1, double b2,                  \
-                            double a1, double a2)                             \
+                            double a1, double a2, int *clippings)             \
 {                                                                             \
     const type *ibuf = input;                                                 \
     type *obuf = output;                                                      \
@@ -189,10 +192,10 @@ static void biquad_## name (BiquadsContext *s,                                \
         o2 = i2 * b2 + i1 * b1 + ibuf[i] * b0 + o2 * a2 + o1 * a1;            \
         i2 = ibuf[i];                                                         \
         if (need_clipping && o2 < min) {                                      \
-            s->clippings++;                                                   \
+            (*clippings)++;                                                   \
             obuf[i] = min;                                                    \
         } else if (need_clipping && o2 > max) {                               \
-            s->clippings++;                                                   \
+            (*clippings)++;                                                   \
             obuf[i] = max;                                                    \
         } else {                                                              \
             obuf[i] = o2;                                                     \
@@ -201,10 +204,10 @@ static void biquad_## name (BiquadsContext *s,                                \
         o1 = i1 * b2 + i2 * b1 + ibuf[i] * b0 + o1 * a2 + o2 * a1;            \
         i1 = ibuf[i];                                                         \
         if (need_clipping && o1 < min) {                                      \
-            s->clippings++;                                                   \
+            (*clippings)++;                                                   \
             obuf[i] = min;                                                    \
         } else if (need_clipping && o1 > max) {                               \
-            s->clippings++;                                                   \
+            (*clippings)++;                                                   \
             obuf[i] = max;                                                    \
         } else {                                                              \
             obuf[i] = o1;                                                     \
@@ -217,10 +220,10 @@ static void biquad_## name (BiquadsContext *s,                                \
         o2 = o1;                                                              \
         o1 = o0;                                                              \
         if (need_clipping && o0 < min) {                                      \
-            s->clippings++;                                                   \
+            (*clippings)++;                                                   \
             obuf[i] = min;                                                    \
         } else if (need_clipping && o0 > max) {                               \
-            s->clippings++;                                                   \
+            (*clippings)++;                                                   \
             obuf[i] = max;                                                    \
         } else {                                                              \
             obuf[i] = o0;                                                     \
@@ -237,6 +240,80 @@ BIQUAD_FILTER(s32, int32_t, INT32_MIN, INT32_MAX, 1)
 BIQUAD_FILTER(flt, float,   -1., 1., 0)
 BIQUAD_FILTER(dbl, double,  -1., 1., 0)
 
+#define STORE_CLIPPED(dst, v, min, max, need_clipping)                        \
+    if (need_clipping && (v) < min) {                                         \
+        (*clippings)++;                                                       \
+        dst = min;                                                            \
+    } else if (need_clipping && (v) > max) {                                  \
+        (*clippings)++;                                                       \
+        dst = max;                                                            \
+    } else {                                                                  \
+        dst = v;                                                              \
+    }
+
+/*
+ * Filter two channels at once, one lane per channel. Each lane runs the
+ * exact same operations as biquad_*() above, in the same order, so the
+ * output is identical; the two independent recursions only let the CPU
+ * overlap their latencies.
+ */
+#define BIQUAD_FILTER2(name, type, min, max, need_clipping)                   \
+static void biquad2_## name (BiquadsContext *s,                               \
+                             const void *const *input, void *const *output,   \
+                             int len, ChanCache *const *cache,                \
+                             double b0, double b1, double b2,                 \
+                             double a1, double a2, int *clippings)            \
+{                                                                             \
+    const type *ibuf[2] = { input[0], input[1] };                             \
+    type *obuf[2] = { output[0], output[1] };                                 \
+    double i1[2], i2[2], o1[2], o2[2];                                        \
+    int i, l;                                                                 \
+    a1 = -a1;                                                                 \
+    a2 = -a2;                                                                 \
+                                                                              \
+    for (l = 0; l < 2; l++) {                                                 \
+        i1[l] = cache[l]->i1;                                                 \
+        i2[l] = cache[l]->i2;                                                 \
+        o1[l] = cache[l]->o1;                                                 \
+        o2[l] = cache[l]->o2;                                                 \
+    }                                                                         \
+                                                                              \
+    for (i = 0; i+1 < len; i += 2) {                                          \
+        for (l = 0; l < 2; l++) {                                             \
+            o2[l] = i2[l] * b2 + i1[l] * b1 + ibuf[l][i] * b0 + o2[l] * a2 + o1[l] * a1; \
+            i2[l] = ibuf[l][i];                                               \
+            STORE_CLIPPED(obuf[l][i], o2[l], min, max, need_clipping)         \
+        }                                                                     \
+        for (l = 0; l < 2; l++) {                                             \
+            o1[l] = i1[l] * b2 + i2[l] * b1 + ibuf[l][i+1] * b0 + o1[l] * a2 + o2[l] * a1; \
+            i1[l] = ibuf[l][i+1];                                             \
+            STORE_CLIPPED(obuf[l][i+1], o1[l], min, max, need_clipping)       \
+        }                                                                     \
+    }                                                                         \
+    if (i < len) {                                                            \
+        for (l = 0; l < 2; l++) {                                             \
+            double o0 = ibuf[l][i] * b0 + i1[l] * b1 + i2[l] * b2 + o1[l] * a1 + o2[l] * a2; \
+            i2[l] = i1[l];                                                    \
+            i1[l] = ibuf[l][i];                                               \
+            o2[l] = o1[l];                                                    \
+            o1[l] = o0;                                                       \
+            STORE_CLIPPED(obuf[l][i], o0, min, max, need_clipping)            \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    for (l = 0; l < 2; l++) {                                                 \
+        cache[l]->i1 = i1[l];                                                 \
+        cache[l]->i2 = i2[l];                                                 \
+        cache[l]->o1 = o1[l];                                                 \
+        cache[l]->o2 = o2[l];                                                 \
+    }                                                                         \
+}
+
+BIQUAD_FILTER2(s16, int16_t, INT16_MIN, INT16_MAX, 1)
+BIQUAD_FILTER2(s32, int32_t, INT32_MIN, INT32_MAX, 1)
+BIQUAD_FILTER2(flt, float,   -1., 1., 0)
+BIQUAD_FILTER2(dbl, double,  -1., 1., 0)
+
 static int config_output(AVFilterLink *outlink)
 {
     AVFilterContext *ctx    = outlink->src;
@@ -383,10 +460,10 @@ static int config_output(AVFilterLink *outlink)
     memset(s->cache, 0, sizeof(ChanCache) * inlink->channels);
 
     switch (inlink->format) {
-    case AV_SAMPLE_FMT_S16P: s->filter = biquad_s16; break;
-    case AV_SAMPLE_FMT_S32P: s->filter = biquad_s32; break;
-    case AV_SAMPLE_FMT_FLTP: s->filter = biquad_flt; break;
-    case AV_SAMPLE_FMT_DBLP: s->filter = biquad_dbl; break;
+    case AV_SAMPLE_FMT_S16P: s->filter = biquad_s16; s->filter2 = biquad2_s16; break;
+    case AV_SAMPLE_FMT_S32P: s->filter = biquad_s32; s->filter2 = biquad2_s32; break;
+    case AV_SAMPLE_FMT_FLTP: s->filter = biquad_flt; s->filter2 = biquad2_flt; break;
+    case AV_SAMPLE_FMT_DBLP: s->filter = biquad_dbl; s->filter2 = biquad2_dbl; break;
     default: av_assert0(0);
     }
 
@@ -395,6 +472,51 @@ static int config_output(AVFilterLink *outlink)
     return 0;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+} ThreadData;
+
+static int filter_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    AVFilterLink *inlink = ctx->inputs[0];
+    ThreadData *td = arg;
+    AVFrame *buf = td->in;
+    AVFrame *out_buf = td->out;
+    BiquadsContext *s = ctx->priv;
+    const int start = (buf->channels * jobnr) / nb_jobs;
+    const int end = (buf->channels * (jobnr+1)) / nb_jobs;
+    int ch, prev = -1;
+
+    for (ch = start; ch < end; ch++) {
+        if (!((av_channel_layout_extract_channel(inlink->channel_layout, ch) & s->channels))) {
+            if (buf != out_buf)
+                memcpy(out_buf->extended_data[ch], buf->extended_data[ch],
+                       buf->nb_samples * s->block_align);
+            continue;
+        }
+
+        /* filtered channels are paired up for the two-lane kernel */
+        if (prev < 0) {
+            prev = ch;
+        } else {
+            const void *ibuf[2] = { buf->extended_data[prev], buf->extended_data[ch] };
+            void *obuf[2] = { out_buf->extended_data[prev], out_buf->extended_data[ch] };
+            ChanCache *cache[2] = { &s->cache[prev], &s->cache[ch] };
+
+            s->filter2(s, ibuf, obuf, buf->nb_samples, cache,
+                       s->b0, s->b1, s->b2, s->a1, s->a2, &s->cache[prev].clippings);
+            prev = -1;
+        }
+    }
+
+    if (prev >= 0)
+        s->filter(s, buf->extended_data[prev], out_buf->extended_data[prev], buf->nb_samples,
+                  &s->cache[prev].i1, &s->cache[prev].i2, &s->cache[prev].o1, &s->cache[prev].o2,
+                  s->b0, s->b1, s->b2, s->a1, s->a2, &s->cache[prev].clippings);
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
 {
     AVFilterContext  *ctx = inlink->dst;
@@ -402,7 +524,8 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out_buf;
     int nb_samples = buf->nb_samples;
-    int ch;
+    ThreadData td;
+    int ch, clippings = 0;
 
     if (av_frame_is_writable(buf)) {
         out_buf = buf;
@@ -415,22 +538,16 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *buf)
         av_frame_copy_props(out_buf, buf);
     }
 
-    for (ch = 0; ch < buf->channels; ch++) {
-        if (!((av_channel_layout_extract_channel(inlink->channel_layout, ch) & s->channels))) {
-            if (buf != out_buf)
-                memcpy(out_buf->extended_data[ch], buf->extended_data[ch], nb_samples * s->block_align);
-            continue;
-        }
-        s->filter(s, buf->extended_data[ch],
-                  out_buf->extended_data[ch], nb_samples,
-                  &s->cache[ch].i1, &s->cache[ch].i2,
-                  &s->cache[ch].o1, &s->cache[ch].o2,
-                  s->b0, s->b1, s->b2, s->a1, s->a2);
-    }
+    td.in = buf;
+    td.out = out_buf;
+    ctx->internal->execute(ctx, filter_channel, &td, NULL, FFMIN(outlink->channels, ff_filter_get_nb_threads(ctx)));
 
-    if (s->clippings > 0)
-        av_log(ctx, AV_LOG_WARNING, "clipping %d times. Please reduce gain.\n", s->clippings);
-    s->clippings = 0;
+    for (ch = 0; ch < outlink->channels; ch++) {
+        clippings += s->cache[ch].clippings;
+        s->cache[ch].clippings = 0;
+    }
+    if (clippings > 0)
+        av_log(ctx, AV_LOG_WARNING, "clipping %d times. Please reduce gain.\n", clippings);
 
     if (buf != out_buf)
         av_frame_free(&buf);
@@ -486,6 +603,7 @@ AVFilter ff_af_##name_ = {                         \
     .inputs        = inputs,                             \
     .outputs       = outputs,                            \
     .priv_class    = &name_##_class,                     \
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,        \
 }
 
 #if CONFIG_EQUALIZER_FILTER
@@ -26,11 +26,11 @@
 #include "libavutil/float_dsp.h"
 #include "libavutil/intmath.h"
 #include "libavutil/opt.h"
-#include "libavcodec/avfft.h"
 
 #include "avfilter.h"
 #include "internal.h"
 #include "audio.h"
+#include "partconv.h"
 
 #define TIME_DOMAIN      0
 #define FREQUENCY_DOMAIN 1
@@ -62,24 +62,21 @@ typedef struct HeadphoneContext {
     int write[2];
 
     int buffer_length;
-    int n_fft;
     int size;
 
     int *delay[2];
     float *data_ir[2];
     float *temp_src[2];
-    FFTComplex *temp_fft[2];
 
-    FFTContext *fft[2], *ifft[2];
-    FFTComplex *data_hrtf[2];
+    PartConvContext conv;
+    float *temp_in;             ///< deinterleaved input, per channel
+    float *temp_out[2];
 
     AVFloatDSPContext *fdsp;
     struct headphone_inputs {
         AVAudioFifo *fifo;
         AVFrame     *frame;
         int          ir_len;
-        int          delay_l;
-        int          delay_r;
         int          eof;
     } *in;
 } HeadphoneContext;
@@ -150,7 +147,6 @@ typedef struct ThreadData {
     int *n_clippings;
     float **ringbuffer;
     float **temp_src;
-    FFTComplex **temp_fft;
 } ThreadData;
 
 static int headphone_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -226,97 +222,50 @@ static int headphone_convolute(AVFilterContext *ctx, void *arg, int jobnr, int n
     return 0;
 }
 
-static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+static int headphone_fast_input(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     HeadphoneContext *s = ctx->priv;
     ThreadData *td = arg;
-    AVFrame *in = td->in, *out = td->out;
-    int offset = jobnr;
-    int *write = &td->write[jobnr];
-    FFTComplex *hrtf = s->data_hrtf[jobnr];
-    int *n_clippings = &td->n_clippings[jobnr];
-    float *ringbuffer = td->ringbuffer[jobnr];
-    const int ir_len = s->ir_len;
-    const float *src = (const float *)in->data[0];
-    float *dst = (float *)out->data[0];
+    AVFrame *in = td->in;
     const int in_channels = in->channels;
-    const int buffer_length = s->buffer_length;
-    const uint32_t modulo = (uint32_t)buffer_length - 1;
-    FFTComplex *fft_in = s->temp_fft[jobnr];
-    FFTContext *ifft = s->ifft[jobnr];
-    FFTContext *fft = s->fft[jobnr];
-    const int n_fft = s->n_fft;
-    const float fft_scale = 1.0f / s->n_fft;
-    FFTComplex *hrtf_offset;
-    int wr = *write;
-    int n_read;
-    int i, j;
-
-    dst += offset;
-
-    n_read = FFMIN(s->ir_len, in->nb_samples);
-    for (j = 0; j < n_read; j++) {
-        dst[2 * j]     = ringbuffer[wr];
-        ringbuffer[wr] = 0.0;
-        wr  = (wr + 1) & modulo;
-    }
-
-    for (j = n_read; j < in->nb_samples; j++) {
-        dst[2 * j] = 0;
-    }
-
-    for (i = 0; i < in_channels; i++) {
-        if (i == s->lfe_channel) {
-            for (j = 0; j < in->nb_samples; j++) {
-                dst[2 * j] += src[i + j * in_channels] * s->gain_lfe;
-            }
-            continue;
-        }
-
-        offset = i * n_fft;
-        hrtf_offset = hrtf + offset;
-
-        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
+    const float *src = (const float *)in->data[0] + jobnr;
+    float *buf = s->temp_in + jobnr * s->size;
+    int j;
 
-        for (j = 0; j < in->nb_samples; j++) {
-            fft_in[j].re = src[j * in_channels + i];
-        }
+    if (jobnr == s->lfe_channel)
+        return 0;
 
-        av_fft_permute(fft, fft_in);
-        av_fft_calc(fft, fft_in);
-        for (j = 0; j < n_fft; j++) {
-            const FFTComplex *hcomplex = hrtf_offset + j;
-            const float re = fft_in[j].re;
-            const float im = fft_in[j].im;
+    for (j = 0; j < in->nb_samples; j++)
+        buf[j] = src[j * in_channels];
 
-            fft_in[j].re = re * hcomplex->re - im * hcomplex->im;
-            fft_in[j].im = re * hcomplex->im + im * hcomplex->re;
-        }
+    ff_partconv_input(&s->conv, jobnr, buf, in->nb_samples);
 
-        av_fft_permute(ifft, fft_in);
-        av_fft_calc(ifft, fft_in);
+    return 0;
+}
 
-        for (j = 0; j < in->nb_samples; j++) {
-            dst[2 * j] += fft_in[j].re * fft_scale;
-        }
+static int headphone_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HeadphoneContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    int *n_clippings = &td->n_clippings[jobnr];
+    const float *temp_out = s->temp_out[jobnr];
+    const float *src = (const float *)in->data[0];
+    float *dst = (float *)out->data[0] + jobnr;
+    const int in_channels = in->channels;
+    int j;
 
-        for (j = 0; j < ir_len - 1; j++) {
-            int write_pos = (wr + j) & modulo;
+    ff_partconv_output(&s->conv, jobnr, s->temp_out[jobnr]);
 
-            *(ringbuffer + write_pos) += fft_in[in->nb_samples + j].re * fft_scale;
-        }
-    }
+    for (j = 0; j < out->nb_samples; j++) {
+        dst[2 * j] = temp_out[j];
+        if (s->lfe_channel >= 0 && s->lfe_channel < in_channels)
+            dst[2 * j] += src[s->lfe_channel + j * in_channels] * s->gain_lfe;
 
-    for (i = 0; i < out->nb_samples; i++) {
-        if (fabs(*dst) > 1) {
+        if (fabs(dst[2 * j]) > 1)
             n_clippings[0]++;
-        }
-
-        dst += 2;
     }
 
-    *write = wr;
-
     return 0;
 }
 
@@ -354,7 +303,7 @@ static int headphone_frame(HeadphoneContext *s, AVFilterLink *outlink)
     ThreadData td;
     AVFrame *out;
 
-    av_audio_fifo_read(s->in[0].fifo, (void **)in->extended_data, s->size);
+    in->nb_samples = av_audio_fifo_read(s->in[0].fifo, (void **)in->extended_data, s->size);
 
     out = ff_get_audio_buffer(outlink, in->nb_samples);
     if (!out)
@@ -366,12 +315,13 @@ static int headphone_frame(HeadphoneContext *s, AVFilterLink *outlink)
     td.in = in; td.out = out; td.write = s->write;
     td.delay = s->delay; td.ir = s->data_ir; td.n_clippings = n_clippings;
     td.ringbuffer = s->ringbuffer; td.temp_src = s->temp_src;
-    td.temp_fft = s->temp_fft;
 
     if (s->type == TIME_DOMAIN) {
         ctx->internal->execute(ctx, headphone_convolute, &td, NULL, 2);
     } else {
+        ctx->internal->execute(ctx, headphone_fast_input, &td, NULL, in->channels);
         ctx->internal->execute(ctx, headphone_fast_convolute, &td, NULL, 2);
+        ff_partconv_next(&s->conv);
     }
     emms_c();
 
@@ -390,64 +340,45 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
     int nb_irs = s->nb_irs;
     int nb_input_channels = ctx->inputs[0]->channels;
     float gain_lin = expf((s->gain - 3 * nb_input_channels) / 20 * M_LN10);
-    FFTComplex *data_hrtf_l = NULL;
-    FFTComplex *data_hrtf_r = NULL;
-    FFTComplex *fft_in_l = NULL;
-    FFTComplex *fft_in_r = NULL;
     float *data_ir_l = NULL;
     float *data_ir_r = NULL;
     int offset = 0, ret = 0;
-    int n_fft;
     int i, j;
 
     s->buffer_length = 1 << (32 - ff_clz(s->ir_len));
-    s->n_fft = n_fft = 1 << (32 - ff_clz(s->ir_len + inlink->sample_rate));
 
     if (s->type == FREQUENCY_DOMAIN) {
-        fft_in_l = av_calloc(n_fft, sizeof(*fft_in_l));
-        fft_in_r = av_calloc(n_fft, sizeof(*fft_in_r));
-        if (!fft_in_l || !fft_in_r) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        av_fft_end(s->fft[0]);
-        av_fft_end(s->fft[1]);
-        s->fft[0] = av_fft_init(log2(s->n_fft), 0);
-        s->fft[1] = av_fft_init(log2(s->n_fft), 0);
-        av_fft_end(s->ifft[0]);
-        av_fft_end(s->ifft[1]);
-        s->ifft[0] = av_fft_init(log2(s->n_fft), 1);
-        s->ifft[1] = av_fft_init(log2(s->n_fft), 1);
-
-        if (!s->fft[0] || !s->fft[1] || !s->ifft[0] || !s->ifft[1]) {
-            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
-            ret = AVERROR(ENOMEM);
+        ff_partconv_uninit(&s->conv);
+        ret = ff_partconv_init(&s->conv, nb_input_channels, 2, s->ir_len,
+                               s->size, INT_MAX);
+        if (ret < 0)
             goto fail;
-        }
+        s->size = s->conv.min_part_size;
     }
 
     s->data_ir[0] = av_calloc(FFALIGN(s->ir_len, 16), sizeof(float) * s->nb_irs);
     s->data_ir[1] = av_calloc(FFALIGN(s->ir_len, 16), sizeof(float) * s->nb_irs);
-    s->delay[0] = av_malloc_array(s->nb_irs, sizeof(float));
-    s->delay[1] = av_malloc_array(s->nb_irs, sizeof(float));
+    s->delay[0] = av_calloc(s->nb_irs, sizeof(**s->delay));
+    s->delay[1] = av_calloc(s->nb_irs, sizeof(**s->delay));
 
     if (s->type == TIME_DOMAIN) {
         s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
         s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
     } else {
-        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
-        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
-        s->temp_fft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_fft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        if (!s->temp_fft[0] || !s->temp_fft[1]) {
+        av_freep(&s->temp_in);
+        av_freep(&s->temp_out[0]);
+        av_freep(&s->temp_out[1]);
+        s->temp_in     = av_calloc(s->size, sizeof(float) * nb_input_channels);
+        s->temp_out[0] = av_calloc(s->size, sizeof(float));
+        s->temp_out[1] = av_calloc(s->size, sizeof(float));
+        if (!s->temp_in || !s->temp_out[0] || !s->temp_out[1]) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
     }
 
-    if (!s->data_ir[0] || !s->data_ir[1] ||
-        !s->ringbuffer[0] || !s->ringbuffer[1]) {
+    if (!s->data_ir[0] || !s->data_ir[1] || !s->delay[0] || !s->delay[1] ||
+        (s->type == TIME_DOMAIN && (!s->ringbuffer[0] || !s->ringbuffer[1]))) {
         ret = AVERROR(ENOMEM);
         goto fail;
     }
@@ -475,19 +406,10 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
             ret = AVERROR(ENOMEM);
             goto fail;
         }
-    } else {
-        data_hrtf_l = av_malloc_array(n_fft, sizeof(*data_hrtf_l) * nb_irs);
-        data_hrtf_r = av_malloc_array(n_fft, sizeof(*data_hrtf_r) * nb_irs);
-        if (!data_hrtf_r || !data_hrtf_l) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
     }
 
     for (i = 0; i < s->nb_irs; i++) {
         int len = s->in[i + 1].ir_len;
-        int delay_l = s->in[i + 1].delay_l;
-        int delay_r = s->in[i + 1].delay_r;
         int idx = -1;
         float *ptr;
 
@@ -513,40 +435,19 @@ static int convert_coeffs(AVFilterContext *ctx, AVFilterLink *inlink)
                 data_ir_l[offset + j] = ptr[len * 2 - j * 2 - 2] * gain_lin;
                 data_ir_r[offset + j] = ptr[len * 2 - j * 2 - 1] * gain_lin;
             }
-        } else {
-            memset(fft_in_l, 0, n_fft * sizeof(*fft_in_l));
-            memset(fft_in_r, 0, n_fft * sizeof(*fft_in_r));
-
-            offset = idx * n_fft;
-            for (j = 0; j < len; j++) {
-                fft_in_l[delay_l + j].re = ptr[j * 2    ] * gain_lin;
-                fft_in_r[delay_r + j].re = ptr[j * 2 + 1] * gain_lin;
-            }
-
-            av_fft_permute(s->fft[0], fft_in_l);
-            av_fft_calc(s->fft[0], fft_in_l);
-            memcpy(data_hrtf_l + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
-            av_fft_permute(s->fft[0], fft_in_r);
-            av_fft_calc(s->fft[0], fft_in_r);
-            memcpy(data_hrtf_r + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
+        } else if (idx != s->lfe_channel) {
+            ret = ff_partconv_set_ir(&s->conv, idx, 0, ptr, len, 2, gain_lin);
+            if (ret < 0)
+                goto fail;
+            ret = ff_partconv_set_ir(&s->conv, idx, 1, ptr + 1, len, 2, gain_lin);
+            if (ret < 0)
+                goto fail;
         }
     }
 
     if (s->type == TIME_DOMAIN) {
         memcpy(s->data_ir[0], data_ir_l, sizeof(float) * nb_irs * FFALIGN(ir_len, 16));
         memcpy(s->data_ir[1], data_ir_r, sizeof(float) * nb_irs * FFALIGN(ir_len, 16));
-    } else {
-        s->data_hrtf[0] = av_malloc_array(n_fft * s->nb_irs, sizeof(FFTComplex));
-        s->data_hrtf[1] = av_malloc_array(n_fft * s->nb_irs, sizeof(FFTComplex));
-        if (!s->data_hrtf[0] || !s->data_hrtf[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        memcpy(s->data_hrtf[0], data_hrtf_l,
-            sizeof(FFTComplex) * nb_irs * n_fft);
-        memcpy(s->data_hrtf[1], data_hrtf_r,
-            sizeof(FFTComplex) * nb_irs * n_fft);
     }
 
     s->have_hrirs = 1;
@@ -556,12 +457,6 @@ fail:
     av_freep(&data_ir_l);
     av_freep(&data_ir_r);
 
-    av_freep(&data_hrtf_l);
-    av_freep(&data_hrtf_r);
-
-    av_freep(&fft_in_l);
-    av_freep(&fft_in_r);
-
     return ret;
 }
 
@@ -643,12 +538,6 @@ static int config_input(AVFilterLink *inlink)
     AVFilterContext *ctx = inlink->dst;
     HeadphoneContext *s = ctx->priv;
 
-    if (s->type == FREQUENCY_DOMAIN) {
-        inlink->partial_buf_size =
-        inlink->min_samples =
-        inlink->max_samples = inlink->sample_rate;
-    }
-
     if (s->nb_irs < inlink->channels) {
         av_log(ctx, AV_LOG_ERROR, "Number of inputs must be >= %d.\n", inlink->channels + 1);
         return AVERROR(EINVAL);
@@ -712,10 +601,7 @@ static int config_output(AVFilterLink *outlink)
     AVFilterLink *inlink = ctx->inputs[0];
     int i;
 
-    if (s->type == TIME_DOMAIN)
-        s->size = 1024;
-    else
-        s->size = inlink->sample_rate;
+    s->size = 1024;
 
     for (i = 0; i < s->nb_inputs; i++) {
         s->in[i].fifo = av_audio_fifo_alloc(ctx->inputs[i]->format, ctx->inputs[i]->channels, 1024);
@@ -746,7 +632,17 @@ static int request_frame(AVFilterLink *outlink)
                 s->eof_hrirs = 1;
         }
     }
-    return ff_request_frame(ctx->inputs[0]);
+
+    ret = ff_request_frame(ctx->inputs[0]);
+    if (ret == AVERROR_EOF && s->have_hrirs) {
+        while (av_audio_fifo_size(s->in[0].fifo) > 0) {
+            ret = headphone_frame(s, outlink);
+            if (ret < 0)
+                return ret;
+        }
+        ret = AVERROR_EOF;
+    }
+    return ret;
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
@@ -754,10 +650,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     HeadphoneContext *s = ctx->priv;
     int i;
 
-    av_fft_end(s->ifft[0]);
-    av_fft_end(s->ifft[1]);
-    av_fft_end(s->fft[0]);
-    av_fft_end(s->fft[1]);
+    ff_partconv_uninit(&s->conv);
     av_freep(&s->delay[0]);
     av_freep(&s->delay[1]);
     av_freep(&s->data_ir[0]);
@@ -766,10 +659,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->ringbuffer[1]);
     av_freep(&s->temp_src[0]);
     av_freep(&s->temp_src[1]);
-    av_freep(&s->temp_fft[0]);
-    av_freep(&s->temp_fft[1]);
-    av_freep(&s->data_hrtf[0]);
-    av_freep(&s->data_hrtf[1]);
+    av_freep(&s->temp_in);
+    av_freep(&s->temp_out[0]);
+    av_freep(&s->temp_out[1]);
     av_freep(&s->fdsp);
 
     for (i = 0; i < s->nb_inputs; i++) {
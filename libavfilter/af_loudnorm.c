@@ -20,6 +20,8 @@
 
 /* http://k.ylo.ph/2016/04/04/loudnorm.html */
 
+#include "libavutil/bprint.h"
+#include "libavutil/file.h"
 #include "libavutil/opt.h"
 #include "avfilter.h"
 #include "internal.h"
@@ -62,6 +64,10 @@ typedef struct LoudNormContext {
     int linear;
     int dual_mono;
     enum PrintFormat print_format;
+    int measure_only;
+    char *stats_file_str;
+    FILE *stats_file;
+    char *measured_file;
 
     double *buf;
     int buf_size;
@@ -119,6 +125,9 @@ static const AVOption loudnorm_options[] = {
     {     "none",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  NONE},     0,         0,  FLAGS, "print_format" },
     {     "json",         0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  JSON},     0,         0,  FLAGS, "print_format" },
     {     "summary",      0,                                   0,                        AV_OPT_TYPE_CONST,   {.i64 =  SUMMARY},  0,         0,  FLAGS, "print_format" },
+    { "measure_only",     "only measure the input, do not normalize it", OFFSET(measure_only), AV_OPT_TYPE_BOOL, {.i64 = 0},     0,         1,  FLAGS },
+    { "stats_file",       "write json stats to a file",        OFFSET(stats_file_str),   AV_OPT_TYPE_STRING,  {.str =  NULL},     0,         0,  FLAGS },
+    { "measured_file",    "read measured values from a json stats file", OFFSET(measured_file), AV_OPT_TYPE_STRING, {.str = NULL},  0,         0,  FLAGS },
     { NULL }
 };
 
@@ -420,6 +429,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     double gain, gain_next, env_global, env_shortterm,
     global, shortterm, lra, relative_threshold;
 
+    if (s->measure_only) {
+        ff_ebur128_add_frames_double(s->r128_in, (const double *)in->data[0], in->nb_samples);
+        return ff_filter_frame(outlink, in);
+    }
+
     if (av_frame_is_writable(in)) {
         out = in;
     } else {
@@ -757,7 +771,7 @@ static int config_input(AVFilterLink *inlink)
 
     init_gaussian_filter(s);
 
-    if (s->frame_type != LINEAR_MODE) {
+    if (s->frame_type != LINEAR_MODE && !s->measure_only) {
         inlink->min_samples =
         inlink->max_samples =
         inlink->partial_buf_size = frame_size(inlink->sample_rate, 3000);
@@ -778,12 +792,81 @@ static int config_input(AVFilterLink *inlink)
     return 0;
 }
 
+static int read_measured_file(AVFilterContext *ctx)
+{
+    LoudNormContext *s = ctx->priv;
+    static const char *const keys[] = { "input_i", "input_tp", "input_lra", "input_thresh" };
+    double *const values[] = { &s->measured_i, &s->measured_tp, &s->measured_lra, &s->measured_thresh };
+    uint8_t *buf;
+    size_t size;
+    char *str;
+    int i, ret;
+
+    ret = av_file_map(s->measured_file, &buf, &size, 0, ctx);
+    if (ret < 0)
+        return ret;
+
+    str = av_malloc(size + 1);
+    if (!str) {
+        av_file_unmap(buf, size);
+        return AVERROR(ENOMEM);
+    }
+    memcpy(str, buf, size);
+    str[size] = 0;
+    av_file_unmap(buf, size);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(keys); i++) {
+        char key[32];
+        const char *p;
+
+        snprintf(key, sizeof(key), "\"%s\"", keys[i]);
+        p = strstr(str, key);
+        if (!p || sscanf(p + strlen(key), " : \"%lf\"", values[i]) != 1) {
+            av_log(ctx, AV_LOG_ERROR, "Missing or invalid %s in %s\n",
+                   keys[i], s->measured_file);
+            ret = AVERROR_INVALIDDATA;
+            break;
+        }
+    }
+    av_free(str);
+
+    if (ret < 0)
+        return ret;
+
+    s->measured_i      = av_clipd(s->measured_i,     -99.,  0.);
+    s->measured_tp     = av_clipd(s->measured_tp,    -99., 99.);
+    s->measured_lra    = av_clipd(s->measured_lra,     0., 99.);
+    s->measured_thresh = av_clipd(s->measured_thresh, -99.,  0.);
+
+    return 0;
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     LoudNormContext *s = ctx->priv;
+    int ret;
+
     s->frame_type = FIRST_FRAME;
 
-    if (s->linear) {
+    if (s->measured_file) {
+        ret = read_measured_file(ctx);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (s->stats_file_str) {
+        s->stats_file = fopen(s->stats_file_str, "w");
+        if (!s->stats_file) {
+            char buf[128];
+            ret = AVERROR(errno);
+            av_strerror(ret, buf, sizeof(buf));
+            av_log(ctx, AV_LOG_ERROR, "Could not open stats file %s: %s\n",
+                   s->stats_file_str, buf);
+            return ret;
+        }
+    }
+
+    if (s->linear && !s->measure_only) {
         double offset, offset_tp;
         offset    = s->target_i - s->measured_i;
         offset_tp = s->measured_tp + offset;
@@ -799,42 +882,17 @@ static av_cold int init(AVFilterContext *ctx)
     return 0;
 }
 
-static av_cold void uninit(AVFilterContext *ctx)
+static void print_stats(LoudNormContext *s, AVBPrint *bp, enum PrintFormat format,
+                        double i_in, double tp_in, double lra_in, double thresh_in,
+                        double i_out, double tp_out, double lra_out, double thresh_out)
 {
-    LoudNormContext *s = ctx->priv;
-    double i_in, i_out, lra_in, lra_out, thresh_in, thresh_out, tp_in, tp_out;
-    int c;
-
-    if (!s->r128_in || !s->r128_out)
-        goto end;
-
-    ff_ebur128_loudness_range(s->r128_in, &lra_in);
-    ff_ebur128_loudness_global(s->r128_in, &i_in);
-    ff_ebur128_relative_threshold(s->r128_in, &thresh_in);
-    for (c = 0; c < s->channels; c++) {
-        double tmp;
-        ff_ebur128_sample_peak(s->r128_in, c, &tmp);
-        if ((c == 0) || (tmp > tp_in))
-            tp_in = tmp;
-    }
-
-    ff_ebur128_loudness_range(s->r128_out, &lra_out);
-    ff_ebur128_loudness_global(s->r128_out, &i_out);
-    ff_ebur128_relative_threshold(s->r128_out, &thresh_out);
-    for (c = 0; c < s->channels; c++) {
-        double tmp;
-        ff_ebur128_sample_peak(s->r128_out, c, &tmp);
-        if ((c == 0) || (tmp > tp_out))
-            tp_out = tmp;
-    }
-
-    switch(s->print_format) {
+    switch(format) {
     case NONE:
         break;
 
     case JSON:
-        av_log(ctx, AV_LOG_INFO,
-            "\n{\n"
+        av_bprintf(bp,
+            "{\n"
             "\t\"input_i\" : \"%.2f\",\n"
             "\t\"input_tp\" : \"%.2f\",\n"
             "\t\"input_lra\" : \"%.2f\",\n"
@@ -854,14 +912,13 @@ static av_cold void uninit(AVFilterContext *ctx)
             20. * log10(tp_out),
             lra_out,
             thresh_out,
-            s->frame_type == LINEAR_MODE ? "linear" : "dynamic",
+            s->measure_only ? "none" : s->frame_type == LINEAR_MODE ? "linear" : "dynamic",
             s->target_i - i_out
         );
         break;
 
     case SUMMARY:
-        av_log(ctx, AV_LOG_INFO,
-            "\n"
+        av_bprintf(bp,
             "Input Integrated:   %+6.1f LUFS\n"
             "Input True Peak:    %+6.1f dBTP\n"
             "Input LRA:          %6.1f LU\n"
@@ -882,13 +939,71 @@ static av_cold void uninit(AVFilterContext *ctx)
             20. * log10(tp_out),
             lra_out,
             thresh_out,
-            s->frame_type == LINEAR_MODE ? "Linear" : "Dynamic",
+            s->measure_only ? "None" : s->frame_type == LINEAR_MODE ? "Linear" : "Dynamic",
             s->target_i - i_out
         );
         break;
     }
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    LoudNormContext *s = ctx->priv;
+    double i_in, i_out, lra_in, lra_out, thresh_in, thresh_out, tp_in, tp_out;
+    AVBPrint bp;
+    int c;
+
+    if (!s->r128_in || !s->r128_out)
+        goto end;
+
+    ff_ebur128_loudness_range(s->r128_in, &lra_in);
+    ff_ebur128_loudness_global(s->r128_in, &i_in);
+    ff_ebur128_relative_threshold(s->r128_in, &thresh_in);
+    for (c = 0; c < s->channels; c++) {
+        double tmp;
+        ff_ebur128_sample_peak(s->r128_in, c, &tmp);
+        if ((c == 0) || (tmp > tp_in))
+            tp_in = tmp;
+    }
+
+    if (s->measure_only) {
+        /* no gain was applied, so the output statistics are the input ones */
+        lra_out    = lra_in;
+        i_out      = i_in;
+        thresh_out = thresh_in;
+        tp_out     = tp_in;
+    } else {
+        ff_ebur128_loudness_range(s->r128_out, &lra_out);
+        ff_ebur128_loudness_global(s->r128_out, &i_out);
+        ff_ebur128_relative_threshold(s->r128_out, &thresh_out);
+        for (c = 0; c < s->channels; c++) {
+            double tmp;
+            ff_ebur128_sample_peak(s->r128_out, c, &tmp);
+            if ((c == 0) || (tmp > tp_out))
+                tp_out = tmp;
+        }
+    }
+
+    if (s->print_format != NONE) {
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+        print_stats(s, &bp, s->print_format, i_in, tp_in, lra_in, thresh_in,
+                    i_out, tp_out, lra_out, thresh_out);
+        av_log(ctx, AV_LOG_INFO, "\n%s", bp.str);
+        av_bprint_finalize(&bp, NULL);
+    }
+
+    if (s->stats_file) {
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+        print_stats(s, &bp, JSON, i_in, tp_in, lra_in, thresh_in,
+                    i_out, tp_out, lra_out, thresh_out);
+        fputs(bp.str, s->stats_file);
+        av_bprint_finalize(&bp, NULL);
+    }
 
 end:
+    if (s->stats_file)
+        fclose(s->stats_file);
+    s->stats_file = NULL;
     if (s->r128_in)
         ff_ebur128_destroy(&s->r128_in);
     if (s->r128_out)
@@ -28,7 +28,6 @@
 #include <math.h>
 #include <mysofa.h>
 
-#include "libavcodec/avfft.h"
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/float_dsp.h"
@@ -37,6 +36,7 @@
 #include "avfilter.h"
 #include "internal.h"
 #include "audio.h"
+#include "partconv.h"
 
 #define TIME_DOMAIN      0
 #define FREQUENCY_DOMAIN 1
@@ -76,7 +76,6 @@ typedef struct SOFAlizerContext {
     int write[2];               /* current write position to ringbuffer */
     int buffer_length;          /* is: longest IR plus max. delay in all SOFA files */
                                 /* then choose next power of 2 */
-    int n_fft;                  /* number of samples in one FFT block */
 
                                 /* netCDF variables */
     int *delay[2];              /* broadband delay for each channel/IR to be convolved */
@@ -84,7 +83,10 @@ typedef struct SOFAlizerContext {
     float *data_ir[2];          /* IRs for all channels to be convolved */
                                 /* (this excludes the LFE) */
     float *temp_src[2];
-    FFTComplex *temp_fft[2];
+
+    PartConvContext conv;       /* partitioned convolution of all channels */
+    float *temp_in;             /* deinterleaved input, per channel */
+    float *temp_out[2];         /* convolution output, per ear */
 
                          /* control variables */
     float gain;          /* filter gain (in dB) */
@@ -95,9 +97,6 @@ typedef struct SOFAlizerContext {
 
     VirtualSpeaker vspkrpos[64];
 
-    FFTContext *fft[2], *ifft[2];
-    FFTComplex *data_hrtf[2];
-
     AVFloatDSPContext *fdsp;
 } SOFAlizerContext;
 
@@ -271,7 +270,6 @@ typedef struct ThreadData {
     int *n_clippings;
     float **ringbuffer;
     float **temp_src;
-    FFTComplex **temp_fft;
 } ThreadData;
 
 static int sofalizer_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -360,121 +358,55 @@ static int sofalizer_convolute(AVFilterContext *ctx, void *arg, int jobnr, int n
     return 0;
 }
 
-static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+static int sofalizer_fast_input(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
     SOFAlizerContext *s = ctx->priv;
     ThreadData *td = arg;
-    AVFrame *in = td->in, *out = td->out;
-    int offset = jobnr;
-    int *write = &td->write[jobnr];
-    FFTComplex *hrtf = s->data_hrtf[jobnr]; /* get pointers to current HRTF data */
-    int *n_clippings = &td->n_clippings[jobnr];
-    float *ringbuffer = td->ringbuffer[jobnr];
-    const int n_samples = s->sofa.n_samples; /* length of one IR */
-    const float *src = (const float *)in->data[0]; /* get pointer to audio input buffer */
-    float *dst = (float *)out->data[0]; /* get pointer to audio output buffer */
+    AVFrame *in = td->in;
     const int in_channels = s->n_conv; /* number of input channels */
-    /* ring buffer length is: longest IR plus max. delay -> next power of 2 */
-    const int buffer_length = s->buffer_length;
-    /* -1 for AND instead of MODULO (applied to powers of 2): */
-    const uint32_t modulo = (uint32_t)buffer_length - 1;
-    FFTComplex *fft_in = s->temp_fft[jobnr]; /* temporary array for FFT input/output data */
-    FFTContext *ifft = s->ifft[jobnr];
-    FFTContext *fft = s->fft[jobnr];
-    const int n_conv = s->n_conv;
-    const int n_fft = s->n_fft;
-    const float fft_scale = 1.0f / s->n_fft;
-    FFTComplex *hrtf_offset;
-    int wr = *write;
-    int n_read;
-    int i, j;
-
-    dst += offset;
-
-    /* find minimum between number of samples and output buffer length:
-     * (important, if one IR is longer than the output buffer) */
-    n_read = FFMIN(s->sofa.n_samples, in->nb_samples);
-    for (j = 0; j < n_read; j++) {
-        /* initialize output buf with saved signal from overflow buf */
-        dst[2 * j]     = ringbuffer[wr];
-        ringbuffer[wr] = 0.0; /* re-set read samples to zero */
-        /* update ringbuffer read/write position */
-        wr  = (wr + 1) & modulo;
-    }
-
-    /* initialize rest of output buffer with 0 */
-    for (j = n_read; j < in->nb_samples; j++) {
-        dst[2 * j] = 0;
-    }
+    const float *src = (const float *)in->data[0] + jobnr; /* current input channel */
+    float *buf = s->temp_in + jobnr * s->conv.min_part_size;
+    int j;
 
-    for (i = 0; i < n_conv; i++) {
-        if (i == s->lfe_channel) { /* LFE */
-            for (j = 0; j < in->nb_samples; j++) {
-                /* apply gain to LFE signal and add to output buffer */
-                dst[2 * j] += src[i + j * in_channels] * s->gain_lfe;
-            }
-            continue;
-        }
-
-        /* outer loop: go through all input channels to be convolved */
-        offset = i * n_fft; /* no. samples already processed */
-        hrtf_offset = hrtf + offset;
-
-        /* fill FFT input with 0 (we want to zero-pad) */
-        memset(fft_in, 0, sizeof(FFTComplex) * n_fft);
+    if (jobnr == s->lfe_channel) /* LFE requires no convolution */
+        return 0;
 
-        for (j = 0; j < in->nb_samples; j++) {
-            /* prepare input for FFT */
-            /* write all samples of current input channel to FFT input array */
-            fft_in[j].re = src[j * in_channels + i];
-        }
+    for (j = 0; j < in->nb_samples; j++)
+        buf[j] = src[j * in_channels];
 
-        /* transform input signal of current channel to frequency domain */
-        av_fft_permute(fft, fft_in);
-        av_fft_calc(fft, fft_in);
-        for (j = 0; j < n_fft; j++) {
-            const FFTComplex *hcomplex = hrtf_offset + j;
-            const float re = fft_in[j].re;
-            const float im = fft_in[j].im;
-
-            /* complex multiplication of input signal and HRTFs */
-            /* output channel (real): */
-            fft_in[j].re = re * hcomplex->re - im * hcomplex->im;
-            /* output channel (imag): */
-            fft_in[j].im = re * hcomplex->im + im * hcomplex->re;
-        }
+    /* transform the input block, shared by both ears */
+    ff_partconv_input(&s->conv, jobnr, buf, in->nb_samples);
 
-        /* transform output signal of current channel back to time domain */
-        av_fft_permute(ifft, fft_in);
-        av_fft_calc(ifft, fft_in);
+    return 0;
+}
 
-        for (j = 0; j < in->nb_samples; j++) {
-            /* write output signal of current channel to output buffer */
-            dst[2 * j] += fft_in[j].re * fft_scale;
-        }
+static int sofalizer_fast_convolute(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SOFAlizerContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    int *n_clippings = &td->n_clippings[jobnr];
+    const float *temp_out = s->temp_out[jobnr];
+    const float *src = (const float *)in->data[0]; /* get pointer to audio input buffer */
+    float *dst = (float *)out->data[0] + jobnr; /* get pointer to audio output buffer */
+    const int in_channels = s->n_conv; /* number of input channels */
+    int j;
 
-        for (j = 0; j < n_samples - 1; j++) { /* overflow length is IR length - 1 */
-            /* write the rest of output signal to overflow buffer */
-            int write_pos = (wr + j) & modulo;
+    /* sum of all input channels convolved with the HRTFs of this ear */
+    ff_partconv_output(&s->conv, jobnr, s->temp_out[jobnr]);
 
-            *(ringbuffer + write_pos) += fft_in[in->nb_samples + j].re * fft_scale;
+    for (j = 0; j < out->nb_samples; j++) {
+        dst[2 * j] = temp_out[j];
+        if (s->lfe_channel >= 0 && s->lfe_channel < in_channels) {
+            /* apply gain to LFE signal and add to output buffer */
+            dst[2 * j] += src[s->lfe_channel + j * in_channels] * s->gain_lfe;
         }
-    }
 
-    /* go through all samples of current output buffer: count clippings */
-    for (i = 0; i < out->nb_samples; i++) {
         /* clippings counter */
-        if (fabs(*dst) > 1) { /* if current output sample > 1 */
+        if (fabs(dst[2 * j]) > 1)
             n_clippings[0]++;
-        }
-
-        /* move output buffer pointer by +2 to get to next sample of processed channel: */
-        dst += 2;
     }
 
-    /* remember read/write position in ringbuffer for next call */
-    *write = wr;
-
     return 0;
 }
 
@@ -497,12 +429,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     td.in = in; td.out = out; td.write = s->write;
     td.delay = s->delay; td.ir = s->data_ir; td.n_clippings = n_clippings;
     td.ringbuffer = s->ringbuffer; td.temp_src = s->temp_src;
-    td.temp_fft = s->temp_fft;
 
     if (s->type == TIME_DOMAIN) {
         ctx->internal->execute(ctx, sofalizer_convolute, &td, NULL, 2);
     } else {
+        ctx->internal->execute(ctx, sofalizer_fast_input, &td, NULL, s->n_conv);
         ctx->internal->execute(ctx, sofalizer_fast_convolute, &td, NULL, 2);
+        ff_partconv_next(&s->conv);
     }
     emms_c();
 
@@ -559,17 +492,13 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
     struct SOFAlizerContext *s = ctx->priv;
     int n_samples;
     int n_conv = s->n_conv; /* no. channels to convolve */
-    int n_fft;
     float delay_l; /* broadband delay for each IR */
     float delay_r;
     int nb_input_channels = ctx->inputs[0]->channels; /* no. input channels */
     float gain_lin = expf((s->gain - 3 * nb_input_channels) / 20 * M_LN10); /* gain - 3dB/channel */
-    FFTComplex *data_hrtf_l = NULL;
-    FFTComplex *data_hrtf_r = NULL;
-    FFTComplex *fft_in_l = NULL;
-    FFTComplex *fft_in_r = NULL;
     float *data_ir_l = NULL;
     float *data_ir_r = NULL;
+    float *ir = NULL;
     int offset = 0; /* used for faster pointer arithmetics in for-loop */
     int i, j, azim_orig = azim, elev_orig = elev;
     int filter_length, ret = 0;
@@ -658,56 +587,31 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
     /* buffer length is longest IR plus max. delay -> next power of 2
        (32 - count leading zeros gives required exponent)  */
     s->buffer_length = 1 << (32 - ff_clz(n_max));
-    s->n_fft = n_fft = 1 << (32 - ff_clz(n_max + sample_rate));
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        av_fft_end(s->fft[0]);
-        av_fft_end(s->fft[1]);
-        s->fft[0] = av_fft_init(log2(s->n_fft), 0);
-        s->fft[1] = av_fft_init(log2(s->n_fft), 0);
-        av_fft_end(s->ifft[0]);
-        av_fft_end(s->ifft[1]);
-        s->ifft[0] = av_fft_init(log2(s->n_fft), 1);
-        s->ifft[1] = av_fft_init(log2(s->n_fft), 1);
-
-        if (!s->fft[0] || !s->fft[1] || !s->ifft[0] || !s->ifft[1]) {
-            av_log(ctx, AV_LOG_ERROR, "Unable to create FFT contexts of size %d.\n", s->n_fft);
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-    }
 
     if (s->type == TIME_DOMAIN) {
         s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
         s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float) * nb_input_channels);
-    } else {
-        /* get temporary HRTF memory for L and R channel */
-        data_hrtf_l = av_malloc_array(n_fft, sizeof(*data_hrtf_l) * n_conv);
-        data_hrtf_r = av_malloc_array(n_fft, sizeof(*data_hrtf_r) * n_conv);
-        if (!data_hrtf_r || !data_hrtf_l) {
+        if (!s->ringbuffer[0] || !s->ringbuffer[1]) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
-
-        s->ringbuffer[0] = av_calloc(s->buffer_length, sizeof(float));
-        s->ringbuffer[1] = av_calloc(s->buffer_length, sizeof(float));
-        s->temp_fft[0] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        s->temp_fft[1] = av_malloc_array(s->n_fft, sizeof(FFTComplex));
-        if (!s->temp_fft[0] || !s->temp_fft[1]) {
-            ret = AVERROR(ENOMEM);
+    } else {
+        /* IRs including their delays are convolved in partitions,
+         * the smallest of which sets the processed frame size */
+        ff_partconv_uninit(&s->conv);
+        ret = ff_partconv_init(&s->conv, n_conv, 2, n_max, 1024, INT_MAX);
+        if (ret < 0)
             goto fail;
-        }
-    }
 
-    if (!s->ringbuffer[0] || !s->ringbuffer[1]) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-
-    if (s->type == FREQUENCY_DOMAIN) {
-        fft_in_l = av_calloc(n_fft, sizeof(*fft_in_l));
-        fft_in_r = av_calloc(n_fft, sizeof(*fft_in_r));
-        if (!fft_in_l || !fft_in_r) {
+        av_freep(&s->temp_in);
+        av_freep(&s->temp_out[0]);
+        av_freep(&s->temp_out[1]);
+        s->temp_in     = av_calloc(s->conv.min_part_size, sizeof(float) * n_conv);
+        s->temp_out[0] = av_calloc(s->conv.min_part_size, sizeof(float));
+        s->temp_out[1] = av_calloc(s->conv.min_part_size, sizeof(float));
+        /* temporary IR, shifted by its delay */
+        ir = av_calloc(n_max, sizeof(*ir));
+        if (!s->temp_in || !s->temp_out[0] || !s->temp_out[1] || !ir) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
@@ -728,53 +632,28 @@ static int load_data(AVFilterContext *ctx, int azim, int elev, float radius, int
                 s->data_ir[0][offset + j] = lir[n_samples - 1 - j] * gain_lin;
                 s->data_ir[1][offset + j] = rir[n_samples - 1 - j] * gain_lin;
             }
-        } else {
-            memset(fft_in_l, 0, n_fft * sizeof(*fft_in_l));
-            memset(fft_in_r, 0, n_fft * sizeof(*fft_in_r));
-
-            offset = i * n_fft; /* no. samples already written */
-            for (j = 0; j < n_samples; j++) {
-                /* load non-reversed IRs of the specified source position
-                 * sample-by-sample and apply gain,
-                 * L channel is loaded to real part, R channel to imag part,
-                 * IRs ared shifted by L and R delay */
-                fft_in_l[s->delay[0][i] + j].re = lir[j] * gain_lin;
-                fft_in_r[s->delay[1][i] + j].re = rir[j] * gain_lin;
-            }
-
-            /* actually transform to frequency domain (IRs -> HRTFs) */
-            av_fft_permute(s->fft[0], fft_in_l);
-            av_fft_calc(s->fft[0], fft_in_l);
-            memcpy(data_hrtf_l + offset, fft_in_l, n_fft * sizeof(*fft_in_l));
-            av_fft_permute(s->fft[0], fft_in_r);
-            av_fft_calc(s->fft[0], fft_in_r);
-            memcpy(data_hrtf_r + offset, fft_in_r, n_fft * sizeof(*fft_in_r));
+        } else if (i != s->lfe_channel) {
+            /* load non-reversed IRs of the specified source position,
+             * shifted by L and R delay; gain is applied by the engine */
+            memset(ir, 0, n_max * sizeof(*ir));
+            memcpy(ir + s->delay[0][i], lir, n_samples * sizeof(*ir));
+            ret = ff_partconv_set_ir(&s->conv, i, 0, ir, s->delay[0][i] + n_samples, 1, gain_lin);
+            if (ret < 0)
+                goto fail;
+
+            memset(ir, 0, n_max * sizeof(*ir));
+            memcpy(ir + s->delay[1][i], rir, n_samples * sizeof(*ir));
+            ret = ff_partconv_set_ir(&s->conv, i, 1, ir, s->delay[1][i] + n_samples, 1, gain_lin);
+            if (ret < 0)
+                goto fail;
         }
     }
 
-    if (s->type == FREQUENCY_DOMAIN) {
-        s->data_hrtf[0] = av_malloc_array(n_fft * s->n_conv, sizeof(FFTComplex));
-        s->data_hrtf[1] = av_malloc_array(n_fft * s->n_conv, sizeof(FFTComplex));
-        if (!s->data_hrtf[0] || !s->data_hrtf[1]) {
-            ret = AVERROR(ENOMEM);
-            goto fail;
-        }
-
-        memcpy(s->data_hrtf[0], data_hrtf_l, /* copy HRTF data to */
-            sizeof(FFTComplex) * n_conv * n_fft); /* filter struct */
-        memcpy(s->data_hrtf[1], data_hrtf_r,
-            sizeof(FFTComplex) * n_conv * n_fft);
-    }
-
 fail:
-    av_freep(&data_hrtf_l); /* free temporary HRTF memory */
-    av_freep(&data_hrtf_r);
-
     av_freep(&data_ir_l); /* free temprary IR memory */
     av_freep(&data_ir_r);
 
-    av_freep(&fft_in_l); /* free temporary FFT memory */
-    av_freep(&fft_in_r);
+    av_freep(&ir);
 
     return ret;
 }
@@ -816,12 +695,6 @@ static int config_input(AVFilterLink *inlink)
     SOFAlizerContext *s = ctx->priv;
     int ret;
 
-    if (s->type == FREQUENCY_DOMAIN) {
-        inlink->partial_buf_size =
-        inlink->min_samples =
-        inlink->max_samples = inlink->sample_rate;
-    }
-
     /* gain -3 dB per channel, -6 dB to get LFE on a similar level */
     s->gain_lfe = expf((s->gain - 3 * inlink->channels - 6 + s->lfe_gain) / 20 * M_LN10);
 
@@ -831,6 +704,12 @@ static int config_input(AVFilterLink *inlink)
     if ((ret = load_data(ctx, s->rotation, s->elevation, s->radius, inlink->sample_rate)) < 0)
         return ret;
 
+    if (s->type == FREQUENCY_DOMAIN) {
+        inlink->partial_buf_size =
+        inlink->min_samples =
+        inlink->max_samples = s->conv.min_part_size;
+    }
+
     av_log(ctx, AV_LOG_DEBUG, "Samplerate: %d Channels to convolute: %d, Length of ringbuffer: %d x %d\n",
         inlink->sample_rate, s->n_conv, inlink->channels, s->buffer_length);
 
@@ -842,10 +721,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     SOFAlizerContext *s = ctx->priv;
 
     close_sofa(&s->sofa);
-    av_fft_end(s->ifft[0]);
-    av_fft_end(s->ifft[1]);
-    av_fft_end(s->fft[0]);
-    av_fft_end(s->fft[1]);
+    ff_partconv_uninit(&s->conv);
     av_freep(&s->delay[0]);
     av_freep(&s->delay[1]);
     av_freep(&s->data_ir[0]);
@@ -856,10 +732,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->speaker_elev);
     av_freep(&s->temp_src[0]);
     av_freep(&s->temp_src[1]);
-    av_freep(&s->temp_fft[0]);
-    av_freep(&s->temp_fft[1]);
-    av_freep(&s->data_hrtf[0]);
-    av_freep(&s->data_hrtf[1]);
+    av_freep(&s->temp_in);
+    av_freep(&s->temp_out[0]);
+    av_freep(&s->temp_out[1]);
     av_freep(&s->fdsp);
 }
 
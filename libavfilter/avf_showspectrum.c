@@ -53,6 +53,7 @@ typedef struct ShowSpectrumContext {
     int w, h;
     AVFrame *outpicref;
     int nb_display_channels;
+    int nb_threads;             ///< number of per-channel buffer sets, one per column job
     int orientation;
     int channel_width;
     int channel_height;
@@ -76,8 +77,8 @@ typedef struct ShowSpectrumContext {
     float overlap;
     float gain;
     int hop_size;
-    float *combine_buffer;      ///< color combining buffer (3 * h items)
-    float **color_buffer;       ///< color buffer (3 * h * ch items)
+    float *combine_buffer;      ///< color combining buffer (3 * h * threads items)
+    float **color_buffer;       ///< color buffer (3 * h * ch * threads items)
     AVAudioFifo *fifo;
     int64_t pts;
     int single_pic;
@@ -231,30 +232,30 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_freep(&s->combine_buffer);
     if (s->fft) {
-        for (i = 0; i < s->nb_display_channels; i++)
+        for (i = 0; i < s->nb_display_channels * s->nb_threads; i++)
             av_fft_end(s->fft[i]);
     }
     av_freep(&s->fft);
     if (s->fft_data) {
-        for (i = 0; i < s->nb_display_channels; i++)
+        for (i = 0; i < s->nb_display_channels * s->nb_threads; i++)
             av_freep(&s->fft_data[i]);
     }
     av_freep(&s->fft_data);
     if (s->color_buffer) {
-        for (i = 0; i < s->nb_display_channels; i++)
+        for (i = 0; i < s->nb_display_channels * s->nb_threads; i++)
             av_freep(&s->color_buffer[i]);
     }
     av_freep(&s->color_buffer);
     av_freep(&s->window_func_lut);
     if (s->magnitudes) {
-        for (i = 0; i < s->nb_display_channels; i++)
+        for (i = 0; i < s->nb_display_channels * s->nb_threads; i++)
             av_freep(&s->magnitudes[i]);
     }
     av_freep(&s->magnitudes);
     av_frame_free(&s->outpicref);
     av_audio_fifo_free(s->fifo);
     if (s->phases) {
-        for (i = 0; i < s->nb_display_channels; i++)
+        for (i = 0; i < s->nb_display_channels * s->nb_threads; i++)
             av_freep(&s->phases[i]);
     }
     av_freep(&s->phases);
@@ -296,7 +297,7 @@ static int config_output(AVFilterLink *outlink)
     AVFilterContext *ctx = outlink->src;
     AVFilterLink *inlink = ctx->inputs[0];
     ShowSpectrumContext *s = ctx->priv;
-    int i, fft_bits, h, w;
+    int i, fft_bits, h, w, nb_buffers;
     float overlap;
 
     s->pts = AV_NOPTS_VALUE;
@@ -304,6 +305,12 @@ static int config_output(AVFilterLink *outlink)
     if (!strcmp(ctx->filter->name, "showspectrumpic"))
         s->single_pic = 1;
 
+    /* showspectrumpic computes groups of columns in parallel, each job
+     * needing its own set of per-channel buffers */
+    if (!s->fft)
+        s->nb_threads = s->single_pic ? ff_filter_get_nb_threads(ctx) : 1;
+    nb_buffers = inlink->channels * s->nb_threads;
+
     outlink->w = s->w;
     outlink->h = s->h;
     outlink->sample_aspect_ratio = (AVRational){1,1};
@@ -330,7 +337,7 @@ static int config_output(AVFilterLink *outlink)
     s->win_size = 1 << fft_bits;
 
     if (!s->fft) {
-        s->fft = av_calloc(inlink->channels, sizeof(*s->fft));
+        s->fft = av_calloc(nb_buffers, sizeof(*s->fft));
         if (!s->fft)
             return AVERROR(ENOMEM);
     }
@@ -344,14 +351,14 @@ static int config_output(AVFilterLink *outlink)
         /* FFT buffers: x2 for each (display) channel buffer.
          * Note: we use free and malloc instead of a realloc-like function to
          * make sure the buffer is aligned in memory for the FFT functions. */
-        for (i = 0; i < s->nb_display_channels; i++) {
+        for (i = 0; i < s->nb_display_channels * s->nb_threads; i++) {
             av_fft_end(s->fft[i]);
             av_freep(&s->fft_data[i]);
         }
         av_freep(&s->fft_data);
 
         s->nb_display_channels = inlink->channels;
-        for (i = 0; i < s->nb_display_channels; i++) {
+        for (i = 0; i < nb_buffers; i++) {
             s->fft[i] = av_fft_init(fft_bits, 0);
             if (!s->fft[i]) {
                 av_log(ctx, AV_LOG_ERROR, "Unable to create FFT context. "
@@ -360,38 +367,38 @@ static int config_output(AVFilterLink *outlink)
             }
         }
 
-        s->magnitudes = av_calloc(s->nb_display_channels, sizeof(*s->magnitudes));
+        s->magnitudes = av_calloc(nb_buffers, sizeof(*s->magnitudes));
         if (!s->magnitudes)
             return AVERROR(ENOMEM);
-        for (i = 0; i < s->nb_display_channels; i++) {
+        for (i = 0; i < nb_buffers; i++) {
             s->magnitudes[i] = av_calloc(s->orientation == VERTICAL ? s->h : s->w, sizeof(**s->magnitudes));
             if (!s->magnitudes[i])
                 return AVERROR(ENOMEM);
         }
 
-        s->phases = av_calloc(s->nb_display_channels, sizeof(*s->phases));
+        s->phases = av_calloc(nb_buffers, sizeof(*s->phases));
         if (!s->phases)
             return AVERROR(ENOMEM);
-        for (i = 0; i < s->nb_display_channels; i++) {
+        for (i = 0; i < nb_buffers; i++) {
             s->phases[i] = av_calloc(s->orientation == VERTICAL ? s->h : s->w, sizeof(**s->phases));
             if (!s->phases[i])
                 return AVERROR(ENOMEM);
         }
 
         av_freep(&s->color_buffer);
-        s->color_buffer = av_calloc(s->nb_display_channels, sizeof(*s->color_buffer));
+        s->color_buffer = av_calloc(nb_buffers, sizeof(*s->color_buffer));
         if (!s->color_buffer)
             return AVERROR(ENOMEM);
-        for (i = 0; i < s->nb_display_channels; i++) {
+        for (i = 0; i < nb_buffers; i++) {
             s->color_buffer[i] = av_calloc(s->orientation == VERTICAL ? s->h * 3 : s->w * 3, sizeof(**s->color_buffer));
             if (!s->color_buffer[i])
                 return AVERROR(ENOMEM);
         }
 
-        s->fft_data = av_calloc(s->nb_display_channels, sizeof(*s->fft_data));
+        s->fft_data = av_calloc(nb_buffers, sizeof(*s->fft_data));
         if (!s->fft_data)
             return AVERROR(ENOMEM);
-        for (i = 0; i < s->nb_display_channels; i++) {
+        for (i = 0; i < nb_buffers; i++) {
             s->fft_data[i] = av_calloc(s->win_size, sizeof(**s->fft_data));
             if (!s->fft_data[i])
                 return AVERROR(ENOMEM);
@@ -444,11 +451,11 @@ static int config_output(AVFilterLink *outlink)
 
     if (s->orientation == VERTICAL) {
         s->combine_buffer =
-            av_realloc_f(s->combine_buffer, s->h * 3,
+            av_realloc_f(s->combine_buffer, s->h * 3 * s->nb_threads,
                          sizeof(*s->combine_buffer));
     } else {
         s->combine_buffer =
-            av_realloc_f(s->combine_buffer, s->w * 3,
+            av_realloc_f(s->combine_buffer, s->w * 3 * s->nb_threads,
                          sizeof(*s->combine_buffer));
     }
 
@@ -462,25 +469,29 @@ static int config_output(AVFilterLink *outlink)
     return 0;
 }
 
-static int run_channel_fft(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+/* run the FFT of one window of samples into buffer set entry b */
+static void fft_channel(ShowSpectrumContext *s, const float *p, int b)
 {
-    ShowSpectrumContext *s = ctx->priv;
     const float *window_func_lut = s->window_func_lut;
-    AVFrame *fin = arg;
-    const int ch = jobnr;
     int n;
 
-    /* fill FFT input with the number of samples available */
-    const float *p = (float *)fin->extended_data[ch];
-
     for (n = 0; n < s->win_size; n++) {
-        s->fft_data[ch][n].re = p[n] * window_func_lut[n];
-        s->fft_data[ch][n].im = 0;
+        s->fft_data[b][n].re = p[n] * window_func_lut[n];
+        s->fft_data[b][n].im = 0;
     }
 
-    /* run FFT on each samples set */
-    av_fft_permute(s->fft[ch], s->fft_data[ch]);
-    av_fft_calc(s->fft[ch], s->fft_data[ch]);
+    av_fft_permute(s->fft[b], s->fft_data[b]);
+    av_fft_calc(s->fft[b], s->fft_data[b]);
+}
+
+static int run_channel_fft(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ShowSpectrumContext *s = ctx->priv;
+    AVFrame *fin = arg;
+    const int ch = jobnr;
+
+    /* fill FFT input with the number of samples available */
+    fft_channel(s, (float *)fin->extended_data[ch], ch);
 
     return 0;
 }
@@ -519,13 +530,14 @@ static int calc_channel_phases(AVFilterContext *ctx, void *arg, int jobnr, int n
     return 0;
 }
 
-static void acalc_magnitudes(ShowSpectrumContext *s)
+/* b is the index of the first channel of the buffer set to work on */
+static void acalc_magnitudes(ShowSpectrumContext *s, int b)
 {
     const double w = s->win_scale * (s->scale == LOG ? s->win_scale : 1);
     int ch, y, h = s->orientation == VERTICAL ? s->h : s->w;
     const float f = s->gain * w;
 
-    for (ch = 0; ch < s->nb_display_channels; ch++) {
+    for (ch = b; ch < b + s->nb_display_channels; ch++) {
         float *magnitudes = s->magnitudes[ch];
 
         for (y = 0; y < h; y++)
@@ -533,11 +545,11 @@ static void acalc_magnitudes(ShowSpectrumContext *s)
     }
 }
 
-static void scale_magnitudes(ShowSpectrumContext *s, float scale)
+static void scale_magnitudes(ShowSpectrumContext *s, int b, float scale)
 {
     int ch, y, h = s->orientation == VERTICAL ? s->h : s->w;
 
-    for (ch = 0; ch < s->nb_display_channels; ch++) {
+    for (ch = b; ch < b + s->nb_display_channels; ch++) {
         float *magnitudes = s->magnitudes[ch];
 
         for (y = 0; y < h; y++)
@@ -645,24 +657,34 @@ static void pick_color(ShowSpectrumContext *s,
     }
 }
 
-static void clear_combine_buffer(ShowSpectrumContext *s, int size)
+static void clear_combine_buffer(float *combine_buffer, int size)
 {
     int y;
 
     for (y = 0; y < size; y++) {
-        s->combine_buffer[3 * y    ] = 0;
-        s->combine_buffer[3 * y + 1] = 127.5;
-        s->combine_buffer[3 * y + 2] = 127.5;
+        combine_buffer[3 * y    ] = 0;
+        combine_buffer[3 * y + 1] = 127.5;
+        combine_buffer[3 * y + 2] = 127.5;
     }
 }
 
-static int plot_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+static void combine_channels(ShowSpectrumContext *s, float *combine_buffer,
+                             int b, int size)
+{
+    int x, y;
+
+    for (y = 0; y < size * 3; y++) {
+        for (x = b; x < b + s->nb_display_channels; x++) {
+            combine_buffer[y] += s->color_buffer[x][y];
+        }
+    }
+}
+
+static void plot_channel_column(ShowSpectrumContext *s, int ch, int b)
 {
-    ShowSpectrumContext *s = ctx->priv;
     const int h = s->orientation == VERTICAL ? s->channel_height : s->channel_width;
-    const int ch = jobnr;
-    float *magnitudes = s->magnitudes[ch];
-    float *phases = s->phases[ch];
+    float *magnitudes = s->magnitudes[b + ch];
+    float *phases = s->phases[b + ch];
     float yf, uf, vf;
     int y;
 
@@ -672,7 +694,7 @@ static int plot_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
     /* draw the channel */
     for (y = 0; y < h; y++) {
         int row = (s->mode == COMBINED) ? y : ch * h + y;
-        float *out = &s->color_buffer[ch][3 * row];
+        float *out = &s->color_buffer[b + ch][3 * row];
         float a;
 
         switch (s->data) {
@@ -714,29 +736,60 @@ static int plot_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 
         pick_color(s, yf, uf, vf, a, out);
     }
+}
+
+static int plot_channel(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ShowSpectrumContext *s = ctx->priv;
+
+    plot_channel_column(s, jobnr, 0);
 
     return 0;
 }
 
+/* copy a combined column to position pos of the output picture */
+static void write_column(ShowSpectrumContext *s, AVFrame *outpicref,
+                         const float *combine_buffer, int pos)
+{
+    int plane, x, y;
+
+    if (s->orientation == VERTICAL) {
+        for (plane = 0; plane < 3; plane++) {
+            uint8_t *p = outpicref->data[plane] + s->start_x +
+                         (outpicref->height - 1 - s->start_y) * outpicref->linesize[plane] +
+                         pos;
+            for (y = 0; y < s->h; y++) {
+                *p = lrintf(av_clipf(combine_buffer[3 * y + plane], 0, 255));
+                p -= outpicref->linesize[plane];
+            }
+        }
+    } else {
+        for (plane = 0; plane < 3; plane++) {
+            uint8_t *p = outpicref->data[plane] + s->start_x +
+                         (pos + s->start_y) * outpicref->linesize[plane];
+            for (x = 0; x < s->w; x++) {
+                *p = lrintf(av_clipf(combine_buffer[3 * x + plane], 0, 255));
+                p++;
+            }
+        }
+    }
+}
+
 static int plot_spectrum_column(AVFilterLink *inlink, AVFrame *insamples)
 {
     AVFilterContext *ctx = inlink->dst;
     AVFilterLink *outlink = ctx->outputs[0];
     ShowSpectrumContext *s = ctx->priv;
     AVFrame *outpicref = s->outpicref;
-    int ret, plane, x, y, z = s->orientation == VERTICAL ? s->h : s->w;
+    int ret, plane, y, z = s->orientation == VERTICAL ? s->h : s->w;
 
     /* fill a new spectrum column */
     /* initialize buffer for combining to black */
-    clear_combine_buffer(s, z);
+    clear_combine_buffer(s->combine_buffer, z);
 
     ctx->internal->execute(ctx, plot_channel, NULL, NULL, s->nb_display_channels);
 
-    for (y = 0; y < z * 3; y++) {
-        for (x = 0; x < s->nb_display_channels; x++) {
-            s->combine_buffer[y] += s->color_buffer[x][y];
-        }
-    }
+    combine_channels(s, s->combine_buffer, 0, z);
 
     av_frame_make_writable(s->outpicref);
     /* copy to output */
@@ -760,15 +813,6 @@ static int plot_spectrum_column(AVFilterLink *inlink, AVFrame *insamples)
             }
             s->xpos = 0;
         }
-        for (plane = 0; plane < 3; plane++) {
-            uint8_t *p = outpicref->data[plane] + s->start_x +
-                         (outlink->h - 1 - s->start_y) * outpicref->linesize[plane] +
-                         s->xpos;
-            for (y = 0; y < s->h; y++) {
-                *p = lrintf(av_clipf(s->combine_buffer[3 * y + plane], 0, 255));
-                p -= outpicref->linesize[plane];
-            }
-        }
     } else {
         if (s->sliding == SCROLL) {
             for (plane = 0; plane < 3; plane++) {
@@ -789,15 +833,8 @@ static int plot_spectrum_column(AVFilterLink *inlink, AVFrame *insamples)
             }
             s->xpos = 0;
         }
-        for (plane = 0; plane < 3; plane++) {
-            uint8_t *p = outpicref->data[plane] + s->start_x +
-                         (s->xpos + s->start_y) * outpicref->linesize[plane];
-            for (x = 0; x < s->w; x++) {
-                *p = lrintf(av_clipf(s->combine_buffer[3 * x + plane], 0, 255));
-                p++;
-            }
-        }
     }
+    write_column(s, outpicref, s->combine_buffer, s->xpos);
 
     if (s->sliding != FULLFRAME || s->xpos == 0)
         outpicref->pts = insamples->pts;
@@ -1020,6 +1057,63 @@ static void drawtext(AVFrame *pic, int x, int y, const char *txt, int o)
     }
 }
 
+typedef struct ThreadData {
+    AVFrame **fin;              ///< per-job window of input samples
+    int samples;                ///< number of buffered samples
+    int spf;                    ///< distance between two windows, in samples
+    int nb_windows;             ///< number of windows averaged into a column
+} ThreadData;
+
+/* compute and draw a range of columns, each job with its own buffer set */
+static int showspectrumpic_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ShowSpectrumContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *fin = td->fin[jobnr];
+    const int h = s->orientation == VERTICAL ? s->h : s->w;
+    const int sz = s->orientation == VERTICAL ? s->w : s->h;
+    const int start = (sz * jobnr) / nb_jobs;
+    const int end = (sz * (jobnr+1)) / nb_jobs;
+    const int b = jobnr * s->nb_display_channels;
+    float *combine_buffer = s->combine_buffer + jobnr * 3 * h;
+    int ch, i, x;
+
+    for (x = start; x < end; x++) {
+        for (i = 0; i < td->nb_windows; i++) {
+            const int offset = (x * td->nb_windows + i) * td->spf;
+            int ret = 0;
+
+            if (offset < td->samples) {
+                ret = av_audio_fifo_peek_at(s->fifo, (void **)fin->extended_data,
+                                            FFMIN(s->win_size, td->samples - offset),
+                                            offset);
+                if (ret < 0)
+                    return ret;
+            }
+
+            for (ch = 0; ch < s->nb_display_channels; ch++) {
+                if (ret < s->win_size)
+                    memset(fin->extended_data[ch] + ret * sizeof(float), 0,
+                           (s->win_size - ret) * sizeof(float));
+                fft_channel(s, (float *)fin->extended_data[ch], b + ch);
+            }
+            acalc_magnitudes(s, b);
+        }
+
+        scale_magnitudes(s, b, 1. / td->nb_windows);
+        for (ch = 0; ch < s->nb_display_channels; ch++)
+            plot_channel_column(s, ch, b);
+        clear_combine_buffer(combine_buffer, h);
+        combine_channels(s, combine_buffer, b, h);
+        write_column(s, s->outpicref, combine_buffer, x);
+
+        for (ch = 0; ch < s->nb_display_channels; ch++)
+            memset(s->magnitudes[b + ch], 0, h * sizeof(float));
+    }
+
+    return 0;
+}
+
 static int showspectrumpic_request_frame(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
@@ -1030,53 +1124,42 @@ static int showspectrumpic_request_frame(AVFilterLink *outlink)
     ret = ff_request_frame(inlink);
     samples = av_audio_fifo_size(s->fifo);
     if (ret == AVERROR_EOF && s->outpicref && samples > 0) {
-        int consumed = 0;
-        int y, x = 0, sz = s->orientation == VERTICAL ? s->w : s->h;
+        int y, x, sz = s->orientation == VERTICAL ? s->w : s->h;
         int ch, spf, spb;
-        AVFrame *fin;
+        ThreadData td;
 
         spf = s->win_size * (samples / ((s->win_size * sz) * ceil(samples / (float)(s->win_size * sz))));
         spf = FFMAX(1, spf);
 
         spb = (samples / (spf * sz)) * spf;
 
-        fin = ff_get_audio_buffer(inlink, s->win_size);
-        if (!fin)
+        td.samples = samples;
+        td.spf = spf;
+        td.nb_windows = FFMAX(1, spb / spf);
+        td.fin = av_calloc(s->nb_threads, sizeof(*td.fin));
+        if (!td.fin)
             return AVERROR(ENOMEM);
+        ret = 0;
+        for (x = 0; x < s->nb_threads && ret >= 0; x++) {
+            td.fin[x] = ff_get_audio_buffer(inlink, s->win_size);
+            if (!td.fin[x])
+                ret = AVERROR(ENOMEM);
+        }
+        if (ret >= 0)
+            ret = av_frame_make_writable(s->outpicref);
 
-        while (x < sz) {
-            ret = av_audio_fifo_peek(s->fifo, (void **)fin->extended_data, s->win_size);
-            if (ret < 0) {
-                av_frame_free(&fin);
-                return ret;
-            }
-
-            av_audio_fifo_drain(s->fifo, spf);
-
-            if (ret < s->win_size) {
-                for (ch = 0; ch < s->nb_display_channels; ch++) {
-                    memset(fin->extended_data[ch] + ret * sizeof(float), 0,
-                           (s->win_size - ret) * sizeof(float));
-                }
-            }
-
-            ctx->internal->execute(ctx, run_channel_fft, fin, NULL, s->nb_display_channels);
-            acalc_magnitudes(s);
-
-            consumed += spf;
-            if (consumed >= spb) {
-                int h = s->orientation == VERTICAL ? s->h : s->w;
+        /* columns only depend on the buffered samples, so they are computed
+         * in parallel, every job peeking its windows at their offset */
+        if (ret >= 0)
+            ctx->internal->execute(ctx, showspectrumpic_columns, &td, NULL, s->nb_threads);
 
-                scale_magnitudes(s, 1. / (consumed / spf));
-                plot_spectrum_column(inlink, fin);
-                consumed = 0;
-                x++;
-                for (ch = 0; ch < s->nb_display_channels; ch++)
-                    memset(s->magnitudes[ch], 0, h * sizeof(float));
-            }
-        }
+        for (x = 0; x < s->nb_threads; x++)
+            av_frame_free(&td.fin[x]);
+        av_freep(&td.fin);
+        if (ret < 0)
+            return ret;
 
-        av_frame_free(&fin);
+        av_audio_fifo_drain(s->fifo, samples);
         s->outpicref->pts = 0;
 
         if (s->legend) {
@@ -0,0 +1,45 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_OVERLAY_H
+#define AVFILTER_OVERLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct OverlayDSPContext {
+    /**
+     * Blend one row of an 8-bit overlay plane on top of a main plane
+     * without alpha, indexed by [hsub][vsub] of the overlay alpha plane.
+     *
+     * @param d         main plane row, modified in place
+     * @param s         overlay plane row
+     * @param a         overlay alpha row matching s (full resolution)
+     * @param w         number of pixels of the d/s row to process; the
+     *                  alpha samples to the right of and below the last
+     *                  pixel are read when subsampled
+     * @param alinesize linesize of the overlay alpha plane
+     */
+    void (*blend_row[2][2])(uint8_t *d, const uint8_t *s, const uint8_t *a,
+                            int w, ptrdiff_t alinesize);
+} OverlayDSPContext;
+
+void ff_overlay_init(OverlayDSPContext *dsp);
+void ff_overlay_init_x86(OverlayDSPContext *dsp);
+
+#endif /* AVFILTER_OVERLAY_H */
@@ -0,0 +1,349 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Non-uniform partitioned FFT convolution
+ *
+ * A segment with partitions of part_size samples starting at tap offset
+ * convolves the input delayed by offset samples. Its input blocks of
+ * part_size samples are only complete part_size - min_part_size samples
+ * after their start, so offset must be at least that large. Segments are
+ * laid out as min_part_size, min_part_size, 2 * min_part_size,
+ * 4 * min_part_size... which satisfies this while doubling the partition
+ * size as early as possible.
+ */
+
+#include "libavutil/avassert.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#include "partconv.h"
+
+void ff_partconv_fcmul_add_c(float *sum, const float *t, const float *c, ptrdiff_t len)
+{
+    int n;
+
+    for (n = 0; n < len; n++) {
+        const float cre = c[2 * n    ];
+        const float cim = c[2 * n + 1];
+        const float tre = t[2 * n    ];
+        const float tim = t[2 * n + 1];
+
+        sum[2 * n    ] += tre * cre - tim * cim;
+        sum[2 * n + 1] += tre * cim + tim * cre;
+    }
+
+    sum[2 * n] += t[2 * n] * c[2 * n];
+}
+
+static int init_segment(PartConvContext *c, PartConvSegment *seg,
+                        int offset, int nb_partitions, int part_size)
+{
+    int i;
+
+    seg->part_size     = part_size;
+    seg->nb_partitions = nb_partitions;
+    seg->offset        = offset;
+    seg->block_size    = FFALIGN(2 * part_size + 1, 32);
+    seg->coeff_size    = 2 * FFALIGN(part_size + 1, 32);
+    seg->part_index    = 0;
+
+    seg->block   = av_calloc(c->nb_inputs, sizeof(*seg->block));
+    seg->rdft    = av_calloc(c->nb_inputs, sizeof(*seg->rdft));
+    seg->coeff   = av_calloc(c->nb_inputs * c->nb_outputs, sizeof(*seg->coeff));
+    seg->sum     = av_calloc(c->nb_outputs, sizeof(*seg->sum));
+    seg->overlap = av_calloc(c->nb_outputs, sizeof(*seg->overlap));
+    seg->output  = av_calloc(c->nb_outputs, sizeof(*seg->output));
+    seg->irdft   = av_calloc(c->nb_outputs, sizeof(*seg->irdft));
+    if (!seg->block || !seg->rdft || !seg->coeff || !seg->sum ||
+        !seg->overlap || !seg->output || !seg->irdft)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < c->nb_inputs; i++) {
+        seg->block[i] = av_calloc(nb_partitions * seg->block_size, sizeof(**seg->block));
+        seg->rdft[i]  = av_rdft_init(av_log2(2 * part_size), DFT_R2C);
+        if (!seg->block[i] || !seg->rdft[i])
+            return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < c->nb_outputs; i++) {
+        seg->sum[i]     = av_calloc(seg->block_size, sizeof(**seg->sum));
+        seg->overlap[i] = av_calloc(part_size, sizeof(**seg->overlap));
+        seg->output[i]  = av_calloc(part_size, sizeof(**seg->output));
+        seg->irdft[i]   = av_rdft_init(av_log2(2 * part_size), IDFT_C2R);
+        if (!seg->sum[i] || !seg->overlap[i] || !seg->output[i] || !seg->irdft[i])
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+int ff_partconv_init(PartConvContext *c, int nb_inputs, int nb_outputs,
+                     int nb_taps, int min_part_size, int max_part_size)
+{
+    int i, n, ret, left, offset, part_size, history_size;
+
+    if (nb_inputs <= 0 || nb_outputs <= 0 || nb_taps <= 0)
+        return AVERROR(EINVAL);
+
+    c->nb_inputs  = nb_inputs;
+    c->nb_outputs = nb_outputs;
+    c->nb_taps    = nb_taps;
+    c->nb_blocks  = 0;
+    c->fcmul_add  = ff_partconv_fcmul_add_c;
+
+    for (n = 3; n < 15 && (1 << n) < nb_taps; n++);
+    max_part_size = 1 << av_log2(av_clip(max_part_size, 8, 1 << n));
+    min_part_size = 1 << av_log2(av_clip(min_part_size, 8, max_part_size));
+    c->min_part_size = min_part_size;
+
+    left      = nb_taps;
+    offset    = 0;
+    part_size = min_part_size;
+    for (i = 0; left > 0; i++) {
+        int step = part_size == max_part_size ? INT_MAX : 1 + (i == 0);
+        int nb_partitions = FFMIN(step, (left + part_size - 1) / part_size);
+
+        av_assert0(i < PARTCONV_MAX_SEGMENTS);
+        c->nb_segments = i + 1;
+        ret = init_segment(c, &c->seg[i], offset, nb_partitions, part_size);
+        if (ret < 0)
+            return ret;
+
+        offset += nb_partitions * part_size;
+        left   -= nb_partitions * part_size;
+        part_size = FFMIN(2 * part_size, max_part_size);
+    }
+
+    for (i = 0; i < c->nb_segments; i++)
+        av_assert0(c->seg[i].offset >= c->seg[i].part_size - min_part_size);
+
+    /* the last segment reads the oldest samples */
+    history_size = 1 << av_ceil_log2(c->seg[c->nb_segments - 1].offset + min_part_size);
+    c->history_mask = history_size - 1;
+    c->history = av_calloc(nb_inputs, sizeof(*c->history));
+    if (!c->history)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb_inputs; i++) {
+        c->history[i] = av_calloc(history_size, sizeof(**c->history));
+        if (!c->history[i])
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+int ff_partconv_set_ir(PartConvContext *c, int input, int output,
+                       const float *ir, int nb_taps, ptrdiff_t stride,
+                       float gain)
+{
+    int i, k, n;
+
+    for (i = 0; i < c->nb_segments; i++) {
+        PartConvSegment *seg = &c->seg[i];
+        const int part_size = seg->part_size;
+        const float scale = gain / part_size;
+        float **coeffp = &seg->coeff[input * c->nb_outputs + output];
+        float *block = seg->sum[0];
+
+        if (!*coeffp) {
+            *coeffp = av_calloc(seg->nb_partitions * seg->coeff_size, sizeof(**coeffp));
+            if (!*coeffp)
+                return AVERROR(ENOMEM);
+        }
+
+        for (k = 0; k < seg->nb_partitions; k++) {
+            float *coeff = *coeffp + k * seg->coeff_size;
+            const int start = seg->offset + k * part_size;
+            const int size = av_clip(nb_taps - start, 0, part_size);
+
+            memset(block, 0, sizeof(*block) * seg->block_size);
+            for (n = 0; n < size; n++)
+                block[n] = ir[(start + n) * stride];
+
+            av_rdft_calc(seg->rdft[input], block);
+
+            coeff[0] = block[0] * scale;
+            coeff[1] = 0;
+            for (n = 1; n < part_size; n++) {
+                coeff[2 * n    ] = block[2 * n    ] * scale;
+                coeff[2 * n + 1] = block[2 * n + 1] * scale;
+            }
+            coeff[2 * part_size    ] = block[1] * scale;
+            coeff[2 * part_size + 1] = 0;
+        }
+        memset(block, 0, sizeof(*block) * seg->block_size);
+    }
+
+    return 0;
+}
+
+static int segment_due(PartConvContext *c, PartConvSegment *seg)
+{
+    const int nb_blocks = seg->part_size / c->min_part_size;
+
+    return ((c->nb_blocks + 1) & (nb_blocks - 1)) == 0;
+}
+
+void ff_partconv_input(PartConvContext *c, int input,
+                       const float *src, int nb_samples)
+{
+    const int min_part_size = c->min_part_size;
+    const int mask = c->history_mask;
+    float *history = c->history[input];
+    const int64_t end = (c->nb_blocks + 1) * min_part_size;
+    int i, n, pos;
+
+    pos = (end - min_part_size) & mask;
+    memcpy(history + pos, src, nb_samples * sizeof(*history));
+    memset(history + pos + nb_samples, 0, (min_part_size - nb_samples) * sizeof(*history));
+
+    for (i = 0; i < c->nb_segments; i++) {
+        PartConvSegment *seg = &c->seg[i];
+        const int part_size = seg->part_size;
+        float *block;
+        int len;
+
+        if (!segment_due(c, seg))
+            continue;
+
+        block = seg->block[input] + seg->part_index * seg->block_size;
+        pos = (end - min_part_size - seg->offset) & mask;
+        len = FFMIN(part_size, mask + 1 - pos);
+        memcpy(block, history + pos, len * sizeof(*block));
+        memcpy(block + len, history, (part_size - len) * sizeof(*block));
+        for (n = part_size; n < seg->block_size; n++)
+            block[n] = 0;
+
+        av_rdft_calc(seg->rdft[input], block);
+        block[2 * part_size] = block[1];
+        block[1] = 0;
+    }
+}
+
+void ff_partconv_output(PartConvContext *c, int output, float *dst)
+{
+    const int min_part_size = c->min_part_size;
+    int i, j, k, n;
+
+    for (i = 0; i < c->nb_segments; i++) {
+        PartConvSegment *seg = &c->seg[i];
+        const int part_size = seg->part_size;
+        float *out = seg->output[output];
+        int input, pos;
+
+        if (segment_due(c, seg)) {
+            float *overlap = seg->overlap[output];
+            float *sum = seg->sum[output];
+            int has_coeffs = 0;
+
+            memset(sum, 0, sizeof(*sum) * seg->block_size);
+
+            for (input = 0; input < c->nb_inputs; input++) {
+                const float *coeff = seg->coeff[input * c->nb_outputs + output];
+
+                if (!coeff)
+                    continue;
+                has_coeffs = 1;
+
+                j = seg->part_index;
+                for (k = 0; k < seg->nb_partitions; k++) {
+                    const float *block = seg->block[input] + j * seg->block_size;
+
+                    c->fcmul_add(sum, block, coeff + k * seg->coeff_size, part_size);
+
+                    if (j == 0)
+                        j = seg->nb_partitions;
+                    j--;
+                }
+            }
+
+            if (has_coeffs) {
+                sum[1] = sum[2 * part_size];
+                av_rdft_calc(seg->irdft[output], sum);
+
+                for (n = 0; n < part_size; n++)
+                    out[n] = sum[n] + overlap[n];
+                memcpy(overlap, sum + part_size, part_size * sizeof(*overlap));
+            }
+        }
+
+        pos = ((c->nb_blocks + 1) & (part_size / min_part_size - 1)) * min_part_size;
+        if (i == 0) {
+            memcpy(dst, out + pos, min_part_size * sizeof(*dst));
+        } else {
+            for (n = 0; n < min_part_size; n++)
+                dst[n] += out[pos + n];
+        }
+    }
+}
+
+void ff_partconv_next(PartConvContext *c)
+{
+    int i;
+
+    for (i = 0; i < c->nb_segments; i++) {
+        PartConvSegment *seg = &c->seg[i];
+
+        if (segment_due(c, seg))
+            seg->part_index = (seg->part_index + 1) % seg->nb_partitions;
+    }
+    c->nb_blocks++;
+}
+
+void ff_partconv_uninit(PartConvContext *c)
+{
+    int i, j;
+
+    for (i = 0; i < c->nb_segments; i++) {
+        PartConvSegment *seg = &c->seg[i];
+
+        for (j = 0; j < c->nb_inputs; j++) {
+            if (seg->block)
+                av_freep(&seg->block[j]);
+            if (seg->rdft)
+                av_rdft_end(seg->rdft[j]);
+        }
+        for (j = 0; seg->coeff && j < c->nb_inputs * c->nb_outputs; j++)
+            av_freep(&seg->coeff[j]);
+        for (j = 0; j < c->nb_outputs; j++) {
+            if (seg->sum)
+                av_freep(&seg->sum[j]);
+            if (seg->overlap)
+                av_freep(&seg->overlap[j]);
+            if (seg->output)
+                av_freep(&seg->output[j]);
+            if (seg->irdft)
+                av_rdft_end(seg->irdft[j]);
+        }
+        av_freep(&seg->block);
+        av_freep(&seg->rdft);
+        av_freep(&seg->coeff);
+        av_freep(&seg->sum);
+        av_freep(&seg->overlap);
+        av_freep(&seg->output);
+        av_freep(&seg->irdft);
+    }
+    c->nb_segments = 0;
+
+    for (i = 0; c->history && i < c->nb_inputs; i++)
+        av_freep(&c->history[i]);
+    av_freep(&c->history);
+}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Non-uniform partitioned FFT convolution
+ *
+ * The impulse responses are split into segments of uniform partitions. The
+ * first segment uses the smallest partition size, which sets the latency
+ * and the number of samples processed at a time. Later segments use
+ * growing partition sizes and are computed less often, which keeps the
+ * cost of long impulse responses low.
+ *
+ * Any number of inputs can be convolved into any number of outputs, each
+ * output being the sum of the inputs convolved with the impulse response
+ * set for that input/output pair.
+ */
+
+#ifndef AVFILTER_PARTCONV_H
+#define AVFILTER_PARTCONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavcodec/avfft.h"
+
+#define PARTCONV_MAX_SEGMENTS 32
+
+typedef struct PartConvSegment {
+    int part_size;              ///< partition size, the FFT size is twice that
+    int nb_partitions;          ///< number of partitions in this segment
+    int offset;                 ///< position of the first tap of this segment
+    int block_size;             ///< allocated size of one input spectrum
+    int coeff_size;             ///< allocated size of one partition spectrum
+    int part_index;             ///< slot of the most recent input spectrum
+
+    float **block;              ///< spectra of the last input blocks, per input
+    float **coeff;              ///< partition spectra, per input/output pair
+    float **sum;                ///< spectrum accumulator, per output
+    float **overlap;            ///< tail of the previous block, per output
+    float **output;             ///< last computed output block, per output
+
+    RDFTContext **rdft;         ///< forward transform, per input
+    RDFTContext **irdft;        ///< inverse transform, per output
+} PartConvSegment;
+
+typedef struct PartConvContext {
+    int nb_inputs;
+    int nb_outputs;
+    int nb_taps;
+    int min_part_size;          ///< number of samples processed at a time
+    int nb_segments;
+    int64_t nb_blocks;          ///< number of processed blocks
+
+    float **history;            ///< ring buffer of past input samples, per input
+    int history_mask;
+
+    PartConvSegment seg[PARTCONV_MAX_SEGMENTS];
+
+    void (*fcmul_add)(float *sum, const float *t, const float *c,
+                      ptrdiff_t len);
+} PartConvContext;
+
+/**
+ * Set up the partitions for impulse responses of up to nb_taps taps.
+ *
+ * min_part_size and max_part_size are rounded down to powers of 2.
+ * Partitions are never made larger than needed for nb_taps taps.
+ * The context must be zeroed or uninitialized with ff_partconv_uninit().
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_partconv_init(PartConvContext *c, int nb_inputs, int nb_outputs,
+                     int nb_taps, int min_part_size, int max_part_size);
+
+/**
+ * Set the impulse response convolving the given input into the given output.
+ *
+ * Pairs without an impulse response do not contribute to the output.
+ * Must not be called concurrently with any other function.
+ *
+ * @param ir     first tap
+ * @param stride distance between two taps
+ * @param gain   factor applied to the taps
+ */
+int ff_partconv_set_ir(PartConvContext *c, int input, int output,
+                       const float *ir, int nb_taps, ptrdiff_t stride,
+                       float gain);
+
+/**
+ * Feed the next block of min_part_size samples of an input.
+ *
+ * If nb_samples is smaller than min_part_size, the rest of the block is
+ * zero. Different inputs may be fed concurrently.
+ */
+void ff_partconv_input(PartConvContext *c, int input,
+                       const float *src, int nb_samples);
+
+/**
+ * Compute the output block corresponding to the last fed input blocks.
+ *
+ * Must be called after all inputs have been fed for the current block.
+ * Different outputs may be computed concurrently.
+ *
+ * @param dst buffer for min_part_size output samples
+ */
+void ff_partconv_output(PartConvContext *c, int output, float *dst);
+
+/**
+ * Move on to the next block, after all outputs have been computed.
+ */
+void ff_partconv_next(PartConvContext *c);
+
+void ff_partconv_uninit(PartConvContext *c);
+
+void ff_partconv_fcmul_add_c(float *sum, const float *t, const float *c,
+                             ptrdiff_t len);
+
+#endif /* AVFILTER_PARTCONV_H */
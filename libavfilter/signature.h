@@ -108,6 +108,10 @@ typedef struct StreamContext {
     /* overflow protection */
     int divide;
 
+    /* first pixel column/row of each of the 32x32 blocks, plus the end */
+    int xbin[33];
+    int ybin[33];
+
     FineSignature* finesiglist;
     FineSignature* curfinesig;
 
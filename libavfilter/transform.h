@@ -124,4 +124,22 @@ int avfilter_transform(const uint8_t *src, uint8_t *dst,
                         enum InterpolateMethod interpolate,
                         enum FillMethod fill);
 
+/**
+ * Do an affine transformation of the rows [slice_start, slice_end) of the
+ * destination image. The whole source image may be read, so slices of the
+ * same destination can be transformed concurrently.
+ *
+ * @param slice_start first destination row to transform
+ * @param slice_end   row after the last destination row to transform
+ * @see avfilter_transform() for the remaining parameters
+ * @return negative on error
+ */
+int avfilter_transform_slice(const uint8_t *src, uint8_t *dst,
+                             int src_stride, int dst_stride,
+                             int width, int height,
+                             int slice_start, int slice_end,
+                             const float *matrix,
+                             enum InterpolateMethod interpolate,
+                             enum FillMethod fill);
+
 #endif /* AVFILTER_TRANSFORM_H */
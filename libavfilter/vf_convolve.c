@@ -29,12 +29,15 @@
 #include "internal.h"
 #include "video.h"
 
+#define MAX_THREADS 16
+#define TRANSPOSE_BLOCK 8
+
 typedef struct ConvolveContext {
     const AVClass *class;
     FFFrameSync fs;
 
-    FFTContext *fft[4];
-    FFTContext *ifft[4];
+    FFTContext *fft[4][MAX_THREADS];
+    FFTContext *ifft[4][MAX_THREADS];
 
     int fft_bits[4];
     int fft_len[4];
@@ -51,6 +54,7 @@ typedef struct ConvolveContext {
     int impulse;
     int nb_planes;
     int got_impulse[4];
+    int nb_threads;
 } ConvolveContext;
 
 #define OFFSET(x) offsetof(ConvolveContext, x)
@@ -152,12 +156,34 @@ static int config_input_impulse(AVFilterLink *inlink)
     return 0;
 }
 
-static void fft_horizontal(ConvolveContext *s, FFTComplex *fft_hdata,
-                           AVFrame *in, int w, int h, int n, int plane, float scale)
+typedef struct ThreadData {
+    FFTComplex *hdata, *vdata;
+    FFTComplex *vdata_impulse;  ///< if set, multiply by it and transform back
+    AVFrame *frame;
+    int plane, w, h, n;
+    float scale;
+} ThreadData;
+
+static int fft_horizontal_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    ConvolveContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    FFTComplex *fft_hdata = td->hdata;
+    AVFrame *in = td->frame;
+    const int plane = td->plane;
+    const int w = td->w, h = td->h, n = td->n;
+    const float scale = td->scale;
+    const int slice_start = (n *  jobnr     ) / nb_jobs;
+    const int slice_end   = (n * (jobnr + 1)) / nb_jobs;
     int y, x;
 
-    for (y = 0; y < h; y++) {
+    for (y = slice_start; y < slice_end; y++) {
+        /* the rows below the picture are zero and so is their transform */
+        if (y >= h) {
+            memset(fft_hdata + y * n, 0, n * sizeof(*fft_hdata));
+            continue;
+        }
+
         if (s->depth == 8) {
             const uint8_t *src = in->data[plane] + in->linesize[plane] * y;
 
@@ -177,81 +203,107 @@ static void fft_horizontal(ConvolveContext *s, FFTComplex *fft_hdata,
             fft_hdata[y * n + x].re = 0;
             fft_hdata[y * n + x].im = 0;
         }
-    }
 
-    for (; y < n; y++) {
-        for (x = 0; x < n; x++) {
-            fft_hdata[y * n + x].re = 0;
-            fft_hdata[y * n + x].im = 0;
-        }
+        av_fft_permute(s->fft[plane][jobnr], fft_hdata + y * n);
+        av_fft_calc(s->fft[plane][jobnr], fft_hdata + y * n);
     }
 
-    for (y = 0; y < n; y++) {
-        av_fft_permute(s->fft[plane], fft_hdata + y * n);
-        av_fft_calc(s->fft[plane], fft_hdata + y * n);
-    }
+    return 0;
 }
 
-static void fft_vertical(ConvolveContext *s, FFTComplex *fft_hdata, FFTComplex *fft_vdata,
-                         int n, int plane)
+static int fft_vertical_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int y, x;
+    ConvolveContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    FFTComplex *fft_hdata = td->hdata;
+    FFTComplex *fft_vdata = td->vdata;
+    const FFTComplex *fft_vdata_impulse = td->vdata_impulse;
+    const int plane = td->plane;
+    const int n = td->n;
+    const int slice_start = (n *  jobnr     ) / nb_jobs;
+    const int slice_end   = (n * (jobnr + 1)) / nb_jobs;
+    int y, yy, x;
+
+    /* Columns are gathered TRANSPOSE_BLOCK at a time, so that each source
+     * row is read in contiguous runs rather than one sample per row. */
+    for (y = slice_start; y < slice_end; y += TRANSPOSE_BLOCK) {
+        const int block_end = FFMIN(y + TRANSPOSE_BLOCK, slice_end);
+
+        for (x = 0; x < n; x++)
+            for (yy = y; yy < block_end; yy++)
+                fft_vdata[yy * n + x] = fft_hdata[x * n + yy];
+
+        for (yy = y; yy < block_end; yy++) {
+            FFTComplex *line = fft_vdata + yy * n;
+
+            av_fft_permute(s->fft[plane][jobnr], line);
+            av_fft_calc(s->fft[plane][jobnr], line);
+
+            if (!fft_vdata_impulse)
+                continue;
 
-    for (y = 0; y < n; y++) {
-        for (x = 0; x < n; x++) {
-            fft_vdata[y * n + x].re = fft_hdata[x * n + y].re;
-            fft_vdata[y * n + x].im = fft_hdata[x * n + y].im;
-        }
-        for (; x < n; x++) {
-            fft_vdata[y * n + x].re = 0;
-            fft_vdata[y * n + x].im = 0;
-        }
-        av_fft_permute(s->fft[plane], fft_vdata + y * n);
-        av_fft_calc(s->fft[plane], fft_vdata + y * n);
-    }
-}
+            for (x = 0; x < n; x++) {
+                FFTSample re, im, ire, iim;
 
-static void ifft_vertical(ConvolveContext *s, int n, int plane)
-{
-    int y, x;
+                re  = line[x].re;
+                im  = line[x].im;
+                ire = fft_vdata_impulse[yy * n + x].re;
+                iim = fft_vdata_impulse[yy * n + x].im;
+
+                line[x].re = ire * re - iim * im;
+                line[x].im = iim * re + ire * im;
+            }
 
-    for (y = 0; y < n; y++) {
-        av_fft_permute(s->ifft[plane], s->fft_vdata[plane] + y * n);
-        av_fft_calc(s->ifft[plane], s->fft_vdata[plane] + y * n);
-        for (x = 0; x < n; x++) {
-            s->fft_hdata[plane][x * n + y].re = s->fft_vdata[plane][y * n + x].re;
-            s->fft_hdata[plane][x * n + y].im = s->fft_vdata[plane][y * n + x].im;
+            av_fft_permute(s->ifft[plane][jobnr], line);
+            av_fft_calc(s->ifft[plane][jobnr], line);
         }
+
+        if (!fft_vdata_impulse)
+            continue;
+
+        for (x = 0; x < n; x++)
+            for (yy = y; yy < block_end; yy++)
+                fft_hdata[x * n + yy] = fft_vdata[yy * n + x];
     }
+
+    return 0;
 }
 
-static void ifft_horizontal(ConvolveContext *s, AVFrame *out,
-                            int w, int h, int n, int plane)
+static int ifft_horizontal_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    ConvolveContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    FFTComplex *fft_hdata = td->hdata;
+    AVFrame *out = td->frame;
+    const int plane = td->plane;
+    const int w = td->w, h = td->h, n = td->n;
     const float scale = 1.f / (n * n);
     const int max = (1 << s->depth) - 1;
     const int oh = h / 2;
     const int ow = w / 2;
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
     int y, x;
 
-    for (y = 0; y < n; y++) {
-        av_fft_permute(s->ifft[plane], s->fft_hdata[plane] + y * n);
-        av_fft_calc(s->ifft[plane], s->fft_hdata[plane] + y * n);
-    }
+    /* only the rows that end up in the output are transformed back */
+    for (y = slice_start; y < slice_end; y++) {
+        FFTComplex *line = fft_hdata + (y + oh) * n;
+
+        av_fft_permute(s->ifft[plane][jobnr], line);
+        av_fft_calc(s->ifft[plane][jobnr], line);
 
-    if (s->depth == 8) {
-        for (y = 0; y < h; y++) {
+        if (s->depth == 8) {
             uint8_t *dst = out->data[plane] + y * out->linesize[plane];
             for (x = 0; x < w; x++)
-                dst[x] = av_clip_uint8(s->fft_hdata[plane][(y+oh) * n + x+ow].re * scale);
-        }
-    } else {
-        for (y = 0; y < h; y++) {
+                dst[x] = av_clip_uint8(line[x + ow].re * scale);
+        } else {
             uint16_t *dst = (uint16_t *)(out->data[plane] + y * out->linesize[plane]);
             for (x = 0; x < w; x++)
-                dst[x] = av_clip(s->fft_hdata[plane][(y+oh) * n + x+ow].re * scale, 0, max);
+                dst[x] = av_clip(line[x + ow].re * scale, 0, max);
         }
     }
+
+    return 0;
 }
 
 static int do_convolve(FFFrameSync *fs)
@@ -260,6 +312,7 @@ static int do_convolve(FFFrameSync *fs)
     AVFilterLink *outlink = ctx->outputs[0];
     ConvolveContext *s = ctx->priv;
     AVFrame *mainpic = NULL, *impulsepic = NULL;
+    ThreadData td;
     int ret, y, x, plane;
 
     ret = ff_framesync_dualinput_get(fs, &mainpic, &impulsepic);
@@ -278,9 +331,10 @@ static int do_convolve(FFFrameSync *fs)
             continue;
         }
 
-        fft_horizontal(s, s->fft_hdata[plane], mainpic, w, h, n, plane, 1.f);
-        fft_vertical(s, s->fft_hdata[plane], s->fft_vdata[plane],
-                     n, plane);
+        td.plane = plane;
+        td.w = w;
+        td.h = h;
+        td.n = n;
 
         if ((!s->impulse && !s->got_impulse[plane]) || s->impulse) {
             if (s->depth == 8) {
@@ -300,29 +354,25 @@ static int do_convolve(FFFrameSync *fs)
             }
             total = FFMAX(1, total);
 
-            fft_horizontal(s, s->fft_hdata_impulse[plane], impulsepic, w, h, n, plane, 1 / total);
-            fft_vertical(s, s->fft_hdata_impulse[plane], s->fft_vdata_impulse[plane],
-                         n, plane);
+            td.hdata = s->fft_hdata_impulse[plane];
+            td.vdata = s->fft_vdata_impulse[plane];
+            td.vdata_impulse = NULL;
+            td.frame = impulsepic;
+            td.scale = 1 / total;
+            ctx->internal->execute(ctx, fft_horizontal_slice, &td, NULL, FFMIN(n, s->nb_threads));
+            ctx->internal->execute(ctx, fft_vertical_slice, &td, NULL, FFMIN(n, s->nb_threads));
 
             s->got_impulse[plane] = 1;
         }
 
-        for (y = 0; y < n; y++) {
-            for (x = 0; x < n; x++) {
-                FFTSample re, im, ire, iim;
-
-                re = s->fft_vdata[plane][y*n + x].re;
-                im = s->fft_vdata[plane][y*n + x].im;
-                ire = s->fft_vdata_impulse[plane][y*n + x].re;
-                iim = s->fft_vdata_impulse[plane][y*n + x].im;
-
-                s->fft_vdata[plane][y*n + x].re = ire * re - iim * im;
-                s->fft_vdata[plane][y*n + x].im = iim * re + ire * im;
-            }
-        }
-
-        ifft_vertical(s, n, plane);
-        ifft_horizontal(s, mainpic, w, h, n, plane);
+        td.hdata = s->fft_hdata[plane];
+        td.vdata = s->fft_vdata[plane];
+        td.vdata_impulse = s->fft_vdata_impulse[plane];
+        td.frame = mainpic;
+        td.scale = 1.f;
+        ctx->internal->execute(ctx, fft_horizontal_slice, &td, NULL, FFMIN(n, s->nb_threads));
+        ctx->internal->execute(ctx, fft_vertical_slice, &td, NULL, FFMIN(n, s->nb_threads));
+        ctx->internal->execute(ctx, ifft_horizontal_slice, &td, NULL, FFMIN(h, s->nb_threads));
     }
 
     return ff_filter_frame(outlink, mainpic);
@@ -333,7 +383,7 @@ static int config_output(AVFilterLink *outlink)
     AVFilterContext *ctx = outlink->src;
     ConvolveContext *s = ctx->priv;
     AVFilterLink *mainlink = ctx->inputs[0];
-    int ret, i;
+    int ret, i, j;
 
     s->fs.on_event = do_convolve;
     ret = ff_framesync_init_dualinput(&s->fs, ctx);
@@ -348,11 +398,15 @@ static int config_output(AVFilterLink *outlink)
     if ((ret = ff_framesync_configure(&s->fs)) < 0)
         return ret;
 
+    s->nb_threads = FFMIN(MAX_THREADS, ff_filter_get_nb_threads(ctx));
+
     for (i = 0; i < s->nb_planes; i++) {
-        s->fft[i]  = av_fft_init(s->fft_bits[i], 0);
-        s->ifft[i] = av_fft_init(s->fft_bits[i], 1);
-        if (!s->fft[i] || !s->ifft[i])
-            return AVERROR(ENOMEM);
+        for (j = 0; j < s->nb_threads; j++) {
+            s->fft[i][j]  = av_fft_init(s->fft_bits[i], 0);
+            s->ifft[i][j] = av_fft_init(s->fft_bits[i], 1);
+            if (!s->fft[i][j] || !s->ifft[i][j])
+                return AVERROR(ENOMEM);
+        }
     }
 
     return 0;
@@ -367,15 +421,17 @@ static int activate(AVFilterContext *ctx)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     ConvolveContext *s = ctx->priv;
-    int i;
+    int i, j;
 
     for (i = 0; i < 4; i++) {
         av_freep(&s->fft_hdata[i]);
         av_freep(&s->fft_vdata[i]);
         av_freep(&s->fft_hdata_impulse[i]);
         av_freep(&s->fft_vdata_impulse[i]);
-        av_fft_end(s->fft[i]);
-        av_fft_end(s->ifft[i]);
+        for (j = 0; j < MAX_THREADS; j++) {
+            av_fft_end(s->fft[i][j]);
+            av_fft_end(s->ifft[i][j]);
+        }
     }
 
     ff_framesync_uninit(&s->fs);
@@ -414,5 +470,5 @@ AVFilter ff_vf_convolve = {
     .priv_class    = &convolve_class,
     .inputs        = convolve_inputs,
     .outputs       = convolve_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS,
 };
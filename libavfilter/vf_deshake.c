@@ -155,7 +155,8 @@ static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
             }
         }
 
-        // Hone in on the specific best match around the match we found above
+        // Hone in on the specific best match around the match we found above,
+        // without leaving the search range when it is 0 in one direction
         tmp = mv->x;
         tmp2 = mv->y;
 
@@ -163,6 +164,8 @@ static void find_block_motion(DeshakeContext *deshake, uint8_t *src1,
             for (x = tmp - 1; x <= tmp + 1; x++) {
                 if (x == tmp && y == tmp2)
                     continue;
+                if (FFABS(x) > deshake->rx || FFABS(y) > deshake->ry)
+                    continue;
 
                 diff = CMP(cx - x, cy - y);
                 if (diff < smallest) {
@@ -226,6 +229,49 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
            diff;
 }
 
+typedef struct ThreadData {
+    uint8_t *src1, *src2;
+    int stride;
+    int nb_blocks_x, nb_blocks_y;
+} ThreadData;
+
+/**
+ * Find the motion vector of every block in a range of block rows. Blocks
+ * with too little contrast get an invalid (-1, -1) vector.
+ *
+ * The search of every block starts from a zero vector, so that the result
+ * does not depend on which block was searched before in the same job.
+ */
+static int find_motion_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DeshakeContext *deshake = ctx->priv;
+    ThreadData *td = arg;
+    const int slice_start = (td->nb_blocks_y * jobnr) / nb_jobs;
+    const int slice_end = (td->nb_blocks_y * (jobnr+1)) / nb_jobs;
+    int bx, by, x, y;
+
+    for (by = slice_start; by < slice_end; by++) {
+        IntMotionVector *mvs = deshake->mvs + by * td->nb_blocks_x;
+
+        y = deshake->ry + by * deshake->blocksize * 2;
+        for (bx = 0; bx < td->nb_blocks_x; bx++) {
+            x = deshake->rx + bx * 16;
+            // If the contrast is too low, just skip this block as it probably
+            // won't be very useful to us.
+            if (block_contrast(td->src2, x, y, td->stride, deshake->blocksize) > deshake->contrast) {
+                IntMotionVector mv = {0, 0};
+
+                find_block_motion(deshake, td->src1, td->src2, x, y, td->stride, &mv);
+                mvs[bx] = mv;
+            } else {
+                mvs[bx].x = mvs[bx].y = -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Find the estimated global motion for a scene given the most likely shift
  * for each block in the frame. The global motion is estimated to be the
@@ -233,19 +279,34 @@ static double block_angle(int x, int y, int cx, int cy, IntMotionVector *shift)
  * move one pixel to the right and two pixels down, this would yield a
  * motion vector (1, -2).
  */
-static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
-                        int width, int height, int stride, Transform *t)
+static int find_motion(AVFilterContext *ctx, uint8_t *src1, uint8_t *src2,
+                       int width, int height, int stride, Transform *t)
 {
-    int x, y;
-    IntMotionVector mv = {0, 0};
+    DeshakeContext *deshake = ctx->priv;
+    ThreadData td;
+    int x, y, bx, by;
+    IntMotionVector *mv;
     int count_max_value = 0;
-    int contrast;
 
     int pos;
     int center_x = 0, center_y = 0;
     double p_x, p_y;
 
+    td.src1 = src1;
+    td.src2 = src2;
+    td.stride = stride;
+    td.nb_blocks_x = 0;
+    td.nb_blocks_y = 0;
+    // We use a width of 16 here to match the sad function
+    for (x = deshake->rx; x < width - deshake->rx - 16; x += 16)
+        td.nb_blocks_x++;
+    for (y = deshake->ry; y < height - deshake->ry - (deshake->blocksize * 2); y += deshake->blocksize * 2)
+        td.nb_blocks_y++;
+
     av_fast_malloc(&deshake->angles, &deshake->angles_size, width * height / (16 * deshake->blocksize) * sizeof(*deshake->angles));
+    av_fast_malloc(&deshake->mvs, &deshake->mvs_size, FFMAX(td.nb_blocks_x * td.nb_blocks_y, 1) * sizeof(*deshake->mvs));
+    if (!deshake->mvs)
+        return AVERROR(ENOMEM);
 
     // Reset counts to zero
     for (x = 0; x < deshake->rx * 2 + 1; x++) {
@@ -254,25 +315,25 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
         }
     }
 
+    // Find motion for every block
+    if (td.nb_blocks_x > 0 && td.nb_blocks_y > 0)
+        ctx->internal->execute(ctx, find_motion_slice, &td, NULL,
+                               FFMIN(td.nb_blocks_y, ff_filter_get_nb_threads(ctx)));
+
     pos = 0;
-    // Find motion for every block and store the motion vector in the counts
-    for (y = deshake->ry; y < height - deshake->ry - (deshake->blocksize * 2); y += deshake->blocksize * 2) {
-        // We use a width of 16 here to match the sad function
-        for (x = deshake->rx; x < width - deshake->rx - 16; x += 16) {
-            // If the contrast is too low, just skip this block as it probably
-            // won't be very useful to us.
-            contrast = block_contrast(src2, x, y, stride, deshake->blocksize);
-            if (contrast > deshake->contrast) {
-                //av_log(NULL, AV_LOG_ERROR, "%d\n", contrast);
-                find_block_motion(deshake, src1, src2, x, y, stride, &mv);
-                if (mv.x != -1 && mv.y != -1) {
-                    deshake->counts[mv.x + deshake->rx][mv.y + deshake->ry] += 1;
-                    if (x > deshake->rx && y > deshake->ry)
-                        deshake->angles[pos++] = block_angle(x, y, 0, 0, &mv);
-
-                    center_x += mv.x;
-                    center_y += mv.y;
-                }
+    // Store the motion vectors in the counts, in block order
+    for (by = 0; by < td.nb_blocks_y; by++) {
+        y = deshake->ry + by * deshake->blocksize * 2;
+        for (bx = 0; bx < td.nb_blocks_x; bx++) {
+            x = deshake->rx + bx * 16;
+            mv = &deshake->mvs[by * td.nb_blocks_x + bx];
+            if (mv->x != -1 && mv->y != -1) {
+                deshake->counts[mv->x + deshake->rx][mv->y + deshake->ry] += 1;
+                if (x > deshake->rx && y > deshake->ry)
+                    deshake->angles[pos++] = block_angle(x, y, 0, 0, mv);
+
+                center_x += mv->x;
+                center_y += mv->y;
             }
         }
     }
@@ -311,32 +372,63 @@ static void find_motion(DeshakeContext *deshake, uint8_t *src1, uint8_t *src2,
     t->angle = av_clipf(t->angle, -0.1, 0.1);
 
     //av_log(NULL, AV_LOG_ERROR, "%d x %d\n", avg->x, avg->y);
+    return 0;
 }
 
-static int deshake_transform_c(AVFilterContext *ctx,
-                                    int width, int height, int cw, int ch,
-                                    const float *matrix_y, const float *matrix_uv,
-                                    enum InterpolateMethod interpolate,
-                                    enum FillMethod fill, AVFrame *in, AVFrame *out)
-{
-    int i = 0, ret = 0;
-    const float *matrixs[3];
+typedef struct TransformThreadData {
+    AVFrame *in, *out;
+    const float *matrix[3];
     int plane_w[3], plane_h[3];
-    matrixs[0] = matrix_y;
-    matrixs[1] =  matrixs[2] = matrix_uv;
-    plane_w[0] = width;
-    plane_w[1] = plane_w[2] = cw;
-    plane_h[0] = height;
-    plane_h[1] = plane_h[2] = ch;
+    enum InterpolateMethod interpolate;
+    enum FillMethod fill;
+} TransformThreadData;
+
+static int transform_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    TransformThreadData *td = arg;
+    int i, ret;
 
     for (i = 0; i < 3; i++) {
+        const int slice_start = (td->plane_h[i] * jobnr) / nb_jobs;
+        const int slice_end = (td->plane_h[i] * (jobnr+1)) / nb_jobs;
+
         // Transform the luma and chroma planes
-        ret = avfilter_transform(in->data[i], out->data[i], in->linesize[i], out->linesize[i],
-                                 plane_w[i], plane_h[i], matrixs[i], interpolate, fill);
+        ret = avfilter_transform_slice(td->in->data[i], td->out->data[i],
+                                       td->in->linesize[i], td->out->linesize[i],
+                                       td->plane_w[i], td->plane_h[i],
+                                       slice_start, slice_end, td->matrix[i],
+                                       td->interpolate, td->fill);
         if (ret < 0)
             return ret;
     }
-    return ret;
+    return 0;
+}
+
+static int deshake_transform_c(AVFilterContext *ctx,
+                                    int width, int height, int cw, int ch,
+                                    const float *matrix_y, const float *matrix_uv,
+                                    enum InterpolateMethod interpolate,
+                                    enum FillMethod fill, AVFrame *in, AVFrame *out)
+{
+    TransformThreadData td;
+
+    if (interpolate < 0 || interpolate >= INTERPOLATE_COUNT)
+        return AVERROR(EINVAL);
+
+    td.in = in;
+    td.out = out;
+    td.matrix[0] = matrix_y;
+    td.matrix[1] = td.matrix[2] = matrix_uv;
+    td.plane_w[0] = width;
+    td.plane_w[1] = td.plane_w[2] = cw;
+    td.plane_h[0] = height;
+    td.plane_h[1] = td.plane_h[2] = ch;
+    td.interpolate = interpolate;
+    td.fill = fill;
+
+    ctx->internal->execute(ctx, transform_slice, &td, NULL,
+                           FFMIN(ch, ff_filter_get_nb_threads(ctx)));
+    return 0;
 }
 
 static av_cold int init(AVFilterContext *ctx)
@@ -422,6 +514,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_frame_free(&deshake->ref);
     av_freep(&deshake->angles);
     deshake->angles_size = 0;
+    av_freep(&deshake->mvs);
+    deshake->mvs_size = 0;
     if (deshake->fp)
         fclose(deshake->fp);
 }
@@ -455,7 +549,7 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
 
     if (deshake->cx < 0 || deshake->cy < 0 || deshake->cw < 0 || deshake->ch < 0) {
         // Find the most likely global motion for the current frame
-        find_motion(deshake, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
+        ret = find_motion(link->dst, (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0], in->data[0], link->w, link->h, in->linesize[0], &t);
     } else {
         uint8_t *src1 = (deshake->ref == NULL) ? in->data[0] : deshake->ref->data[0];
         uint8_t *src2 = in->data[0];
@@ -472,8 +566,10 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         src1 += deshake->cy * in->linesize[0] + deshake->cx;
         src2 += deshake->cy * in->linesize[0] + deshake->cx;
 
-        find_motion(deshake, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
+        ret = find_motion(link->dst, src1, src2, deshake->cw, deshake->ch, in->linesize[0], &t);
     }
+    if (ret < 0)
+        goto fail;
 
 
     // Copy transform so we can output it later to compare to the smoothed value
@@ -576,4 +672,5 @@ AVFilter ff_vf_deshake = {
     .inputs        = deshake_inputs,
     .outputs       = deshake_outputs,
     .priv_class    = &deshake_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
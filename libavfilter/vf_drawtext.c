@@ -197,6 +197,10 @@ typedef struct DrawTextContext {
     int text_shaping;               ///< 1 to shape the text before drawing it
 #endif
     AVDictionary *metadata;
+
+    char *layout_text;              ///< expanded text the cached layout was computed for
+    unsigned int layout_fontsize;   ///< font size the cached layout was computed for
+    int glyphs_y, glyphs_h;         ///< rows covered by the glyphs and their borders, relative to the text position
 } DrawTextContext;
 
 #define OFFSET(x) offsetof(DrawTextContext, x)
@@ -817,6 +821,8 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_bprint_finalize(&s->expanded_text, NULL);
     av_bprint_finalize(&s->expanded_fontcolor, NULL);
+
+    av_freep(&s->layout_text);
 }
 
 static int config_input(AVFilterLink *inlink)
@@ -1166,19 +1172,20 @@ static int expand_text(AVFilterContext *ctx, char *text, AVBPrint *bp)
     return 0;
 }
 
-static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
-                       int width, int height,
-                       FFDrawColor *color,
-                       int x, int y, int borderw)
+/**
+ * Compute the range of rows covered by the glyphs of the expanded text and
+ * their borders, so that the frame can be split into slices around them.
+ */
+static int glyphs_extent(DrawTextContext *s)
 {
     char *text = s->expanded_text.str;
     uint32_t code = 0;
-    int i, x1, y1;
+    int i, y1;
+    int y_min = INT_MAX, y_max = INT_MIN;
     uint8_t *p;
     Glyph *glyph = NULL;
 
     for (i = 0, p = text; *p; i++) {
-        FT_Bitmap bitmap;
         Glyph dummy = { 0 };
         GET_UTF8(code, *p++, continue;);
 
@@ -1190,23 +1197,214 @@ static int draw_glyphs(DrawTextContext *s, AVFrame *frame,
         dummy.fontsize = s->fontsize;
         glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
 
-        bitmap = borderw ? glyph->border_bitmap : glyph->bitmap;
-
         if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
             glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
             return AVERROR(EINVAL);
 
+        y1 = s->positions[i].y;
+        y_min = FFMIN(y_min, y1);
+        y_max = FFMAX(y_max, y1 + (int)glyph->bitmap.rows);
+        if (s->borderw) {
+            y_min = FFMIN(y_min, y1 - s->borderw);
+            y_max = FFMAX(y_max, y1 - s->borderw + (int)glyph->border_bitmap.rows);
+        }
+    }
+
+    s->glyphs_y = y_min;
+    s->glyphs_h = y_min < y_max ? y_max - y_min : 0;
+
+    return 0;
+}
+
+static int layout_text(AVFilterContext *ctx)
+{
+    DrawTextContext *s = ctx->priv;
+
+    uint32_t code = 0, prev_code = 0;
+    int x = 0, y = 0, i = 0, ret;
+    int max_text_line_w = 0;
+    char *text = s->expanded_text.str;
+    uint8_t *p;
+    int y_min = 32000, y_max = -32000;
+    int x_min = 32000, x_max = -32000;
+    FT_Vector delta;
+    Glyph *glyph = NULL, *prev_glyph = NULL;
+    Glyph dummy = { 0 };
+
+    /* load and cache glyphs */
+    for (i = 0, p = text; *p; i++) {
+        GET_UTF8(code, *p++, continue;);
+
+        /* get glyph */
+        dummy.code = code;
+        dummy.fontsize = s->fontsize;
+        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+        if (!glyph) {
+            ret = load_glyph(ctx, &glyph, code);
+            if (ret < 0)
+                return ret;
+        }
+
+        y_min = FFMIN(glyph->bbox.yMin, y_min);
+        y_max = FFMAX(glyph->bbox.yMax, y_max);
+        x_min = FFMIN(glyph->bbox.xMin, x_min);
+        x_max = FFMAX(glyph->bbox.xMax, x_max);
+    }
+    s->max_glyph_h = y_max - y_min;
+    s->max_glyph_w = x_max - x_min;
+
+    /* compute and save position for each glyph */
+    glyph = NULL;
+    for (i = 0, p = text; *p; i++) {
+        GET_UTF8(code, *p++, continue;);
+
+        /* skip the \n in the sequence \r\n */
+        if (prev_code == '\r' && code == '\n')
+            continue;
+
+        prev_code = code;
+        if (is_newline(code)) {
+
+            max_text_line_w = FFMAX(max_text_line_w, x);
+            y += s->max_glyph_h + s->line_spacing;
+            x = 0;
+            continue;
+        }
+
+        /* get glyph */
+        prev_glyph = glyph;
+        dummy.code = code;
+        dummy.fontsize = s->fontsize;
+        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+
+        /* kerning */
+        if (s->use_kerning && prev_glyph && glyph->code) {
+            FT_Get_Kerning(s->face, prev_glyph->code, glyph->code,
+                           ft_kerning_default, &delta);
+            x += delta.x >> 6;
+        }
+
+        /* save position */
+        s->positions[i].x = x + glyph->bitmap_left;
+        s->positions[i].y = y - glyph->bitmap_top + y_max;
+        if (code == '\t') x  = (x / s->tabsize + 1)*s->tabsize;
+        else              x += glyph->advance;
+    }
+
+    max_text_line_w = FFMAX(x, max_text_line_w);
+
+    s->var_values[VAR_TW] = s->var_values[VAR_TEXT_W] = max_text_line_w;
+    s->var_values[VAR_TH] = s->var_values[VAR_TEXT_H] = y + s->max_glyph_h;
+
+    s->var_values[VAR_MAX_GLYPH_W] = s->max_glyph_w;
+    s->var_values[VAR_MAX_GLYPH_H] = s->max_glyph_h;
+    s->var_values[VAR_MAX_GLYPH_A] = s->var_values[VAR_ASCENT ] = y_max;
+    s->var_values[VAR_MAX_GLYPH_D] = s->var_values[VAR_DESCENT] = y_min;
+
+    s->var_values[VAR_LINE_H] = s->var_values[VAR_LH] = s->max_glyph_h;
+
+    return glyphs_extent(s);
+}
+
+typedef struct ThreadData {
+    AVFrame *frame;
+    FFDrawColor fontcolor;
+    FFDrawColor shadowcolor;
+    FFDrawColor bordercolor;
+    FFDrawColor boxcolor;
+    int box_w, box_h;
+    int y_start, y_end;
+} ThreadData;
+
+/**
+ * Blend the glyphs one after the other, like a single pass over the whole
+ * frame would, but only on the frame lines in [slice_start, slice_end).
+ */
+static void draw_glyphs(DrawTextContext *s, AVFrame *frame,
+                        FFDrawColor *color, int x, int y, int borderw,
+                        int slice_start, int slice_end)
+{
+    char *text = s->expanded_text.str;
+    uint32_t code = 0;
+    int i, x1, y1, start, end;
+    uint8_t *p;
+    Glyph *glyph = NULL;
+
+    for (i = 0, p = text; *p; i++) {
+        FT_Bitmap bitmap;
+        Glyph dummy = { 0 };
+        GET_UTF8(code, *p++, continue;);
+
+        /* skip new line chars, just go to new line */
+        if (code == '\n' || code == '\r' || code == '\t')
+            continue;
+
+        dummy.code = code;
+        dummy.fontsize = s->fontsize;
+        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
+
+        bitmap = borderw ? glyph->border_bitmap : glyph->bitmap;
+
         x1 = s->positions[i].x+s->x+x - borderw;
         y1 = s->positions[i].y+s->y+y - borderw;
 
+        start = FFMAX(y1, slice_start);
+        end   = FFMIN(y1 + (int)bitmap.rows, slice_end);
+        if (start >= end)
+            continue;
+
         ff_blend_mask(&s->dc, color,
-                      frame->data, frame->linesize, width, height,
-                      bitmap.buffer, bitmap.pitch,
-                      bitmap.width, bitmap.rows,
+                      frame->data, frame->linesize, frame->width, frame->height,
+                      bitmap.buffer + (start - y1) * bitmap.pitch, bitmap.pitch,
+                      bitmap.width, end - start,
                       bitmap.pixel_mode == FT_PIXEL_MODE_MONO ? 0 : 3,
-                      0, x1, y1);
+                      0, x1, start);
+    }
+}
+
+/**
+ * Blend the box and all layers of the text for the frame lines in
+ * [slice_start, slice_end). Slice boundaries are aligned on the vertical
+ * chroma subsampling so that no chroma line is shared between two jobs.
+ */
+static int draw_text_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    DrawTextContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *frame = td->frame;
+    int vmask = (1 << s->dc.vsub_max) - 1;
+    int slice_start = td->y_start + (td->y_end - td->y_start) *  jobnr      / nb_jobs;
+    int slice_end   = td->y_start + (td->y_end - td->y_start) * (jobnr + 1) / nb_jobs;
+
+    if (jobnr)
+        slice_start &= ~vmask;
+    if (jobnr != nb_jobs - 1)
+        slice_end &= ~vmask;
+
+    if (s->draw_box) {
+        int start = FFMAX(s->y - s->boxborderw, slice_start);
+        int end   = FFMIN(s->y - s->boxborderw + td->box_h + s->boxborderw * 2, slice_end);
+
+        if (start < end)
+            ff_blend_rectangle(&s->dc, &td->boxcolor,
+                               frame->data, frame->linesize, frame->width, frame->height,
+                               s->x - s->boxborderw, start,
+                               td->box_w + s->boxborderw * 2, end - start);
     }
 
+    if (!s->glyphs_h)
+        return 0;
+
+    if (s->shadowx || s->shadowy)
+        draw_glyphs(s, frame, &td->shadowcolor, s->shadowx, s->shadowy, 0,
+                    slice_start, slice_end);
+
+    if (s->borderw)
+        draw_glyphs(s, frame, &td->bordercolor, 0, 0, s->borderw,
+                    slice_start, slice_end);
+
+    draw_glyphs(s, frame, &td->fontcolor, 0, 0, 0, slice_start, slice_end);
+
     return 0;
 }
 
@@ -1239,26 +1437,13 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
     DrawTextContext *s = ctx->priv;
     AVFilterLink *inlink = ctx->inputs[0];
 
-    uint32_t code = 0, prev_code = 0;
-    int x = 0, y = 0, i = 0, ret;
-    int max_text_line_w = 0, len;
-    int box_w, box_h;
+    int ret, len, nb_jobs;
     char *text;
-    uint8_t *p;
-    int y_min = 32000, y_max = -32000;
-    int x_min = 32000, x_max = -32000;
-    FT_Vector delta;
-    Glyph *glyph = NULL, *prev_glyph = NULL;
-    Glyph dummy = { 0 };
 
     time_t now = time(0);
     struct tm ltime;
     AVBPrint *bp = &s->expanded_text;
-
-    FFDrawColor fontcolor;
-    FFDrawColor shadowcolor;
-    FFDrawColor bordercolor;
-    FFDrawColor boxcolor;
+    ThreadData td;
 
     av_bprint_clear(bp);
 
@@ -1310,118 +1495,55 @@ static int draw_text(AVFilterContext *ctx, AVFrame *frame,
         ff_draw_color(&s->dc, &s->fontcolor, s->fontcolor.rgba);
     }
 
-    x = 0;
-    y = 0;
-
     if ((ret = update_fontsize(ctx)) < 0)
         return ret;
 
-    /* load and cache glyphs */
-    for (i = 0, p = text; *p; i++) {
-        GET_UTF8(code, *p++, continue;);
-
-        /* get glyph */
-        dummy.code = code;
-        dummy.fontsize = s->fontsize;
-        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
-        if (!glyph) {
-            ret = load_glyph(ctx, &glyph, code);
-            if (ret < 0)
-                return ret;
-        }
-
-        y_min = FFMIN(glyph->bbox.yMin, y_min);
-        y_max = FFMAX(glyph->bbox.yMax, y_max);
-        x_min = FFMIN(glyph->bbox.xMin, x_min);
-        x_max = FFMAX(glyph->bbox.xMax, x_max);
-    }
-    s->max_glyph_h = y_max - y_min;
-    s->max_glyph_w = x_max - x_min;
-
-    /* compute and save position for each glyph */
-    glyph = NULL;
-    for (i = 0, p = text; *p; i++) {
-        GET_UTF8(code, *p++, continue;);
-
-        /* skip the \n in the sequence \r\n */
-        if (prev_code == '\r' && code == '\n')
-            continue;
-
-        prev_code = code;
-        if (is_newline(code)) {
-
-            max_text_line_w = FFMAX(max_text_line_w, x);
-            y += s->max_glyph_h + s->line_spacing;
-            x = 0;
-            continue;
-        }
-
-        /* get glyph */
-        prev_glyph = glyph;
-        dummy.code = code;
-        dummy.fontsize = s->fontsize;
-        glyph = av_tree_find(s->glyphs, &dummy, glyph_cmp, NULL);
-
-        /* kerning */
-        if (s->use_kerning && prev_glyph && glyph->code) {
-            FT_Get_Kerning(s->face, prev_glyph->code, glyph->code,
-                           ft_kerning_default, &delta);
-            x += delta.x >> 6;
-        }
-
-        /* save position */
-        s->positions[i].x = x + glyph->bitmap_left;
-        s->positions[i].y = y - glyph->bitmap_top + y_max;
-        if (code == '\t') x  = (x / s->tabsize + 1)*s->tabsize;
-        else              x += glyph->advance;
+    /* the layout only depends on the text and the font size, reuse it as
+     * long as neither changed */
+    if (!s->layout_text || s->layout_fontsize != s->fontsize ||
+        strcmp(s->layout_text, text)) {
+        av_freep(&s->layout_text);
+        if ((ret = layout_text(ctx)) < 0)
+            return ret;
+        if (!(s->layout_text = av_strdup(text)))
+            return AVERROR(ENOMEM);
+        s->layout_fontsize = s->fontsize;
     }
 
-    max_text_line_w = FFMAX(x, max_text_line_w);
-
-    s->var_values[VAR_TW] = s->var_values[VAR_TEXT_W] = max_text_line_w;
-    s->var_values[VAR_TH] = s->var_values[VAR_TEXT_H] = y + s->max_glyph_h;
-
-    s->var_values[VAR_MAX_GLYPH_W] = s->max_glyph_w;
-    s->var_values[VAR_MAX_GLYPH_H] = s->max_glyph_h;
-    s->var_values[VAR_MAX_GLYPH_A] = s->var_values[VAR_ASCENT ] = y_max;
-    s->var_values[VAR_MAX_GLYPH_D] = s->var_values[VAR_DESCENT] = y_min;
-
-    s->var_values[VAR_LINE_H] = s->var_values[VAR_LH] = s->max_glyph_h;
-
     s->x = s->var_values[VAR_X] = av_expr_eval(s->x_pexpr, s->var_values, &s->prng);
     s->y = s->var_values[VAR_Y] = av_expr_eval(s->y_pexpr, s->var_values, &s->prng);
     s->x = s->var_values[VAR_X] = av_expr_eval(s->x_pexpr, s->var_values, &s->prng);
 
     update_alpha(s);
-    update_color_with_alpha(s, &fontcolor  , s->fontcolor  );
-    update_color_with_alpha(s, &shadowcolor, s->shadowcolor);
-    update_color_with_alpha(s, &bordercolor, s->bordercolor);
-    update_color_with_alpha(s, &boxcolor   , s->boxcolor   );
-
-    box_w = FFMIN(width - 1 , max_text_line_w);
-    box_h = FFMIN(height - 1, y + s->max_glyph_h);
-
-    /* draw box */
-    if (s->draw_box)
-        ff_blend_rectangle(&s->dc, &boxcolor,
-                           frame->data, frame->linesize, width, height,
-                           s->x - s->boxborderw, s->y - s->boxborderw,
-                           box_w + s->boxborderw * 2, box_h + s->boxborderw * 2);
-
-    if (s->shadowx || s->shadowy) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &shadowcolor, s->shadowx, s->shadowy, 0)) < 0)
-            return ret;
+    update_color_with_alpha(s, &td.fontcolor  , s->fontcolor  );
+    update_color_with_alpha(s, &td.shadowcolor, s->shadowcolor);
+    update_color_with_alpha(s, &td.bordercolor, s->bordercolor);
+    update_color_with_alpha(s, &td.boxcolor   , s->boxcolor   );
+
+    td.frame = frame;
+    td.box_w = FFMIN(width - 1 , (int)s->var_values[VAR_TEXT_W]);
+    td.box_h = FFMIN(height - 1, (int)s->var_values[VAR_TEXT_H]);
+
+    /* lines touched by the box and all layers of the text */
+    td.y_start = height;
+    td.y_end   = 0;
+    if (s->draw_box) {
+        td.y_start = s->y - s->boxborderw;
+        td.y_end   = s->y + td.box_h + s->boxborderw;
     }
-
-    if (s->borderw) {
-        if ((ret = draw_glyphs(s, frame, width, height,
-                               &bordercolor, 0, 0, s->borderw)) < 0)
-            return ret;
+    if (s->glyphs_h) {
+        td.y_start = FFMIN3(td.y_start, s->y + s->glyphs_y, s->y + s->glyphs_y + s->shadowy);
+        td.y_end   = FFMAX3(td.y_end, s->y + s->glyphs_y + s->glyphs_h,
+                            s->y + s->glyphs_y + s->glyphs_h + s->shadowy);
     }
-    if ((ret = draw_glyphs(s, frame, width, height,
-                           &fontcolor, 0, 0, 0)) < 0)
-        return ret;
+    td.y_start = FFMAX(td.y_start, 0);
+    td.y_end   = FFMIN(td.y_end, height);
+    if (td.y_start >= td.y_end)
+        return 0;
+
+    nb_jobs = av_clip((td.y_end - td.y_start) >> s->dc.vsub_max, 1,
+                      ff_filter_get_nb_threads(ctx));
+    ctx->internal->execute(ctx, draw_text_slice, &td, NULL, nb_jobs);
 
     return 0;
 }
@@ -1494,5 +1616,5 @@ AVFilter ff_vf_drawtext = {
     .inputs        = avfilter_vf_drawtext_inputs,
     .outputs       = avfilter_vf_drawtext_outputs,
     .process_command = command,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
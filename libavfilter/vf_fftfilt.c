@@ -32,6 +32,8 @@
 #include "libavutil/eval.h"
 
 #define MAX_PLANES 4
+#define MAX_THREADS 16
+#define TRANSPOSE_BLOCK 8
 
 enum EvalMode {
     EVAL_MODE_INIT,
@@ -48,10 +50,11 @@ typedef struct FFTFILTContext {
     int planewidth[MAX_PLANES];
     int planeheight[MAX_PLANES];
 
-    RDFTContext *hrdft[MAX_PLANES];
-    RDFTContext *vrdft[MAX_PLANES];
-    RDFTContext *ihrdft[MAX_PLANES];
-    RDFTContext *ivrdft[MAX_PLANES];
+    int nb_threads;
+    RDFTContext *hrdft[MAX_THREADS][MAX_PLANES];
+    RDFTContext *vrdft[MAX_THREADS][MAX_PLANES];
+    RDFTContext *ihrdft[MAX_THREADS][MAX_PLANES];
+    RDFTContext *ivrdft[MAX_THREADS][MAX_PLANES];
     int rdft_hbits[MAX_PLANES];
     int rdft_vbits[MAX_PLANES];
     size_t rdft_hlen[MAX_PLANES];
@@ -110,65 +113,109 @@ static void copy_rev (FFTSample *dest, int w, int w2)
         dest[i] = dest[w2 - i];
 }
 
+typedef struct ThreadData {
+    AVFrame *frame;
+    int plane, w, h;
+} ThreadData;
+
 /*Horizontal pass - RDFT*/
-static void rdft_horizontal(FFTFILTContext *s, AVFrame *in, int w, int h, int plane)
+static int rdft_horizontal_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FFTFILTContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    AVFrame *in = td->frame;
+    const int plane = td->plane;
+    const int w = td->w, h = td->h;
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
     int i, j;
 
-    for (i = 0; i < h; i++) {
+    for (i = slice_start; i < slice_end; i++) {
+        FFTSample *line = s->rdft_hdata[plane] + i * s->rdft_hlen[plane];
+
         for (j = 0; j < w; j++)
-            s->rdft_hdata[plane][i * s->rdft_hlen[plane] + j] = *(in->data[plane] + in->linesize[plane] * i + j);
+            line[j] = *(in->data[plane] + in->linesize[plane] * i + j);
 
-        copy_rev(s->rdft_hdata[plane] + i * s->rdft_hlen[plane], w, s->rdft_hlen[plane]);
+        copy_rev(line, w, s->rdft_hlen[plane]);
+        av_rdft_calc(s->hrdft[jobnr][plane], line);
     }
 
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->hrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+    return 0;
 }
 
-/*Vertical pass - RDFT*/
-static void rdft_vertical(FFTFILTContext *s, int h, int plane)
+/*Vertical pass - RDFT, weighting and IRDFT*/
+static int rdft_vertical_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int i, j;
+    FFTFILTContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int plane = td->plane;
+    const int h = td->h;
+    const size_t hlen = s->rdft_hlen[plane];
+    const size_t vlen = s->rdft_vlen[plane];
+    FFTSample *hdata = s->rdft_hdata[plane];
+    FFTSample *vdata = s->rdft_vdata[plane];
+    const double *weight = s->weight[plane];
+    const int slice_start = (hlen *  jobnr     ) / nb_jobs;
+    const int slice_end   = (hlen * (jobnr + 1)) / nb_jobs;
+    int i, ii, j;
+
+    /* Columns are transposed TRANSPOSE_BLOCK at a time, so that each row
+     * of the horizontal pass is accessed in contiguous runs. */
+    for (i = slice_start; i < slice_end; i += TRANSPOSE_BLOCK) {
+        const int block_end = FFMIN(i + TRANSPOSE_BLOCK, slice_end);
 
-    for (i = 0; i < s->rdft_hlen[plane]; i++) {
         for (j = 0; j < h; j++)
-            s->rdft_vdata[plane][i * s->rdft_vlen[plane] + j] =
-            s->rdft_hdata[plane][j * s->rdft_hlen[plane] + i];
-        copy_rev(s->rdft_vdata[plane] + i * s->rdft_vlen[plane], h, s->rdft_vlen[plane]);
-    }
+            for (ii = i; ii < block_end; ii++)
+                vdata[ii * vlen + j] = hdata[j * hlen + ii];
 
-    for (i = 0; i < s->rdft_hlen[plane]; i++)
-        av_rdft_calc(s->vrdft[plane], s->rdft_vdata[plane] + i * s->rdft_vlen[plane]);
-}
-/*Vertical pass - IRDFT*/
-static void irdft_vertical(FFTFILTContext *s, int h, int plane)
-{
-    int i, j;
+        for (ii = i; ii < block_end; ii++) {
+            FFTSample *line = vdata + ii * vlen;
+
+            copy_rev(line, h, vlen);
+            av_rdft_calc(s->vrdft[jobnr][plane], line);
 
-    for (i = 0; i < s->rdft_hlen[plane]; i++)
-        av_rdft_calc(s->ivrdft[plane], s->rdft_vdata[plane] + i * s->rdft_vlen[plane]);
+            /*Change user defined parameters*/
+            for (j = 0; j < vlen; j++)
+                line[j] *= weight[ii * vlen + j];
+
+            if (!ii)
+                line[0] += hlen * vlen * s->dc[plane];
+
+            av_rdft_calc(s->ivrdft[jobnr][plane], line);
+        }
 
-    for (i = 0; i < s->rdft_hlen[plane]; i++)
         for (j = 0; j < h; j++)
-            s->rdft_hdata[plane][j * s->rdft_hlen[plane] + i] =
-            s->rdft_vdata[plane][i * s->rdft_vlen[plane] + j];
+            for (ii = i; ii < block_end; ii++)
+                hdata[j * hlen + ii] = vdata[ii * vlen + j];
+    }
+
+    return 0;
 }
 
 /*Horizontal pass - IRDFT*/
-static void irdft_horizontal(FFTFILTContext *s, AVFrame *out, int w, int h, int plane)
+static int irdft_horizontal_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FFTFILTContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    AVFrame *out = td->frame;
+    const int plane = td->plane;
+    const int w = td->w, h = td->h;
+    const int slice_start = (h *  jobnr     ) / nb_jobs;
+    const int slice_end   = (h * (jobnr + 1)) / nb_jobs;
     int i, j;
 
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->ihrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+    for (i = slice_start; i < slice_end; i++) {
+        FFTSample *line = s->rdft_hdata[plane] + i * s->rdft_hlen[plane];
+
+        av_rdft_calc(s->ihrdft[jobnr][plane], line);
 
-    for (i = 0; i < h; i++)
         for (j = 0; j < w; j++)
-            *(out->data[plane] + out->linesize[plane] * i + j) = av_clip(s->rdft_hdata[plane][i
-                                                                         *s->rdft_hlen[plane] + j] * 4 /
+            *(out->data[plane] + out->linesize[plane] * i + j) = av_clip(line[j] * 4 /
                                                                          (s->rdft_hlen[plane] *
                                                                           s->rdft_vlen[plane]), 0, 255);
+    }
+
+    return 0;
 }
 
 static av_cold int initialize(AVFilterContext *ctx)
@@ -228,7 +275,7 @@ static int config_props(AVFilterLink *inlink)
 {
     FFTFILTContext *s = inlink->dst->priv;
     const AVPixFmtDescriptor *desc;
-    int rdft_hbits, rdft_vbits, i, plane;
+    int rdft_hbits, rdft_vbits, i, j, plane;
 
     desc = av_pix_fmt_desc_get(inlink->format);
     s->depth = desc->comp[0].depth;
@@ -238,6 +285,7 @@ static int config_props(AVFilterLink *inlink)
     s->planeheight[0] = s->planeheight[3] = inlink->h;
 
     s->nb_planes = av_pix_fmt_count_planes(inlink->format);
+    s->nb_threads = FFMIN(MAX_THREADS, ff_filter_get_nb_threads(inlink->dst));
 
     for (i = 0; i < desc->nb_components; i++) {
         int w = s->planewidth[i];
@@ -250,10 +298,12 @@ static int config_props(AVFilterLink *inlink)
         if (!(s->rdft_hdata[i] = av_malloc_array(h, s->rdft_hlen[i] * sizeof(FFTSample))))
             return AVERROR(ENOMEM);
 
-        if (!(s->hrdft[i] = av_rdft_init(s->rdft_hbits[i], DFT_R2C)))
-            return AVERROR(ENOMEM);
-        if (!(s->ihrdft[i] = av_rdft_init(s->rdft_hbits[i], IDFT_C2R)))
-            return AVERROR(ENOMEM);
+        for (j = 0; j < s->nb_threads; j++) {
+            if (!(s->hrdft[j][i] = av_rdft_init(s->rdft_hbits[i], DFT_R2C)))
+                return AVERROR(ENOMEM);
+            if (!(s->ihrdft[j][i] = av_rdft_init(s->rdft_hbits[i], IDFT_C2R)))
+                return AVERROR(ENOMEM);
+        }
 
         /* RDFT - Array initialization for Vertical pass*/
         for (rdft_vbits = 1; 1 << rdft_vbits < h*10/9; rdft_vbits++);
@@ -262,10 +312,12 @@ static int config_props(AVFilterLink *inlink)
         if (!(s->rdft_vdata[i] = av_malloc_array(s->rdft_hlen[i], s->rdft_vlen[i] * sizeof(FFTSample))))
             return AVERROR(ENOMEM);
 
-        if (!(s->vrdft[i] = av_rdft_init(s->rdft_vbits[i], DFT_R2C)))
-            return AVERROR(ENOMEM);
-        if (!(s->ivrdft[i] = av_rdft_init(s->rdft_vbits[i], IDFT_C2R)))
-            return AVERROR(ENOMEM);
+        for (j = 0; j < s->nb_threads; j++) {
+            if (!(s->vrdft[j][i] = av_rdft_init(s->rdft_vbits[i], DFT_R2C)))
+                return AVERROR(ENOMEM);
+            if (!(s->ivrdft[j][i] = av_rdft_init(s->rdft_vbits[i], IDFT_C2R)))
+                return AVERROR(ENOMEM);
+        }
     }
 
     /*Luminance value - Array initialization*/
@@ -285,7 +337,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     AVFilterLink *outlink = inlink->dst->outputs[0];
     FFTFILTContext *s = ctx->priv;
     AVFrame *out;
-    int i, j, plane;
+    int plane;
 
     out = ff_get_video_buffer(outlink, inlink->w, inlink->h);
     if (!out) {
@@ -299,22 +351,19 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         int w = s->planewidth[plane];
         int h = s->planeheight[plane];
 
+        ThreadData td = { .plane = plane, .w = w, .h = h };
+
         if (s->eval_mode == EVAL_MODE_FRAME)
             do_eval(s, inlink, plane);
 
-        rdft_horizontal(s, in, w, h, plane);
-        rdft_vertical(s, h, plane);
-
-        /*Change user defined parameters*/
-        for (i = 0; i < s->rdft_hlen[plane]; i++)
-            for (j = 0; j < s->rdft_vlen[plane]; j++)
-                s->rdft_vdata[plane][i * s->rdft_vlen[plane] + j] *=
-                  s->weight[plane][i * s->rdft_vlen[plane] + j];
-
-        s->rdft_vdata[plane][0] += s->rdft_hlen[plane] * s->rdft_vlen[plane] * s->dc[plane];
-
-        irdft_vertical(s, h, plane);
-        irdft_horizontal(s, out, w, h, plane);
+        td.frame = in;
+        ctx->internal->execute(ctx, rdft_horizontal_slice, &td, NULL,
+                               FFMIN(h, s->nb_threads));
+        ctx->internal->execute(ctx, rdft_vertical_slice, &td, NULL,
+                               FFMIN(s->rdft_hlen[plane], s->nb_threads));
+        td.frame = out;
+        ctx->internal->execute(ctx, irdft_horizontal_slice, &td, NULL,
+                               FFMIN(h, s->nb_threads));
     }
 
     av_frame_free(&in);
@@ -324,16 +373,18 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     FFTFILTContext *s = ctx->priv;
-    int i;
+    int i, j;
     for (i = 0; i < MAX_PLANES; i++) {
         av_free(s->rdft_hdata[i]);
         av_free(s->rdft_vdata[i]);
         av_expr_free(s->weight_expr[i]);
         av_free(s->weight[i]);
-        av_rdft_end(s->hrdft[i]);
-        av_rdft_end(s->ihrdft[i]);
-        av_rdft_end(s->vrdft[i]);
-        av_rdft_end(s->ivrdft[i]);
+        for (j = 0; j < MAX_THREADS; j++) {
+            av_rdft_end(s->hrdft[j][i]);
+            av_rdft_end(s->ihrdft[j][i]);
+            av_rdft_end(s->vrdft[j][i]);
+            av_rdft_end(s->ivrdft[j][i]);
+        }
     }
 }
 
@@ -381,5 +432,5 @@ AVFilter ff_vf_fftfilt = {
     .query_formats   = query_formats,
     .init            = initialize,
     .uninit          = uninit,
-    .flags           = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags           = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,695 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Calculate the SSIM and PSNR of several video streams against one
+ * reference video stream.
+ *
+ * The SSIM uses the same overlapped 8x8 block sums as the ssim filter. The
+ * sums of every 4x4 block are split into the part that only depends on the
+ * reference (sum and sum of squares), which is computed once per frame, and
+ * the part that depends on each distorted input. The PSNR is derived from
+ * the same block sums, plus the pixels to the right and below the last
+ * full block.
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "avfilter.h"
+#include "drawutils.h"
+#include "formats.h"
+#include "framesync.h"
+#include "internal.h"
+#include "video.h"
+
+typedef struct MetricInput {
+    double ssim[4], ssim_total;
+    double mse, min_mse, max_mse, mse_comp[4];
+    float *score[4];                ///< SSIM of every row of 4x4 blocks
+} MetricInput;
+
+typedef struct MultiMetricContext {
+    const AVClass *class;
+    FFFrameSync fs;
+    int nb_inputs;                  ///< number of distorted inputs
+    FILE *stats_file;
+    char *stats_file_str;
+    uint64_t nb_frames;
+    int nb_components;
+    int max, average_max;
+    int is_rgb;
+    uint8_t rgba_map[4];
+    char comps[4];
+    int planewidth[4];
+    int planeheight[4];
+    double planeweight[4];
+    float coefs[4];                 ///< plane weights of the SSIM, as in the ssim filter
+    int64_t (*ref_sums[4])[2];      ///< sum and sum of squares of every reference block
+    int64_t (**temp)[3];            ///< two rows of distorted block sums per job
+    uint64_t (*sse)[4];             ///< per job and input squared error of every plane
+    int nb_threads;
+    MetricInput *metrics;
+    AVFrame **frames;
+} MultiMetricContext;
+
+#define OFFSET(x) offsetof(MultiMetricContext, x)
+#define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
+
+static const AVOption multimetric_options[] = {
+    { "inputs",     "set number of distorted inputs", OFFSET(nb_inputs), AV_OPT_TYPE_INT, {.i64=2}, 1, INT_MAX, FLAGS },
+    { "stats_file", "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    { "f",          "Set file where to store per-frame difference information", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(multimetric);
+
+static void set_meta(AVDictionary **metadata, const char *key, int idx,
+                     char comp, float d)
+{
+    char value[128], key2[128];
+
+    snprintf(value, sizeof(value), "%0.2f", d);
+    if (comp)
+        snprintf(key2, sizeof(key2), key, idx, comp);
+    else
+        snprintf(key2, sizeof(key2), key, idx);
+    av_dict_set(metadata, key2, value, 0);
+}
+
+static inline unsigned pow_2(unsigned base)
+{
+    return base*base;
+}
+
+static inline double get_psnr(double mse, uint64_t nb_frames, int max)
+{
+    return 10.0 * log10(pow_2(max) / (mse / nb_frames));
+}
+
+static double ssim_db(double ssim, double weight)
+{
+    return 10 * log10(weight / (weight - ssim));
+}
+
+static float ssim_end1x(int64_t s1, int64_t s2, int64_t ss, int64_t s12, int max)
+{
+    int64_t ssim_c1 = (int64_t)(.01*.01*max*max*64 + .5);
+    int64_t ssim_c2 = (int64_t)(.03*.03*max*max*64*63 + .5);
+
+    int64_t fs1 = s1;
+    int64_t fs2 = s2;
+    int64_t fss = ss;
+    int64_t fs12 = s12;
+    int64_t vars = fss * 64 - fs1 * fs1 - fs2 * fs2;
+    int64_t covar = fs12 * 64 - fs1 * fs2;
+
+    return (float)(2 * fs1 * fs2 + ssim_c1) * (float)(2 * covar + ssim_c2)
+         / ((float)(fs1 * fs1 + fs2 * fs2 + ssim_c1) * (float)(vars + ssim_c2));
+}
+
+static void ref_4x4xn_8bit(const uint8_t *ref, ptrdiff_t ref_stride,
+                           int64_t (*sums)[2], int width)
+{
+    int x, y, z;
+
+    for (z = 0; z < width; z++) {
+        uint32_t s2 = 0, ss = 0;
+
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 4; x++) {
+                int b = ref[x + y * ref_stride];
+
+                s2 += b;
+                ss += b*b;
+            }
+        }
+
+        sums[z][0] = s2;
+        sums[z][1] = ss;
+        ref += 4;
+    }
+}
+
+static void ref_4x4xn_16bit(const uint8_t *ref8, ptrdiff_t ref_stride,
+                            int64_t (*sums)[2], int width)
+{
+    const uint16_t *ref16 = (const uint16_t *)ref8;
+    int x, y, z;
+
+    ref_stride >>= 1;
+
+    for (z = 0; z < width; z++) {
+        uint64_t s2 = 0, ss = 0;
+
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 4; x++) {
+                unsigned b = ref16[x + y * ref_stride];
+
+                s2 += b;
+                ss += (uint64_t)b*b;
+            }
+        }
+
+        sums[z][0] = s2;
+        sums[z][1] = ss;
+        ref16 += 4;
+    }
+}
+
+static void main_4x4xn_8bit(const uint8_t *main, ptrdiff_t main_stride,
+                            const uint8_t *ref, ptrdiff_t ref_stride,
+                            int64_t (*sums)[3], int width)
+{
+    int x, y, z;
+
+    for (z = 0; z < width; z++) {
+        uint32_t s1 = 0, ss = 0, s12 = 0;
+
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 4; x++) {
+                int a = main[x + y * main_stride];
+                int b = ref[x + y * ref_stride];
+
+                s1  += a;
+                ss  += a*a;
+                s12 += a*b;
+            }
+        }
+
+        sums[z][0] = s1;
+        sums[z][1] = ss;
+        sums[z][2] = s12;
+        main += 4;
+        ref += 4;
+    }
+}
+
+static void main_4x4xn_16bit(const uint8_t *main8, ptrdiff_t main_stride,
+                             const uint8_t *ref8, ptrdiff_t ref_stride,
+                             int64_t (*sums)[3], int width)
+{
+    const uint16_t *main16 = (const uint16_t *)main8;
+    const uint16_t *ref16  = (const uint16_t *)ref8;
+    int x, y, z;
+
+    main_stride >>= 1;
+    ref_stride >>= 1;
+
+    for (z = 0; z < width; z++) {
+        uint64_t s1 = 0, ss = 0, s12 = 0;
+
+        for (y = 0; y < 4; y++) {
+            for (x = 0; x < 4; x++) {
+                unsigned a = main16[x + y * main_stride];
+                unsigned b = ref16[x + y * ref_stride];
+
+                s1  += a;
+                ss  += (uint64_t)a*a;
+                s12 += (uint64_t)a*b;
+            }
+        }
+
+        sums[z][0] = s1;
+        sums[z][1] = ss;
+        sums[z][2] = s12;
+        main16 += 4;
+        ref16 += 4;
+    }
+}
+
+static uint64_t sse_rect(const uint8_t *main, int main_stride,
+                         const uint8_t *ref, int ref_stride,
+                         int x, int y, int w, int h, int is_16bit)
+{
+    uint64_t sse = 0;
+    int i, j;
+
+    for (j = y; j < y + h; j++) {
+        if (is_16bit) {
+            const uint16_t *m = (const uint16_t *)(main + j * main_stride);
+            const uint16_t *r = (const uint16_t *)(ref  + j * ref_stride);
+
+            for (i = x; i < x + w; i++)
+                sse += (uint64_t)pow_2(m[i] - r[i]);
+        } else {
+            const uint8_t *m = main + j * main_stride;
+            const uint8_t *r = ref  + j * ref_stride;
+
+            for (i = x; i < x + w; i++)
+                sse += pow_2(m[i] - r[i]);
+        }
+    }
+
+    return sse;
+}
+
+#define SUM_LEN(w) (((w) >> 2) + 3)
+
+/* Every job owns the rows of 4x4 blocks [start, end) of each plane. */
+static int ref_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MultiMetricContext *s = ctx->priv;
+    AVFrame *ref = arg;
+    int i, z;
+
+    for (i = 0; i < s->nb_components; i++) {
+        const int width  = s->planewidth[i]  >> 2;
+        const int height = s->planeheight[i] >> 2;
+        const int start = (height *  jobnr     ) / nb_jobs;
+        const int end   = (height * (jobnr + 1)) / nb_jobs;
+
+        for (z = start; z < end; z++) {
+            if (s->max > 255)
+                ref_4x4xn_16bit(ref->data[i] + 4 * z * ref->linesize[i],
+                                ref->linesize[i], s->ref_sums[i] + z * width, width);
+            else
+                ref_4x4xn_8bit(ref->data[i] + 4 * z * ref->linesize[i],
+                               ref->linesize[i], s->ref_sums[i] + z * width, width);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * The SSIM of row y combines the block rows y - 1 and y, so every job also
+ * computes the block row just above its first one. The block sums give the
+ * squared error of the owned rows, the pixels outside the full blocks are
+ * added directly, the ones below the last block row by the last job.
+ */
+static int metric_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MultiMetricContext *s = ctx->priv;
+    AVFrame *ref = s->frames[0];
+    const int is_16bit = s->max > 255;
+    int k, i, x, z;
+
+    for (k = 0; k < s->nb_inputs; k++) {
+        AVFrame *main = s->frames[k + 1];
+        uint64_t *sse = s->sse[jobnr * s->nb_inputs + k];
+
+        for (i = 0; i < s->nb_components; i++) {
+            const int width  = s->planewidth[i]  >> 2;
+            const int height = s->planeheight[i] >> 2;
+            const int start = (height *  jobnr     ) / nb_jobs;
+            const int end   = (height * (jobnr + 1)) / nb_jobs;
+            const int main_stride = main->linesize[i];
+            const int ref_stride  = ref->linesize[i];
+            int64_t (*sum0)[3] = s->temp[jobnr];
+            int64_t (*sum1)[3] = sum0 + SUM_LEN(s->planewidth[0]);
+            float *score = s->metrics[k].score[i];
+            uint64_t m2 = 0;
+
+            for (z = FFMAX(start - 1, 0); z < end; z++) {
+                const int64_t (*r0)[2] = s->ref_sums[i] + z * width;
+
+                FFSWAP(void*, sum0, sum1);
+                if (is_16bit)
+                    main_4x4xn_16bit(main->data[i] + 4 * z * main_stride, main_stride,
+                                     ref->data[i] + 4 * z * ref_stride, ref_stride,
+                                     sum0, width);
+                else
+                    main_4x4xn_8bit(main->data[i] + 4 * z * main_stride, main_stride,
+                                    ref->data[i] + 4 * z * ref_stride, ref_stride,
+                                    sum0, width);
+                if (z < start)
+                    continue;
+
+                for (x = 0; x < width; x++)
+                    m2 += sum0[x][1] + r0[x][1] - 2 * sum0[x][2];
+                m2 += sse_rect(main->data[i], main_stride, ref->data[i], ref_stride,
+                               4 * width, 4 * z, s->planewidth[i] - 4 * width, 4, is_16bit);
+
+                if (z > 0) {
+                    const int64_t (*r1)[2] = r0 - width;
+                    float ssim = 0.0;
+
+                    for (x = 0; x < width - 1; x++)
+                        ssim += ssim_end1x(sum0[x][0] + sum0[x + 1][0] + sum1[x][0] + sum1[x + 1][0],
+                                           r0[x][0]   + r0[x + 1][0]   + r1[x][0]   + r1[x + 1][0],
+                                           sum0[x][1] + sum0[x + 1][1] + sum1[x][1] + sum1[x + 1][1] +
+                                           r0[x][1]   + r0[x + 1][1]   + r1[x][1]   + r1[x + 1][1],
+                                           sum0[x][2] + sum0[x + 1][2] + sum1[x][2] + sum1[x + 1][2],
+                                           s->max);
+                    score[z] = ssim;
+                }
+            }
+
+            if (jobnr == nb_jobs - 1)
+                m2 += sse_rect(main->data[i], main_stride, ref->data[i], ref_stride,
+                               0, 4 * height, s->planewidth[i],
+                               s->planeheight[i] - 4 * height, is_16bit);
+            sse[i] = m2;
+        }
+    }
+
+    return 0;
+}
+
+static int do_metrics(FFFrameSync *fs)
+{
+    AVFilterContext *ctx = fs->parent;
+    MultiMetricContext *s = ctx->priv;
+    AVFrame *ref;
+    AVDictionary **metadata;
+    int ret, i, j, k, y;
+
+    if ((ret = ff_framesync_get_frame(fs, 0, &ref, 1)) < 0)
+        return ret;
+    for (k = 0; k < s->nb_inputs; k++) {
+        if ((ret = ff_framesync_get_frame(fs, k + 1, &s->frames[k + 1], 0)) < 0) {
+            av_frame_free(&ref);
+            return ret;
+        }
+    }
+    ref->pts = av_rescale_q(fs->pts, fs->time_base, ctx->outputs[0]->time_base);
+    metadata = &ref->metadata;
+    s->frames[0] = ref;
+
+    s->nb_frames++;
+
+    ctx->internal->execute(ctx, ref_slice, ref, NULL, s->nb_threads);
+    ctx->internal->execute(ctx, metric_slice, NULL, NULL, s->nb_threads);
+
+    for (k = 0; k < s->nb_inputs; k++) {
+        MetricInput *m = &s->metrics[k];
+        float c[4], ssimv = 0.0;
+        double comp_mse[4], mse = 0;
+
+        for (i = 0; i < s->nb_components; i++) {
+            const int width  = s->planewidth[i]  >> 2;
+            const int height = s->planeheight[i] >> 2;
+            float ssim = 0.0;
+            uint64_t m2 = 0;
+
+            for (y = 1; y < height; y++)
+                ssim += m->score[i][y];
+            c[i] = ssim / ((height - 1) * (width - 1));
+            ssimv += s->coefs[i] * c[i];
+            m->ssim[i] += c[i];
+
+            for (j = 0; j < s->nb_threads; j++)
+                m2 += s->sse[j * s->nb_inputs + k][i];
+            comp_mse[i] = m2 / (double)(s->planewidth[i] * s->planeheight[i]);
+            mse += comp_mse[i] * s->planeweight[i];
+            m->mse_comp[i] += comp_mse[i];
+        }
+        m->ssim_total += ssimv;
+        m->mse += mse;
+        m->min_mse = FFMIN(m->min_mse, mse);
+        m->max_mse = FFMAX(m->max_mse, mse);
+
+        for (i = 0; i < s->nb_components; i++) {
+            int cidx = s->is_rgb ? s->rgba_map[i] : i;
+            set_meta(metadata, "lavfi.ssim.%d.%c", k, s->comps[i], c[cidx]);
+        }
+        set_meta(metadata, "lavfi.ssim.%d.All", k, 0, ssimv);
+        set_meta(metadata, "lavfi.ssim.%d.dB", k, 0, ssim_db(ssimv, 1.0));
+        for (i = 0; i < s->nb_components; i++) {
+            int cidx = s->is_rgb ? s->rgba_map[i] : i;
+            set_meta(metadata, "lavfi.psnr.%d.mse.%c", k, av_tolower(s->comps[i]), comp_mse[cidx]);
+            set_meta(metadata, "lavfi.psnr.%d.psnr.%c", k, av_tolower(s->comps[i]),
+                     get_psnr(comp_mse[cidx], 1, s->max));
+        }
+        set_meta(metadata, "lavfi.psnr.%d.mse_avg", k, 0, mse);
+        set_meta(metadata, "lavfi.psnr.%d.psnr_avg", k, 0, get_psnr(mse, 1, s->average_max));
+
+        if (s->stats_file) {
+            fprintf(s->stats_file, "n:%"PRId64" input:%d ", s->nb_frames, k);
+            for (i = 0; i < s->nb_components; i++) {
+                int cidx = s->is_rgb ? s->rgba_map[i] : i;
+                fprintf(s->stats_file, "%c:%f ", s->comps[i], c[cidx]);
+            }
+            fprintf(s->stats_file, "All:%f (%f) ", ssimv, ssim_db(ssimv, 1.0));
+            fprintf(s->stats_file, "mse_avg:%0.2f psnr_avg:%0.2f\n",
+                    mse, get_psnr(mse, 1, s->average_max));
+        }
+    }
+
+    return ff_filter_frame(ctx->outputs[0], ref);
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    MultiMetricContext *s = ctx->priv;
+    int i, ret;
+
+    if (s->stats_file_str) {
+        if (!strcmp(s->stats_file_str, "-")) {
+            s->stats_file = stdout;
+        } else {
+            s->stats_file = fopen(s->stats_file_str, "w");
+            if (!s->stats_file) {
+                int err = AVERROR(errno);
+                char buf[128];
+                av_strerror(err, buf, sizeof(buf));
+                av_log(ctx, AV_LOG_ERROR, "Could not open stats file %s: %s\n",
+                       s->stats_file_str, buf);
+                return err;
+            }
+        }
+    }
+
+    s->frames = av_calloc(s->nb_inputs + 1, sizeof(*s->frames));
+    if (!s->frames)
+        return AVERROR(ENOMEM);
+
+    s->metrics = av_calloc(s->nb_inputs, sizeof(*s->metrics));
+    if (!s->metrics)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_inputs; i++) {
+        s->metrics[i].min_mse = +INFINITY;
+        s->metrics[i].max_mse = -INFINITY;
+    }
+
+    for (i = 0; i <= s->nb_inputs; i++) {
+        AVFilterPad pad = { 0 };
+
+        pad.type = AVMEDIA_TYPE_VIDEO;
+        pad.name = i ? av_asprintf("input%d", i - 1) : av_strdup("reference");
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_insert_inpad(ctx, i, &pad)) < 0) {
+            av_freep(&pad.name);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_GRAY8, AV_PIX_FMT_GRAY9, AV_PIX_FMT_GRAY10,
+        AV_PIX_FMT_GRAY12, AV_PIX_FMT_GRAY16,
+        AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV444P,
+        AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV411P, AV_PIX_FMT_YUV410P,
+        AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUVJ422P,
+        AV_PIX_FMT_YUVJ440P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_GBRP,
+#define PF(suf) AV_PIX_FMT_YUV420##suf,  AV_PIX_FMT_YUV422##suf,  AV_PIX_FMT_YUV444##suf, AV_PIX_FMT_GBR##suf
+        PF(P9), PF(P10), PF(P12), PF(P14), PF(P16),
+        AV_PIX_FMT_NONE
+    };
+
+    AVFilterFormats *fmts_list = ff_make_format_list(pix_fmts);
+    if (!fmts_list)
+        return AVERROR(ENOMEM);
+    return ff_set_common_formats(ctx, fmts_list);
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    MultiMetricContext *s = ctx->priv;
+    AVFilterLink *reflink = ctx->inputs[0];
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(reflink->format);
+    FFFrameSyncIn *in;
+    double average_max = 0;
+    int64_t sum = 0;
+    int i, k, ret;
+
+    for (i = 1; i < ctx->nb_inputs; i++) {
+        if (ctx->inputs[i]->w != reflink->w ||
+            ctx->inputs[i]->h != reflink->h) {
+            av_log(ctx, AV_LOG_ERROR, "Width and height of input videos must be same.\n");
+            return AVERROR(EINVAL);
+        }
+        if (ctx->inputs[i]->format != reflink->format) {
+            av_log(ctx, AV_LOG_ERROR, "Inputs must be of same pixel format.\n");
+            return AVERROR(EINVAL);
+        }
+    }
+
+    s->nb_components = desc->nb_components;
+    s->max = (1 << desc->comp[0].depth) - 1;
+
+    s->is_rgb = ff_fill_rgba_map(s->rgba_map, reflink->format) >= 0;
+    s->comps[0] = s->is_rgb ? 'R' : 'Y';
+    s->comps[1] = s->is_rgb ? 'G' : 'U';
+    s->comps[2] = s->is_rgb ? 'B' : 'V';
+    s->comps[3] = 'A';
+
+    s->planeheight[1] = s->planeheight[2] = AV_CEIL_RSHIFT(reflink->h, desc->log2_chroma_h);
+    s->planeheight[0] = s->planeheight[3] = reflink->h;
+    s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(reflink->w, desc->log2_chroma_w);
+    s->planewidth[0]  = s->planewidth[3]  = reflink->w;
+    for (i = 0; i < s->nb_components; i++)
+        sum += s->planeheight[i] * s->planewidth[i];
+    for (i = 0; i < s->nb_components; i++) {
+        s->planeweight[i] = (double) s->planeheight[i] * s->planewidth[i] / sum;
+        s->coefs[i] = s->planeweight[i];
+        average_max += s->max * s->planeweight[i];
+    }
+    s->average_max = lrint(average_max);
+
+    for (i = 0; i < s->nb_components; i++) {
+        const int width  = s->planewidth[i]  >> 2;
+        const int height = s->planeheight[i] >> 2;
+
+        s->ref_sums[i] = av_mallocz_array(FFMAX(width * height, 1), sizeof(*s->ref_sums[i]));
+        if (!s->ref_sums[i])
+            return AVERROR(ENOMEM);
+        for (k = 0; k < s->nb_inputs; k++) {
+            s->metrics[k].score[i] = av_mallocz_array(FFMAX(height, 1), sizeof(*s->metrics[k].score[i]));
+            if (!s->metrics[k].score[i])
+                return AVERROR(ENOMEM);
+        }
+    }
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->temp = av_mallocz_array(s->nb_threads, sizeof(*s->temp));
+    if (!s->temp)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_threads; i++) {
+        s->temp[i] = av_mallocz_array(2 * SUM_LEN(reflink->w), sizeof(*s->temp[i]));
+        if (!s->temp[i])
+            return AVERROR(ENOMEM);
+    }
+    s->sse = av_mallocz_array(s->nb_threads * s->nb_inputs, sizeof(*s->sse));
+    if (!s->sse)
+        return AVERROR(ENOMEM);
+
+    outlink->w = reflink->w;
+    outlink->h = reflink->h;
+    outlink->time_base = reflink->time_base;
+    outlink->sample_aspect_ratio = reflink->sample_aspect_ratio;
+    outlink->frame_rate = reflink->frame_rate;
+
+    if ((ret = ff_framesync_init(&s->fs, ctx, ctx->nb_inputs)) < 0)
+        return ret;
+
+    in = s->fs.in;
+    s->fs.opaque = s;
+    s->fs.on_event = do_metrics;
+
+    for (i = 0; i < ctx->nb_inputs; i++) {
+        in[i].time_base = ctx->inputs[i]->time_base;
+        in[i].sync   = i ? 1 : 2;
+        in[i].before = EXT_STOP;
+        in[i].after  = i ? EXT_INFINITY : EXT_STOP;
+    }
+
+    return ff_framesync_configure(&s->fs);
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    MultiMetricContext *s = ctx->priv;
+    return ff_framesync_activate(&s->fs);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    MultiMetricContext *s = ctx->priv;
+    int i, k;
+
+    for (k = 0; s->metrics && k < s->nb_inputs; k++) {
+        MetricInput *m = &s->metrics[k];
+
+        if (s->nb_frames > 0) {
+            char buf[256];
+            buf[0] = 0;
+            for (i = 0; i < s->nb_components; i++) {
+                int c = s->is_rgb ? s->rgba_map[i] : i;
+                av_strlcatf(buf, sizeof(buf), " %c:%f (%f)", s->comps[i], m->ssim[c] / s->nb_frames,
+                            ssim_db(m->ssim[c], s->nb_frames));
+            }
+            av_log(ctx, AV_LOG_INFO, "Input %d SSIM%s All:%f (%f)\n", k, buf,
+                   m->ssim_total / s->nb_frames, ssim_db(m->ssim_total, s->nb_frames));
+
+            buf[0] = 0;
+            for (i = 0; i < s->nb_components; i++) {
+                int c = s->is_rgb ? s->rgba_map[i] : i;
+                av_strlcatf(buf, sizeof(buf), " %c:%f", av_tolower(s->comps[i]),
+                            get_psnr(m->mse_comp[c], s->nb_frames, s->max));
+            }
+            av_log(ctx, AV_LOG_INFO, "Input %d PSNR%s average:%f min:%f max:%f\n", k, buf,
+                   get_psnr(m->mse, s->nb_frames, s->average_max),
+                   get_psnr(m->max_mse, 1, s->average_max),
+                   get_psnr(m->min_mse, 1, s->average_max));
+        }
+
+        for (i = 0; i < 4; i++)
+            av_freep(&m->score[i]);
+    }
+
+    ff_framesync_uninit(&s->fs);
+
+    if (s->stats_file && s->stats_file != stdout)
+        fclose(s->stats_file);
+
+    for (i = 0; s->temp && i < s->nb_threads; i++)
+        av_freep(&s->temp[i]);
+    av_freep(&s->temp);
+    for (i = 0; i < 4; i++)
+        av_freep(&s->ref_sums[i]);
+    av_freep(&s->sse);
+    av_freep(&s->metrics);
+    av_freep(&s->frames);
+
+    for (i = 0; i < ctx->nb_inputs; i++)
+        av_freep(&ctx->input_pads[i].name);
+}
+
+static const AVFilterPad multimetric_outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_multimetric = {
+    .name          = "multimetric",
+    .description   = NULL_IF_CONFIG_SMALL("Calculate the SSIM and PSNR of several video streams against one reference."),
+    .priv_size     = sizeof(MultiMetricContext),
+    .priv_class    = &multimetric_class,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .activate      = activate,
+    .outputs       = multimetric_outputs,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
+};
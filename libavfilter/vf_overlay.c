@@ -38,8 +38,13 @@
 #include "internal.h"
 #include "drawutils.h"
 #include "framesync.h"
+#include "overlay.h"
 #include "video.h"
 
+typedef struct ThreadData {
+    AVFrame *dst, *src;
+} ThreadData;
+
 static const char *const var_names[] = {
     "main_w",    "W", ///< width  of the main    video
     "main_h",    "H", ///< height of the main    video
@@ -123,7 +128,9 @@ typedef struct OverlayContext {
 
     AVExpr *x_pexpr, *y_pexpr;
 
-    void (*blend_image)(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y);
+    OverlayDSPContext dsp;
+
+    int (*blend_slice)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
 } OverlayContext;
 
 static av_cold void uninit(AVFilterContext *ctx)
@@ -397,13 +404,64 @@ static int config_output(AVFilterLink *outlink)
 // ((((x) + (y)) << 8) - ((x) + (y)) - (y) * (x)) is a faster version of: 255 * (x + y)
 #define UNPREMULTIPLY_ALPHA(x, y) ((((x) << 16) - ((x) << 9) + (x)) / ((((x) + (y)) << 8) - ((x) + (y)) - (y) * (x)))
 
+static av_always_inline void blend_row_c(uint8_t *d, const uint8_t *s, const uint8_t *a,
+                                         int w, ptrdiff_t alinesize, int hsub, int vsub)
+{
+    int k;
+
+    for (k = 0; k < w; k++) {
+        int alpha_v, alpha_h, alpha;
+
+        // average alpha for color components, improve quality
+        if (hsub && vsub) {
+            alpha = (a[0] + a[alinesize] +
+                     a[1] + a[alinesize+1]) >> 2;
+        } else if (hsub || vsub) {
+            alpha_h = hsub ? (a[0] + a[1]) >> 1 : a[0];
+            alpha_v = vsub ? (a[0] + a[alinesize]) >> 1 : a[0];
+            alpha = (alpha_v + alpha_h) >> 1;
+        } else
+            alpha = a[0];
+        d[k] = FAST_DIV255(d[k] * (255 - alpha) + s[k] * alpha);
+        a += 1 << hsub;
+    }
+}
+
+#define DEFINE_BLEND_ROW(hsub, vsub)                                          \
+static void blend_row_##hsub##vsub##_c(uint8_t *d, const uint8_t *s,          \
+                                       const uint8_t *a, int w,               \
+                                       ptrdiff_t alinesize)                   \
+{                                                                             \
+    blend_row_c(d, s, a, w, alinesize, hsub, vsub);                           \
+}
+
+DEFINE_BLEND_ROW(0, 0)
+DEFINE_BLEND_ROW(0, 1)
+DEFINE_BLEND_ROW(1, 0)
+DEFINE_BLEND_ROW(1, 1)
+
+void ff_overlay_init(OverlayDSPContext *dsp)
+{
+    dsp->blend_row[0][0] = blend_row_00_c;
+    dsp->blend_row[0][1] = blend_row_01_c;
+    dsp->blend_row[1][0] = blend_row_10_c;
+    dsp->blend_row[1][1] = blend_row_11_c;
+
+    if (ARCH_X86)
+        ff_overlay_init_x86(dsp);
+}
+
 /**
  * Blend image in src to destination buffer dst at position (x, y).
+ *
+ * Only the rows in [slice_start, slice_end) of the overlay are processed,
+ * expressed in lines of the (possibly subsampled) plane being blended.
  */
 
 static void blend_image_packed_rgb(AVFilterContext *ctx,
                                    AVFrame *dst, const AVFrame *src,
-                                   int main_has_alpha, int x, int y)
+                                   int main_has_alpha, int x, int y,
+                                   int jobnr, int nb_jobs)
 {
     OverlayContext *s = ctx->priv;
     int i, imax, j, jmax;
@@ -424,11 +482,18 @@ static void blend_image_packed_rgb(AVFilterContext *ctx,
     const int sstep = s->overlay_pix_step[0];
     uint8_t *S, *sp, *d, *dp;
 
-    i = FFMAX(-y, 0);
+    i    = FFMAX(-y, 0);
+    imax = FFMIN(-y + dst_h, src_h);
+    if (imax <= i)
+        return;
+    jmax = i + (imax - i) * (jobnr + 1) / nb_jobs;
+    i    = i + (imax - i) *  jobnr      / nb_jobs;
+    imax = jmax;
+
     sp = src->data[0] + i     * src->linesize[0];
     dp = dst->data[0] + (y+i) * dst->linesize[0];
 
-    for (imax = FFMIN(-y + dst_h, src_h); i < imax; i++) {
+    for (; i < imax; i++) {
         j = FFMAX(-x, 0);
         S = sp + j     * sstep;
         d = dp + (x+j) * dstep;
@@ -487,8 +552,10 @@ static av_always_inline void blend_plane(AVFilterContext *ctx,
                                          int main_has_alpha,
                                          int dst_plane,
                                          int dst_offset,
-                                         int dst_step)
+                                         int dst_step,
+                                         int slice_start, int slice_end)
 {
+    OverlayContext *octx = ctx->priv;
     int src_wp = AV_CEIL_RSHIFT(src_w, hsub);
     int src_hp = AV_CEIL_RSHIFT(src_h, vsub);
     int dst_wp = AV_CEIL_RSHIFT(dst_w, hsub);
@@ -498,7 +565,7 @@ static av_always_inline void blend_plane(AVFilterContext *ctx,
     uint8_t *s, *sp, *d, *dp, *dap, *a, *da, *ap;
     int jmax, j, k, kmax;
 
-    j = FFMAX(-yp, 0);
+    j = FFMAX(FFMAX(-yp, 0), slice_start);
     sp = src->data[i] + j         * src->linesize[i];
     dp = dst->data[dst_plane]
                       + (yp+j)    * dst->linesize[dst_plane]
@@ -506,14 +573,30 @@ static av_always_inline void blend_plane(AVFilterContext *ctx,
     ap = src->data[3] + (j<<vsub) * src->linesize[3];
     dap = dst->data[3] + ((yp+j) << vsub) * dst->linesize[3];
 
-    for (jmax = FFMIN(-yp + dst_hp, src_hp); j < jmax; j++) {
+    for (jmax = FFMIN3(-yp + dst_hp, src_hp, slice_end); j < jmax; j++) {
         k = FFMAX(-xp, 0);
         d = dp + (xp+k) * dst_step;
         s = sp + k;
         a = ap + (k<<hsub);
         da = dap + ((xp+k) << hsub);
+        kmax = FFMIN(-xp + dst_wp, src_wp);
+
+        // the bulk of the row, where the averaged alpha needs no clipping,
+        // goes through the dsp function; edges are handled below
+        if (!main_has_alpha && dst_step == 1 && (!vsub || j+1 < src_hp)) {
+            int w = (kmax - k - (hsub && kmax == src_wp)) & ~15;
+
+            if (w > 0) {
+                octx->dsp.blend_row[hsub][vsub](d, s, a, w, src->linesize[3]);
+                k  += w;
+                d  += w;
+                s  += w;
+                a  += w << hsub;
+                da += w << hsub;
+            }
+        }
 
-        for (kmax = FFMIN(-xp + dst_wp, src_wp); k < kmax; k++) {
+        for (; k < kmax; k++) {
             int alpha_v, alpha_h, alpha;
 
             // average alpha for color components, improve quality
@@ -562,17 +645,18 @@ static av_always_inline void blend_plane(AVFilterContext *ctx,
 static inline void alpha_composite(const AVFrame *src, const AVFrame *dst,
                                    int src_w, int src_h,
                                    int dst_w, int dst_h,
-                                   int x, int y)
+                                   int x, int y,
+                                   int slice_start, int slice_end)
 {
     uint8_t alpha;          ///< the amount of overlay to blend on to main
     uint8_t *s, *sa, *d, *da;
     int i, imax, j, jmax;
 
-    i = FFMAX(-y, 0);
+    i = FFMAX(FFMAX(-y, 0), slice_start);
     sa = src->data[3] + i     * src->linesize[3];
     da = dst->data[3] + (y+i) * dst->linesize[3];
 
-    for (imax = FFMIN(-y + dst_h, src_h); i < imax; i++) {
+    for (imax = FFMIN3(-y + dst_h, src_h, slice_end); i < imax; i++) {
         j = FFMAX(-x, 0);
         s = sa + j;
         d = da + x+j;
@@ -601,101 +685,107 @@ static inline void alpha_composite(const AVFrame *src, const AVFrame *dst,
     }
 }
 
-static av_always_inline void blend_image_yuv(AVFilterContext *ctx,
-                                             AVFrame *dst, const AVFrame *src,
-                                             int hsub, int vsub,
-                                             int main_has_alpha,
-                                             int x, int y)
-{
-    OverlayContext *s = ctx->priv;
-    const int src_w = src->width;
-    const int src_h = src->height;
-    const int dst_w = dst->width;
-    const int dst_h = dst->height;
-
-    blend_plane(ctx, dst, src, src_w, src_h, dst_w, dst_h, 0, 0,       0, x, y, main_has_alpha,
-                s->main_desc->comp[0].plane, s->main_desc->comp[0].offset, s->main_desc->comp[0].step);
-    blend_plane(ctx, dst, src, src_w, src_h, dst_w, dst_h, 1, hsub, vsub, x, y, main_has_alpha,
-                s->main_desc->comp[1].plane, s->main_desc->comp[1].offset, s->main_desc->comp[1].step);
-    blend_plane(ctx, dst, src, src_w, src_h, dst_w, dst_h, 2, hsub, vsub, x, y, main_has_alpha,
-                s->main_desc->comp[2].plane, s->main_desc->comp[2].offset, s->main_desc->comp[2].step);
-
-    if (main_has_alpha)
-        alpha_composite(src, dst, src_w, src_h, dst_w, dst_h, x, y);
-}
-
-static av_always_inline void blend_image_planar_rgb(AVFilterContext *ctx,
-                                                    AVFrame *dst, const AVFrame *src,
-                                                    int hsub, int vsub,
-                                                    int main_has_alpha,
-                                                    int x, int y)
+static av_always_inline void blend_image_planar(AVFilterContext *ctx,
+                                                AVFrame *dst, const AVFrame *src,
+                                                int hsub, int vsub,
+                                                int main_has_alpha,
+                                                int x, int y,
+                                                const int comp[3],
+                                                int jobnr, int nb_jobs)
 {
     OverlayContext *s = ctx->priv;
+    const AVComponentDescriptor *c = s->main_desc->comp;
     const int src_w = src->width;
     const int src_h = src->height;
     const int dst_w = dst->width;
     const int dst_h = dst->height;
+    const int yp = y >> vsub;
+    const int i    = FFMAX(-y, 0);
+    const int imax = FFMIN(-y + dst_h, src_h);
+    const int j    = FFMAX(-yp, 0);
+    const int jmax = FFMIN(-yp + AV_CEIL_RSHIFT(dst_h, vsub), AV_CEIL_RSHIFT(src_h, vsub));
+    int start, end, slice_start, slice_end;
+
+    if (imax <= i && jmax <= j)
+        return;
+
+    /* Slices are cut in units of one main chroma line, i.e. 1 << vsub main
+     * luma lines, covering both the luma and the chroma lines touched by the
+     * overlay. The main alpha lines read for a chroma line are then always
+     * updated by the same job, after it has blended that chroma line. */
+    start = INT_MAX;
+    end   = INT_MIN;
+    if (i < imax) {
+        start = (y + i) >> vsub;
+        end   = AV_CEIL_RSHIFT(y + imax, vsub);
+    }
+    if (j < jmax) {
+        start = FFMIN(start, yp + j);
+        end   = FFMAX(end,   yp + jmax);
+    }
+    slice_start = start + (end - start) *  jobnr      / nb_jobs;
+    slice_end   = start + (end - start) * (jobnr + 1) / nb_jobs;
 
     blend_plane(ctx, dst, src, src_w, src_h, dst_w, dst_h, 0, 0,       0, x, y, main_has_alpha,
-                s->main_desc->comp[1].plane, s->main_desc->comp[1].offset, s->main_desc->comp[1].step);
+                c[comp[0]].plane, c[comp[0]].offset, c[comp[0]].step,
+                (slice_start << vsub) - y, (slice_end << vsub) - y);
     blend_plane(ctx, dst, src, src_w, src_h, dst_w, dst_h, 1, hsub, vsub, x, y, main_has_alpha,
-                s->main_desc->comp[2].plane, s->main_desc->comp[2].offset, s->main_desc->comp[2].step);
+                c[comp[1]].plane, c[comp[1]].offset, c[comp[1]].step,
+                slice_start - yp, slice_end - yp);
     blend_plane(ctx, dst, src, src_w, src_h, dst_w, dst_h, 2, hsub, vsub, x, y, main_has_alpha,
-                s->main_desc->comp[0].plane, s->main_desc->comp[0].offset, s->main_desc->comp[0].step);
+                c[comp[2]].plane, c[comp[2]].offset, c[comp[2]].step,
+                slice_start - yp, slice_end - yp);
 
     if (main_has_alpha)
-        alpha_composite(src, dst, src_w, src_h, dst_w, dst_h, x, y);
-}
-
-static void blend_image_yuv420(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_yuv(ctx, dst, src, 1, 1, 0, x, y);
-}
-
-static void blend_image_yuva420(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_yuv(ctx, dst, src, 1, 1, 1, x, y);
-}
-
-static void blend_image_yuv422(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_yuv(ctx, dst, src, 1, 0, 0, x, y);
-}
-
-static void blend_image_yuva422(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_yuv(ctx, dst, src, 1, 0, 1, x, y);
+        alpha_composite(src, dst, src_w, src_h, dst_w, dst_h, x, y,
+                        (slice_start << vsub) - y, (slice_end << vsub) - y);
 }
 
-static void blend_image_yuv444(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
+static av_always_inline void blend_image_yuv(AVFilterContext *ctx,
+                                             AVFrame *dst, const AVFrame *src,
+                                             int hsub, int vsub,
+                                             int main_has_alpha,
+                                             int x, int y,
+                                             int jobnr, int nb_jobs)
 {
-    blend_image_yuv(ctx, dst, src, 0, 0, 0, x, y);
-}
+    static const int comp[3] = { 0, 1, 2 };
 
-static void blend_image_yuva444(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_yuv(ctx, dst, src, 0, 0, 1, x, y);
+    blend_image_planar(ctx, dst, src, hsub, vsub, main_has_alpha, x, y, comp, jobnr, nb_jobs);
 }
 
-static void blend_image_gbrp(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
+static av_always_inline void blend_image_planar_rgb(AVFilterContext *ctx,
+                                                    AVFrame *dst, const AVFrame *src,
+                                                    int hsub, int vsub,
+                                                    int main_has_alpha,
+                                                    int x, int y,
+                                                    int jobnr, int nb_jobs)
 {
-    blend_image_planar_rgb(ctx, dst, src, 0, 0, 0, x, y);
-}
+    static const int comp[3] = { 1, 2, 0 };
 
-static void blend_image_gbrap(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_planar_rgb(ctx, dst, src, 0, 0, 1, x, y);
+    blend_image_planar(ctx, dst, src, hsub, vsub, main_has_alpha, x, y, comp, jobnr, nb_jobs);
 }
 
-static void blend_image_rgb(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_packed_rgb(ctx, dst, src, 0, x, y);
+#define DEFINE_BLEND_SLICE(name, blend, ...)                                  \
+static int blend_slice_##name(AVFilterContext *ctx, void *arg,                \
+                              int jobnr, int nb_jobs)                         \
+{                                                                             \
+    OverlayContext *s = ctx->priv;                                            \
+    ThreadData *td = arg;                                                     \
+                                                                              \
+    blend(ctx, td->dst, td->src, __VA_ARGS__, s->x, s->y, jobnr, nb_jobs);    \
+    return 0;                                                                 \
 }
 
-static void blend_image_rgba(AVFilterContext *ctx, AVFrame *dst, const AVFrame *src, int x, int y)
-{
-    blend_image_packed_rgb(ctx, dst, src, 1, x, y);
-}
+DEFINE_BLEND_SLICE(yuv420,  blend_image_yuv,        1, 1, 0)
+DEFINE_BLEND_SLICE(yuva420, blend_image_yuv,        1, 1, 1)
+DEFINE_BLEND_SLICE(yuv422,  blend_image_yuv,        1, 0, 0)
+DEFINE_BLEND_SLICE(yuva422, blend_image_yuv,        1, 0, 1)
+DEFINE_BLEND_SLICE(yuv444,  blend_image_yuv,        0, 0, 0)
+DEFINE_BLEND_SLICE(yuva444, blend_image_yuv,        0, 0, 1)
+DEFINE_BLEND_SLICE(gbrp,    blend_image_planar_rgb, 0, 0, 0)
+DEFINE_BLEND_SLICE(gbrap,   blend_image_planar_rgb, 0, 0, 1)
+DEFINE_BLEND_SLICE(rgb,     blend_image_packed_rgb, 0)
+DEFINE_BLEND_SLICE(rgba,    blend_image_packed_rgb, 1)
 
 static int config_input_main(AVFilterLink *inlink)
 {
@@ -714,39 +804,39 @@ static int config_input_main(AVFilterLink *inlink)
     s->main_has_alpha = ff_fmt_is_in(inlink->format, alpha_pix_fmts);
     switch (s->format) {
     case OVERLAY_FORMAT_YUV420:
-        s->blend_image = s->main_has_alpha ? blend_image_yuva420 : blend_image_yuv420;
+        s->blend_slice = s->main_has_alpha ? blend_slice_yuva420 : blend_slice_yuv420;
         break;
     case OVERLAY_FORMAT_YUV422:
-        s->blend_image = s->main_has_alpha ? blend_image_yuva422 : blend_image_yuv422;
+        s->blend_slice = s->main_has_alpha ? blend_slice_yuva422 : blend_slice_yuv422;
         break;
     case OVERLAY_FORMAT_YUV444:
-        s->blend_image = s->main_has_alpha ? blend_image_yuva444 : blend_image_yuv444;
+        s->blend_slice = s->main_has_alpha ? blend_slice_yuva444 : blend_slice_yuv444;
         break;
     case OVERLAY_FORMAT_RGB:
-        s->blend_image = s->main_has_alpha ? blend_image_rgba : blend_image_rgb;
+        s->blend_slice = s->main_has_alpha ? blend_slice_rgba : blend_slice_rgb;
         break;
     case OVERLAY_FORMAT_GBRP:
-        s->blend_image = s->main_has_alpha ? blend_image_gbrap : blend_image_gbrp;
+        s->blend_slice = s->main_has_alpha ? blend_slice_gbrap : blend_slice_gbrp;
         break;
     case OVERLAY_FORMAT_AUTO:
         switch (inlink->format) {
         case AV_PIX_FMT_YUVA420P:
-            s->blend_image = blend_image_yuva420;
+            s->blend_slice = blend_slice_yuva420;
             break;
         case AV_PIX_FMT_YUVA422P:
-            s->blend_image = blend_image_yuva422;
+            s->blend_slice = blend_slice_yuva422;
             break;
         case AV_PIX_FMT_YUVA444P:
-            s->blend_image = blend_image_yuva444;
+            s->blend_slice = blend_slice_yuva444;
             break;
         case AV_PIX_FMT_ARGB:
         case AV_PIX_FMT_RGBA:
         case AV_PIX_FMT_BGRA:
         case AV_PIX_FMT_ABGR:
-            s->blend_image = blend_image_rgba;
+            s->blend_slice = blend_slice_rgba;
             break;
         case AV_PIX_FMT_GBRAP:
-            s->blend_image = blend_image_gbrap;
+            s->blend_slice = blend_slice_gbrap;
             break;
         default:
             av_assert0(0);
@@ -792,8 +882,14 @@ static int do_blend(FFFrameSync *fs)
     }
 
     if (s->x < mainpic->width  && s->x + second->width  >= 0 ||
-        s->y < mainpic->height && s->y + second->height >= 0)
-        s->blend_image(ctx, mainpic, second, s->x, s->y);
+        s->y < mainpic->height && s->y + second->height >= 0) {
+        ThreadData td;
+
+        td.dst = mainpic;
+        td.src = second;
+        ctx->internal->execute(ctx, s->blend_slice, &td, NULL,
+                               FFMIN(second->height, ff_filter_get_nb_threads(ctx)));
+    }
     return ff_filter_frame(ctx->outputs[0], mainpic);
 }
 
@@ -802,6 +898,7 @@ static av_cold int init(AVFilterContext *ctx)
     OverlayContext *s = ctx->priv;
 
     s->fs.on_event = do_blend;
+    ff_overlay_init(&s->dsp);
     return 0;
 }
 
@@ -876,5 +973,6 @@ AVFilter ff_vf_overlay = {
     .process_command = process_command,
     .inputs        = avfilter_vf_overlay_inputs,
     .outputs       = avfilter_vf_overlay_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL |
+                     AVFILTER_FLAG_SLICE_THREADS,
 };
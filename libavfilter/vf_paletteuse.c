@@ -65,6 +65,11 @@ struct color_node {
 #define NBITS 5
 #define CACHE_SIZE (1<<(3*NBITS))
 
+#define LUT_BITS 5
+#define LUT_SHIFT (8-LUT_BITS)
+#define LUT_SIZE (1<<(3*LUT_BITS))
+#define LUT_INDEX(r, g, b) ((r)>>LUT_SHIFT<<(2*LUT_BITS) | (g)>>LUT_SHIFT<<LUT_BITS | (b)>>LUT_SHIFT)
+
 struct cached_color {
     uint32_t color;
     uint8_t pal_entry;
@@ -84,6 +89,7 @@ typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
     struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    int16_t lut[LUT_SIZE];                  /* inverse colormap of color cells, -1 if more than one entry can be the nearest */
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int palette_loaded;
@@ -327,6 +333,7 @@ end:
  */
 static av_always_inline int color_get(struct cache_node *cache, uint32_t color,
                                       uint8_t r, uint8_t g, uint8_t b,
+                                      const int16_t *lut,
                                       const struct color_node *map,
                                       const uint32_t *palette,
                                       const enum color_search_method search_method)
@@ -340,6 +347,9 @@ static av_always_inline int color_get(struct cache_node *cache, uint32_t color,
     struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
+    if (lut[LUT_INDEX(r, g, b)] >= 0)
+        return lut[LUT_INDEX(r, g, b)];
+
     for (i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color)
@@ -355,8 +365,26 @@ static av_always_inline int color_get(struct cache_node *cache, uint32_t color,
     return e->pal_entry;
 }
 
+/**
+ * Same as color_get() but without the cache, so that it can be used from
+ * several threads at once.
+ */
+static av_always_inline int color_get_nocache(uint8_t r, uint8_t g, uint8_t b,
+                                              const int16_t *lut,
+                                              const struct color_node *map,
+                                              const uint32_t *palette,
+                                              const enum color_search_method search_method)
+{
+    const uint8_t rgb[] = {r, g, b};
+
+    if (lut[LUT_INDEX(r, g, b)] >= 0)
+        return lut[LUT_INDEX(r, g, b)];
+    return COLORMAP_NEAREST(search_method, palette, map, rgb);
+}
+
 static av_always_inline int get_dst_color_err(struct cache_node *cache,
-                                              uint32_t c, const struct color_node *map,
+                                              uint32_t c, const int16_t *lut,
+                                              const struct color_node *map,
                                               const uint32_t *palette,
                                               int *er, int *eg, int *eb,
                                               const enum color_search_method search_method)
@@ -364,7 +392,7 @@ static av_always_inline int get_dst_color_err(struct cache_node *cache,
     const uint8_t r = c >> 16 & 0xff;
     const uint8_t g = c >>  8 & 0xff;
     const uint8_t b = c       & 0xff;
-    const int dstx = color_get(cache, c, r, g, b, map, palette, search_method);
+    const int dstx = color_get(cache, c, r, g, b, lut, map, palette, search_method);
     const uint32_t dstc = palette[dstx];
     *er = r - (dstc >> 16 & 0xff);
     *eg = g - (dstc >>  8 & 0xff);
@@ -380,6 +408,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
     int x, y;
     const struct color_node *map = s->map;
     struct cache_node *cache = s->cache;
+    const int16_t *lut = s->lut;
     const uint32_t *palette = s->palette;
     const int src_linesize = in ->linesize[0] >> 2;
     const int dst_linesize = out->linesize[0];
@@ -401,16 +430,13 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = av_clip_uint8(r8 + d);
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
-                const uint32_t c = r<<16 | g<<8 | b;
-                const int color = color_get(cache, c, r, g, b, map, palette, search_method);
+                const int color = color_get_nocache(r, g, b, lut, map, palette, search_method);
 
-                if (color < 0)
-                    return color;
                 dst[x] = color;
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(cache, src[x], map, palette, &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(cache, src[x], lut, map, palette, &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -422,7 +448,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(cache, src[x], map, palette, &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(cache, src[x], lut, map, palette, &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -436,7 +462,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(cache, src[x], map, palette, &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(cache, src[x], lut, map, palette, &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -455,7 +481,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(cache, src[x], map, palette, &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(cache, src[x], lut, map, palette, &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -469,10 +495,8 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = src[x] >> 16 & 0xff;
                 const uint8_t g = src[x] >>  8 & 0xff;
                 const uint8_t b = src[x]       & 0xff;
-                const int color = color_get(cache, src[x] & 0xffffff, r, g, b, map, palette, search_method);
+                const int color = color_get_nocache(r, g, b, lut, map, palette, search_method);
 
-                if (color < 0)
-                    return color;
                 dst[x] = color;
             }
         }
@@ -857,6 +881,22 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x, y, w, h;
+} ThreadData;
+
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = td->y + (td->h *  jobnr     ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr + 1)) / nb_jobs;
+
+    return s->set_frame(s, td->out, td->in, td->x, slice_start,
+                        td->w, slice_end - slice_start);
+}
+
 static AVFrame *apply_palette(AVFilterLink *inlink, AVFrame *in)
 {
     int x, y, w, h;
@@ -887,7 +927,12 @@ static AVFrame *apply_palette(AVFilterLink *inlink, AVFrame *in)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    if (s->set_frame(s, out, in, x, y, w, h) < 0) {
+    if (s->dither == DITHERING_NONE || s->dither == DITHERING_BAYER) {
+        /* no error diffusion and no cache: rows are independent */
+        ThreadData td = { .in = in, .out = out, .x = x, .y = y, .w = w, .h = h };
+        ctx->internal->execute(ctx, set_frame_slice, &td, NULL,
+                               FFMIN(h, ff_filter_get_nb_threads(ctx)));
+    } else if (s->set_frame(s, out, in, x, y, w, h) < 0) {
         av_frame_free(&out);
         return NULL;
     }
@@ -935,6 +980,71 @@ static int config_input_palette(AVFilterLink *inlink)
     return 0;
 }
 
+/**
+ * Fill a slice of the inverse colormap. A cell only gets a palette entry if
+ * no other opaque entry can be closer to any of the colors it contains;
+ * otherwise it is marked with -1 and the regular search is used.
+ */
+static int build_lut_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const int cell_size = 1 << LUT_SHIFT;
+    const int slice_start = ((1 << LUT_BITS) *  jobnr     ) / nb_jobs;
+    const int slice_end   = ((1 << LUT_BITS) * (jobnr + 1)) / nb_jobs;
+    uint8_t pal[AVPALETTE_COUNT][3];
+    int ids[AVPALETTE_COUNT];
+    int i, c, r, g, b, nb_entries = 0;
+
+    for (i = 0; i < AVPALETTE_COUNT; i++) {
+        const uint32_t color = s->palette[i];
+
+        if ((color & 0xff000000) != 0xff000000)
+            continue;
+        pal[nb_entries][0] = color >> 16 & 0xff;
+        pal[nb_entries][1] = color >>  8 & 0xff;
+        pal[nb_entries][2] = color       & 0xff;
+        ids[nb_entries++] = i;
+    }
+
+    for (r = slice_start; r < slice_end; r++) {
+        for (g = 0; g < 1 << LUT_BITS; g++) {
+            for (b = 0; b < 1 << LUT_BITS; b++) {
+                const int lo[] = { r << LUT_SHIFT, g << LUT_SHIFT, b << LUT_SHIFT };
+                int best_id = -1, best_dist = INT_MAX, nb_candidates = 0;
+
+                /* smallest distance to the farthest corner of the cell */
+                for (i = 0; i < nb_entries; i++) {
+                    int d = 0;
+                    for (c = 0; c < 3; c++) {
+                        const int dc = FFMAX(FFABS(pal[i][c] - lo[c]),
+                                             FFABS(pal[i][c] - lo[c] - cell_size + 1));
+                        d += dc * dc;
+                    }
+                    if (d < best_dist) {
+                        best_dist = d;
+                        best_id   = ids[i];
+                    }
+                }
+
+                /* count the entries that may be the nearest to some color of the cell */
+                for (i = 0; i < nb_entries && nb_candidates < 2; i++) {
+                    int d = 0;
+                    for (c = 0; c < 3; c++) {
+                        const int dc = pal[i][c] < lo[c]                 ? lo[c] - pal[i][c]
+                                     : pal[i][c] > lo[c] + cell_size - 1 ? pal[i][c] - lo[c] - cell_size + 1
+                                     : 0;
+                        d += dc * dc;
+                    }
+                    nb_candidates += d <= best_dist;
+                }
+
+                s->lut[r << (2*LUT_BITS) | g << LUT_BITS | b] = nb_candidates == 1 ? best_id : -1;
+            }
+        }
+    }
+    return 0;
+}
+
 static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
 {
     int i, x, y;
@@ -980,6 +1090,8 @@ static int load_apply_palette(FFFrameSync *fs)
     }
     if (!s->palette_loaded) {
         load_palette(s, second);
+        ctx->internal->execute(ctx, build_lut_slice, NULL, NULL,
+                               FFMIN(1 << LUT_BITS, ff_filter_get_nb_threads(ctx)));
     }
     out = apply_palette(inlink, main);
     return ff_filter_frame(ctx->outputs[0], out);
@@ -1099,4 +1211,5 @@ AVFilter ff_vf_paletteuse = {
     .inputs        = paletteuse_inputs,
     .outputs       = paletteuse_outputs,
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,281 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * video scene change detection filter
+ *
+ * The score is built like the scene variable of the select filter, from
+ * the mean absolute frame difference and its change, but that difference
+ * is taken between the 4x4 block averages of the luma plane, so the values
+ * differ from those of select.
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/timestamp.h"
+#include "avfilter.h"
+#include "formats.h"
+#include "internal.h"
+#include "video.h"
+
+typedef struct SCDetContext {
+    const AVClass *class;
+
+    double threshold;
+    int sc_pass;
+    char *stats_file_str;
+    FILE *stats_file;
+
+    int bw, bh;                 ///< dimensions of the reduced luma plane
+    uint16_t *cur, *prev;       ///< 4x4 block sums of the current and previous frame
+    int has_prev;
+    uint64_t *sad;              ///< per-job sum of absolute differences
+    int nb_threads;
+    double prev_mafd;
+    int64_t nb_frames;
+} SCDetContext;
+
+#define OFFSET(x) offsetof(SCDetContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption scdet_options[] = {
+    { "threshold",  "set scene change detect threshold",        OFFSET(threshold),      AV_OPT_TYPE_DOUBLE, {.dbl = 10.},  0,  100., FLAGS },
+    { "t",          "set scene change detect threshold",        OFFSET(threshold),      AV_OPT_TYPE_DOUBLE, {.dbl = 10.},  0,  100., FLAGS },
+    { "sc_pass",    "only pass scene change frames",            OFFSET(sc_pass),        AV_OPT_TYPE_BOOL,   {.i64 = 0},    0,     1, FLAGS },
+    { "s",          "only pass scene change frames",            OFFSET(sc_pass),        AV_OPT_TYPE_BOOL,   {.i64 = 0},    0,     1, FLAGS },
+    { "stats_file", "set file where to store per-frame scores", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str = NULL}, 0,     0, FLAGS },
+    { "f",          "set file where to store per-frame scores", OFFSET(stats_file_str), AV_OPT_TYPE_STRING, {.str = NULL}, 0,     0, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(scdet);
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    SCDetContext *s = ctx->priv;
+
+    if (s->stats_file_str) {
+        if (!strcmp(s->stats_file_str, "-")) {
+            s->stats_file = stdout;
+        } else {
+            s->stats_file = fopen(s->stats_file_str, "w");
+            if (!s->stats_file) {
+                int err = AVERROR(errno);
+                char buf[128];
+                av_strerror(err, buf, sizeof(buf));
+                av_log(ctx, AV_LOG_ERROR, "Could not open stats file %s: %s\n",
+                       s->stats_file_str, buf);
+                return err;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    static const enum AVPixelFormat pix_fmts[] = {
+        AV_PIX_FMT_GRAY8,
+        AV_PIX_FMT_YUV410P, AV_PIX_FMT_YUV411P,
+        AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P,
+        AV_PIX_FMT_YUV440P, AV_PIX_FMT_YUV444P,
+        AV_PIX_FMT_YUVJ411P, AV_PIX_FMT_YUVJ420P,
+        AV_PIX_FMT_YUVJ422P, AV_PIX_FMT_YUVJ444P,
+        AV_PIX_FMT_YUVJ440P,
+        AV_PIX_FMT_YUVA420P, AV_PIX_FMT_YUVA422P, AV_PIX_FMT_YUVA444P,
+        AV_PIX_FMT_NV12, AV_PIX_FMT_NV21,
+        AV_PIX_FMT_NONE
+    };
+    AVFilterFormats *fmts_list = ff_make_format_list(pix_fmts);
+    if (!fmts_list)
+        return AVERROR(ENOMEM);
+    return ff_set_common_formats(ctx, fmts_list);
+}
+
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    SCDetContext *s = ctx->priv;
+
+    s->bw = inlink->w / 4;
+    s->bh = inlink->h / 4;
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+
+    av_freep(&s->cur);
+    av_freep(&s->prev);
+    av_freep(&s->sad);
+    s->cur  = av_malloc_array(FFMAX(s->bw * s->bh, 1), sizeof(*s->cur));
+    s->prev = av_malloc_array(FFMAX(s->bw * s->bh, 1), sizeof(*s->prev));
+    s->sad  = av_calloc(s->nb_threads, sizeof(*s->sad));
+    if (!s->cur || !s->prev || !s->sad)
+        return AVERROR(ENOMEM);
+    s->has_prev = 0;
+
+    return 0;
+}
+
+/**
+ * Reduce a range of rows of the luma plane to 4x4 block sums and add up
+ * their absolute difference to the previous frame.
+ */
+static int scdet_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SCDetContext *s = ctx->priv;
+    AVFrame *in = arg;
+    const int linesize = in->linesize[0];
+    const int slice_start = (s->bh * jobnr) / nb_jobs;
+    const int slice_end = (s->bh * (jobnr+1)) / nb_jobs;
+    uint64_t sad = 0;
+    int x, y;
+
+    for (y = slice_start; y < slice_end; y++) {
+        const uint8_t *src = in->data[0] + 4 * y * linesize;
+        uint16_t *cur = s->cur + y * s->bw;
+        const uint16_t *prev = s->prev + y * s->bw;
+        unsigned line_sad = 0;
+
+        for (x = 0; x < s->bw; x++) {
+            const uint8_t *p = src + 4 * x;
+
+            cur[x] = p[0]            + p[1]              + p[2]              + p[3]              +
+                     p[linesize]     + p[linesize + 1]   + p[linesize + 2]   + p[linesize + 3]   +
+                     p[2 * linesize] + p[2 * linesize+1] + p[2 * linesize+2] + p[2 * linesize+3] +
+                     p[3 * linesize] + p[3 * linesize+1] + p[3 * linesize+2] + p[3 * linesize+3];
+        }
+
+        if (s->has_prev) {
+            for (x = 0; x < s->bw; x++)
+                line_sad += FFABS(cur[x] - prev[x]);
+            sad += line_sad;
+        }
+    }
+
+    s->sad[jobnr] = sad;
+    return 0;
+}
+
+static double get_scene_score(AVFilterContext *ctx, AVFrame *in, double *mafd)
+{
+    SCDetContext *s = ctx->priv;
+    const int nb_jobs = FFMAX(FFMIN(s->bh, s->nb_threads), 1);
+    uint64_t sad = 0;
+    double ret = 0, diff;
+    int i;
+
+    ctx->internal->execute(ctx, scdet_slice, in, NULL, nb_jobs);
+
+    *mafd = 0;
+    if (s->has_prev) {
+        for (i = 0; i < nb_jobs; i++)
+            sad += s->sad[i];
+        /* block sums are 16 times the mean of their pixels */
+        *mafd = s->bw && s->bh ? (double)sad / (16. * s->bw * s->bh) : 0;
+        diff = fabs(*mafd - s->prev_mafd);
+        ret  = av_clipd(FFMIN(*mafd, diff), 0, 100.);
+        s->prev_mafd = *mafd;
+    }
+    FFSWAP(uint16_t *, s->cur, s->prev);
+    s->has_prev = 1;
+
+    return ret;
+}
+
+static void set_meta(AVDictionary **metadata, const char *key, double d)
+{
+    char value[128];
+    snprintf(value, sizeof(value), "%0.3f", d);
+    av_dict_set(metadata, key, value, 0);
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *in)
+{
+    AVFilterContext *ctx = inlink->dst;
+    SCDetContext *s = ctx->priv;
+    double mafd, score;
+    int scene_change;
+
+    score = get_scene_score(ctx, in, &mafd);
+    scene_change = s->nb_frames > 0 && score >= s->threshold;
+    s->nb_frames++;
+
+    set_meta(&in->metadata, "lavfi.scd.mafd", mafd);
+    set_meta(&in->metadata, "lavfi.scd.score", score);
+    if (scene_change)
+        av_dict_set(&in->metadata, "lavfi.scd.time",
+                    av_ts2timestr(in->pts, &inlink->time_base), 0);
+
+    if (s->stats_file) {
+        fprintf(s->stats_file, "n:%"PRId64" pts:%s pts_time:%s mafd:%f score:%f scene_change:%d\n",
+                s->nb_frames - 1, av_ts2str(in->pts),
+                av_ts2timestr(in->pts, &inlink->time_base),
+                mafd, score, scene_change);
+    }
+
+    if (s->sc_pass && !scene_change) {
+        av_frame_free(&in);
+        return 0;
+    }
+
+    return ff_filter_frame(ctx->outputs[0], in);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    SCDetContext *s = ctx->priv;
+
+    if (s->stats_file && s->stats_file != stdout)
+        fclose(s->stats_file);
+
+    av_freep(&s->cur);
+    av_freep(&s->prev);
+    av_freep(&s->sad);
+}
+
+static const AVFilterPad scdet_inputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .filter_frame = filter_frame,
+        .config_props = config_input,
+    },
+    { NULL }
+};
+
+static const AVFilterPad scdet_outputs[] = {
+    {
+        .name = "default",
+        .type = AVMEDIA_TYPE_VIDEO,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_scdet = {
+    .name          = "scdet",
+    .description   = NULL_IF_CONFIG_SMALL("Detect video scene change."),
+    .priv_size     = sizeof(SCDetContext),
+    .priv_class    = &scdet_class,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .inputs        = scdet_inputs,
+    .outputs       = scdet_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
+};
@@ -92,6 +92,7 @@ static int config_input(AVFilterLink *inlink)
     AVFilterContext *ctx = inlink->dst;
     SignatureContext *sic = ctx->priv;
     StreamContext *sc = &(sic->streamcontexts[FF_INLINK_IDX(inlink)]);
+    int i;
 
     sc->time_base = inlink->time_base;
     /* test for overflow */
@@ -101,6 +102,11 @@ static int config_input(AVFilterLink *inlink)
     }
     sc->w = inlink->w;
     sc->h = inlink->h;
+    /* pixel x belongs to block column (x*32)/w, so block column i starts at ceil(i*w/32) */
+    for (i = 0; i <= 32; i++) {
+        sc->xbin[i] = ((int64_t)i * inlink->w + 31) / 32;
+        sc->ybin[i] = ((int64_t)i * inlink->h + 31) / 32;
+    }
     return 0;
 }
 
@@ -146,6 +152,47 @@ static void set_bit(uint8_t* data, size_t pos)
     data[pos/8] |= mask;
 }
 
+typedef struct ThreadData {
+    const AVFrame *picref;
+    const StreamContext *sc;
+    uint64_t (*intpic)[32];
+} ThreadData;
+
+/**
+ * Sum up the luma of every pixel in its block of the 32x32 grid, for a
+ * range of block rows.
+ */
+static int block_sums_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    const StreamContext *sc = td->sc;
+    const int linesize = td->picref->linesize[0];
+    const int slice_start = (32 * jobnr) / nb_jobs;
+    const int slice_end = (32 * (jobnr+1)) / nb_jobs;
+    int i, j, y;
+
+    for (i = slice_start; i < slice_end; i++) {
+        uint64_t *intpic = td->intpic[i];
+
+        for (y = sc->ybin[i]; y < sc->ybin[i+1]; y++) {
+            const uint8_t *p = td->picref->data[0] + y * linesize;
+
+            for (j = 0; j < 32; j++) {
+                const uint8_t *src = p + sc->xbin[j];
+                const int n = sc->xbin[j+1] - sc->xbin[j];
+                unsigned sum = 0;
+                int x;
+
+                for (x = 0; x < n; x++)
+                    sum += src[x];
+                intpic[j] += sum;
+            }
+        }
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -163,9 +210,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
     uint8_t wordt2b[5] = { 0, 0, 0, 0, 0 }; /* word ternary to binary */
     uint64_t intpic[32][32];
     uint64_t rowcount;
-    uint8_t *p = picref->data[0];
-    int inti, intj;
-    int *intjlut;
+    ThreadData td;
 
     uint64_t conflist[DIFFELEM_SIZE];
     int f = 0, g = 0, w = 0;
@@ -196,22 +241,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *picref)
     fs->index = sc->lastindex++;
 
     memset(intpic, 0, sizeof(uint64_t)*32*32);
-    intjlut = av_malloc_array(inlink->w, sizeof(int));
-    if (!intjlut)
-        return AVERROR(ENOMEM);
-    for (i = 0; i < inlink->w; i++) {
-        intjlut[i] = (i*32)/inlink->w;
-    }
-
-    for (i = 0; i < inlink->h; i++) {
-        inti = (i*32)/inlink->h;
-        for (j = 0; j < inlink->w; j++) {
-            intj = intjlut[j];
-            intpic[inti][intj] += p[j];
-        }
-        p += picref->linesize[0];
-    }
-    av_freep(&intjlut);
+    td.picref = picref;
+    td.sc = sc;
+    td.intpic = intpic;
+    ctx->internal->execute(ctx, block_sums_slice, &td, NULL,
+                           FFMIN(32, ff_filter_get_nb_threads(ctx)));
 
     /* The following calculates a summed area table (intpic) and brings the numbers
      * in intpic to the same denominator.
@@ -766,5 +800,5 @@ AVFilter ff_vf_signature = {
     .query_formats = query_formats,
     .outputs       = signature_outputs,
     .inputs        = NULL,
-    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
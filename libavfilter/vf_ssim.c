@@ -59,13 +59,16 @@ typedef struct SSIMContext {
     uint8_t rgba_map[4];
     int planewidth[4];
     int planeheight[4];
-    int *temp;
+    void **temp;
+    float *score[4];
+    int nb_threads;
     int is_rgb;
-    float (*ssim_plane)(SSIMDSPContext *dsp,
-                        uint8_t *main, int main_stride,
-                        uint8_t *ref, int ref_stride,
-                        int width, int height, void *temp,
-                        int max);
+    void (*ssim_plane)(SSIMDSPContext *dsp,
+                       uint8_t *main, int main_stride,
+                       uint8_t *ref, int ref_stride,
+                       int width, int height, void *temp,
+                       int max, float *score,
+                       int jobnr, int nb_jobs);
     SSIMDSPContext dsp;
 } SSIMContext;
 
@@ -221,21 +224,30 @@ static float ssim_endn_8bit(const int (*sum0)[4], const int (*sum1)[4], int widt
 
 #define SUM_LEN(w) (((w) >> 2) + 3)
 
-static float ssim_plane_16bit(SSIMDSPContext *dsp,
-                              uint8_t *main, int main_stride,
-                              uint8_t *ref, int ref_stride,
-                              int width, int height, void *temp,
-                              int max)
+/*
+ * The plane functions score one slice of the 4x4 block rows and store the
+ * score of every row, so that the caller can sum the rows in order and get
+ * the same result with any number of threads.
+ */
+static void ssim_plane_16bit(SSIMDSPContext *dsp,
+                             uint8_t *main, int main_stride,
+                             uint8_t *ref, int ref_stride,
+                             int width, int height, void *temp,
+                             int max, float *score,
+                             int jobnr, int nb_jobs)
 {
-    int z = 0, y;
-    float ssim = 0.0;
+    int z, y;
     int64_t (*sum0)[4] = temp;
     int64_t (*sum1)[4] = sum0 + SUM_LEN(width);
+    int slice_start, slice_end;
 
     width >>= 2;
     height >>= 2;
 
-    for (y = 1; y < height; y++) {
+    slice_start = 1 + ((height - 1) * jobnr) / nb_jobs;
+    slice_end   = 1 + ((height - 1) * (jobnr+1)) / nb_jobs;
+
+    for (y = slice_start, z = slice_start - 1; y < slice_end; y++) {
         for (; z <= y; z++) {
             FFSWAP(void*, sum0, sum1);
             ssim_4x4xn_16bit(&main[4 * z * main_stride], main_stride,
@@ -243,27 +255,29 @@ static float ssim_plane_16bit(SSIMDSPContext *dsp,
                              sum0, width);
         }
 
-        ssim += ssim_endn_16bit((const int64_t (*)[4])sum0, (const int64_t (*)[4])sum1, width - 1, max);
+        score[y] = ssim_endn_16bit((const int64_t (*)[4])sum0, (const int64_t (*)[4])sum1, width - 1, max);
     }
-
-    return ssim / ((height - 1) * (width - 1));
 }
 
-static float ssim_plane(SSIMDSPContext *dsp,
-                        uint8_t *main, int main_stride,
-                        uint8_t *ref, int ref_stride,
-                        int width, int height, void *temp,
-                        int max)
+static void ssim_plane(SSIMDSPContext *dsp,
+                       uint8_t *main, int main_stride,
+                       uint8_t *ref, int ref_stride,
+                       int width, int height, void *temp,
+                       int max, float *score,
+                       int jobnr, int nb_jobs)
 {
-    int z = 0, y;
-    float ssim = 0.0;
+    int z, y;
     int (*sum0)[4] = temp;
     int (*sum1)[4] = sum0 + SUM_LEN(width);
+    int slice_start, slice_end;
 
     width >>= 2;
     height >>= 2;
 
-    for (y = 1; y < height; y++) {
+    slice_start = 1 + ((height - 1) * jobnr) / nb_jobs;
+    slice_end   = 1 + ((height - 1) * (jobnr+1)) / nb_jobs;
+
+    for (y = slice_start, z = slice_start - 1; y < slice_end; y++) {
         for (; z <= y; z++) {
             FFSWAP(void*, sum0, sum1);
             dsp->ssim_4x4_line(&main[4 * z * main_stride], main_stride,
@@ -271,10 +285,27 @@ static float ssim_plane(SSIMDSPContext *dsp,
                                sum0, width);
         }
 
-        ssim += dsp->ssim_end_line((const int (*)[4])sum0, (const int (*)[4])sum1, width - 1);
+        score[y] = dsp->ssim_end_line((const int (*)[4])sum0, (const int (*)[4])sum1, width - 1);
     }
+}
+
+typedef struct ThreadData {
+    AVFrame *main, *ref;
+} ThreadData;
 
-    return ssim / ((height - 1) * (width - 1));
+static int ssim_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    SSIMContext *s = ctx->priv;
+    ThreadData *td = arg;
+    int i;
+
+    for (i = 0; i < s->nb_components; i++)
+        s->ssim_plane(&s->dsp, td->main->data[i], td->main->linesize[i],
+                      td->ref->data[i], td->ref->linesize[i],
+                      s->planewidth[i], s->planeheight[i], s->temp[jobnr],
+                      s->max, s->score[i], jobnr, nb_jobs);
+
+    return 0;
 }
 
 static double ssim_db(double ssim, double weight)
@@ -288,8 +319,9 @@ static int do_ssim(FFFrameSync *fs)
     SSIMContext *s = ctx->priv;
     AVFrame *main, *ref;
     AVDictionary **metadata;
+    ThreadData td;
     float c[4], ssimv = 0.0;
-    int ret, i;
+    int ret, i, y;
 
     ret = ff_framesync_dualinput_get(fs, &main, &ref);
     if (ret < 0)
@@ -300,11 +332,18 @@ static int do_ssim(FFFrameSync *fs)
 
     s->nb_frames++;
 
+    td.main = main;
+    td.ref = ref;
+    ctx->internal->execute(ctx, ssim_slice, &td, NULL, s->nb_threads);
+
     for (i = 0; i < s->nb_components; i++) {
-        c[i] = s->ssim_plane(&s->dsp, main->data[i], main->linesize[i],
-                             ref->data[i], ref->linesize[i],
-                             s->planewidth[i], s->planeheight[i], s->temp,
-                             s->max);
+        const int width = s->planewidth[i] >> 2;
+        const int height = s->planeheight[i] >> 2;
+        float ssim = 0.0;
+
+        for (y = 1; y < height; y++)
+            ssim += s->score[i][y];
+        c[i] = ssim / ((height - 1) * (width - 1));
         ssimv += s->coefs[i] * c[i];
         s->ssim[i] += c[i];
     }
@@ -410,9 +449,20 @@ static int config_input_ref(AVFilterLink *inlink)
     for (i = 0; i < s->nb_components; i++)
         s->coefs[i] = (double) s->planeheight[i] * s->planewidth[i] / sum;
 
-    s->temp = av_mallocz_array(2 * SUM_LEN(inlink->w), (desc->comp[0].depth > 8) ? sizeof(int64_t[4]) : sizeof(int[4]));
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->temp = av_mallocz_array(s->nb_threads, sizeof(*s->temp));
     if (!s->temp)
         return AVERROR(ENOMEM);
+    for (i = 0; i < s->nb_threads; i++) {
+        s->temp[i] = av_mallocz_array(2 * SUM_LEN(inlink->w), (desc->comp[0].depth > 8) ? sizeof(int64_t[4]) : sizeof(int[4]));
+        if (!s->temp[i])
+            return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < s->nb_components; i++) {
+        s->score[i] = av_mallocz_array(FFMAX(s->planeheight[i] >> 2, 1), sizeof(*s->score[i]));
+        if (!s->score[i])
+            return AVERROR(ENOMEM);
+    }
     s->max = (1 << desc->comp[0].depth) - 1;
 
     s->ssim_plane = desc->comp[0].depth > 8 ? ssim_plane_16bit : ssim_plane;
@@ -455,10 +505,10 @@ static int activate(AVFilterContext *ctx)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     SSIMContext *s = ctx->priv;
+    int i;
 
     if (s->nb_frames > 0) {
         char buf[256];
-        int i;
         buf[0] = 0;
         for (i = 0; i < s->nb_components; i++) {
             int c = s->is_rgb ? s->rgba_map[i] : i;
@@ -474,7 +524,11 @@ static av_cold void uninit(AVFilterContext *ctx)
     if (s->stats_file && s->stats_file != stdout)
         fclose(s->stats_file);
 
+    for (i = 0; s->temp && i < s->nb_threads; i++)
+        av_freep(&s->temp[i]);
     av_freep(&s->temp);
+    for (i = 0; i < 4; i++)
+        av_freep(&s->score[i]);
 }
 
 static const AVFilterPad ssim_inputs[] = {
@@ -510,4 +564,5 @@ AVFilter ff_vf_ssim = {
     .priv_class    = &ssim_class,
     .inputs        = ssim_inputs,
     .outputs       = ssim_outputs,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
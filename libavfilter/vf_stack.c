@@ -29,14 +29,25 @@
 #include "framesync.h"
 #include "video.h"
 
+typedef struct StackItem {
+    int x[4], y[4];
+    int linesize[4];
+    int height[4];
+} StackItem;
+
 typedef struct StackContext {
     const AVClass *class;
     const AVPixFmtDescriptor *desc;
     int nb_inputs;
+    char *layout;
     int shortest;
     int is_vertical;
+    int is_horizontal;
     int nb_planes;
+    int overlap;        ///< some inputs overlap, they are copied in input order
+    int fill;           ///< the layout leaves parts of the output uncovered
 
+    StackItem *items;
     AVFrame **frames;
     FFFrameSync fs;
 } StackContext;
@@ -66,10 +77,28 @@ static av_cold int init(AVFilterContext *ctx)
     if (!strcmp(ctx->filter->name, "vstack"))
         s->is_vertical = 1;
 
+    if (!strcmp(ctx->filter->name, "hstack"))
+        s->is_horizontal = 1;
+
     s->frames = av_calloc(s->nb_inputs, sizeof(*s->frames));
     if (!s->frames)
         return AVERROR(ENOMEM);
 
+    s->items = av_calloc(s->nb_inputs, sizeof(*s->items));
+    if (!s->items)
+        return AVERROR(ENOMEM);
+
+    if (!s->is_vertical && !s->is_horizontal && !s->layout) {
+        if (s->nb_inputs == 2) {
+            s->layout = av_strdup("0_0|w0_0");
+            if (!s->layout)
+                return AVERROR(ENOMEM);
+        } else {
+            av_log(ctx, AV_LOG_ERROR, "No layout specified.\n");
+            return AVERROR(EINVAL);
+        }
+    }
+
     for (i = 0; i < s->nb_inputs; i++) {
         AVFilterPad pad = { 0 };
 
@@ -87,6 +116,31 @@ static av_cold int init(AVFilterContext *ctx)
     return 0;
 }
 
+/* Each job copies whole inputs straight into their place in the output. */
+static int process_slice(AVFilterContext *ctx, void *arg, int job, int nb_jobs)
+{
+    StackContext *s = ctx->priv;
+    AVFrame *out = arg;
+    AVFrame **in = s->frames;
+    const int start = (s->nb_inputs *  job     ) / nb_jobs;
+    const int end   = (s->nb_inputs * (job + 1)) / nb_jobs;
+    int i, p;
+
+    for (i = start; i < end; i++) {
+        const StackItem *item = &s->items[i];
+
+        for (p = 0; p < s->nb_planes; p++) {
+            av_image_copy_plane(out->data[p] + out->linesize[p] * item->y[p] + item->x[p],
+                                out->linesize[p],
+                                in[i]->data[p],
+                                in[i]->linesize[p],
+                                item->linesize[p], item->height[p]);
+        }
+    }
+
+    return 0;
+}
+
 static int process_frame(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
@@ -94,7 +148,7 @@ static int process_frame(FFFrameSync *fs)
     StackContext *s = fs->opaque;
     AVFrame **in = s->frames;
     AVFrame *out;
-    int i, p, ret, offset[4] = { 0 };
+    int i, ret, nb_jobs;
 
     for (i = 0; i < s->nb_inputs; i++) {
         if ((ret = ff_framesync_get_frame(&s->fs, i, &in[i], 0)) < 0)
@@ -106,39 +160,86 @@ static int process_frame(FFFrameSync *fs)
         return AVERROR(ENOMEM);
     out->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
 
-    for (i = 0; i < s->nb_inputs; i++) {
-        AVFilterLink *inlink = ctx->inputs[i];
-        int linesize[4];
-        int height[4];
+    if (s->fill) {
+        ptrdiff_t linesize[4];
 
-        if ((ret = av_image_fill_linesizes(linesize, inlink->format, inlink->w)) < 0) {
+        for (i = 0; i < 4; i++)
+            linesize[i] = out->linesize[i];
+        if ((ret = av_image_fill_black(out->data, linesize, outlink->format,
+                                       AVCOL_RANGE_UNSPECIFIED,
+                                       outlink->w, outlink->h)) < 0) {
             av_frame_free(&out);
             return ret;
         }
+    }
 
-        height[1] = height[2] = AV_CEIL_RSHIFT(inlink->h, s->desc->log2_chroma_h);
-        height[0] = height[3] = inlink->h;
+    /* overlapping inputs must be copied in order, so that the last input
+     * ends up on top whatever the number of threads */
+    nb_jobs = s->overlap ? 1 : FFMIN(s->nb_inputs, ff_filter_get_nb_threads(ctx));
+    ctx->internal->execute(ctx, process_slice, out, NULL, nb_jobs);
 
-        for (p = 0; p < s->nb_planes; p++) {
-            if (s->is_vertical) {
-                av_image_copy_plane(out->data[p] + offset[p] * out->linesize[p],
-                                    out->linesize[p],
-                                    in[i]->data[p],
-                                    in[i]->linesize[p],
-                                    linesize[p], height[p]);
-                offset[p] += height[p];
+    return ff_filter_frame(outlink, out);
+}
+
+static int fill_item(AVFilterContext *ctx, StackItem *item, AVFilterLink *inlink, int x, int y)
+{
+    StackContext *s = ctx->priv;
+    int ret;
+
+    if ((ret = av_image_fill_linesizes(item->linesize, inlink->format, inlink->w)) < 0)
+        return ret;
+    if ((ret = av_image_fill_linesizes(item->x, inlink->format, x)) < 0)
+        return ret;
+
+    item->height[1] = item->height[2] = AV_CEIL_RSHIFT(inlink->h, s->desc->log2_chroma_h);
+    item->height[0] = item->height[3] = inlink->h;
+    item->y[1] = item->y[2] = AV_CEIL_RSHIFT(y, s->desc->log2_chroma_h);
+    item->y[0] = item->y[3] = y;
+
+    return 0;
+}
+
+/**
+ * Parse the position of one xstack input, given as "X_Y" where each
+ * coordinate is a '+' separated sum of constants and of the width (wN)
+ * or height (hN) of other inputs.
+ */
+static int parse_position(AVFilterContext *ctx, char *arg, int i, int *x, int *y)
+{
+    StackContext *s = ctx->priv;
+    char *arg2, *p2 = arg, *saveptr2 = NULL;
+    char *arg3, *p3, *saveptr3 = NULL;
+    int j, size, pos[2] = { 0 };
+
+    for (j = 0; j < 2; j++) {
+        if (!(arg2 = av_strtok(p2, "_", &saveptr2)))
+            return AVERROR(EINVAL);
+
+        p2 = NULL;
+        p3 = arg2;
+        while ((arg3 = av_strtok(p3, "+", &saveptr3))) {
+            p3 = NULL;
+            if (sscanf(arg3, "w%d", &size) == 1) {
+                if (size == i || size < 0 || size >= s->nb_inputs)
+                    return AVERROR(EINVAL);
+                pos[j] += ctx->inputs[size]->w;
+            } else if (sscanf(arg3, "h%d", &size) == 1) {
+                if (size == i || size < 0 || size >= s->nb_inputs)
+                    return AVERROR(EINVAL);
+                pos[j] += ctx->inputs[size]->h;
+            } else if (sscanf(arg3, "%d", &size) == 1) {
+                if (size < 0)
+                    return AVERROR(EINVAL);
+                pos[j] += size;
             } else {
-                av_image_copy_plane(out->data[p] + offset[p],
-                                    out->linesize[p],
-                                    in[i]->data[p],
-                                    in[i]->linesize[p],
-                                    linesize[p], height[p]);
-                offset[p] += linesize[p];
+                return AVERROR(EINVAL);
             }
         }
     }
 
-    return ff_filter_frame(outlink, out);
+    *x = pos[0];
+    *y = pos[1];
+    return 0;
 }
 
 static int config_output(AVFilterLink *outlink)
@@ -150,30 +251,101 @@ static int config_output(AVFilterLink *outlink)
     int height = ctx->inputs[0]->h;
     int width = ctx->inputs[0]->w;
     FFFrameSyncIn *in;
-    int i, ret;
+    int i, p, ret, offset[4] = { 0 };
+
+    s->desc = av_pix_fmt_desc_get(outlink->format);
+    if (!s->desc)
+        return AVERROR_BUG;
+    s->nb_planes = av_pix_fmt_count_planes(outlink->format);
 
     if (s->is_vertical) {
-        for (i = 1; i < s->nb_inputs; i++) {
+        height = 0;
+        for (i = 0; i < s->nb_inputs; i++) {
             if (ctx->inputs[i]->w != width) {
                 av_log(ctx, AV_LOG_ERROR, "Input %d width %d does not match input %d width %d.\n", i, ctx->inputs[i]->w, 0, width);
                 return AVERROR(EINVAL);
             }
+            if ((ret = fill_item(ctx, &s->items[i], ctx->inputs[i], 0, 0)) < 0)
+                return ret;
+            for (p = 0; p < s->nb_planes; p++) {
+                s->items[i].y[p] = offset[p];
+                offset[p] += s->items[i].height[p];
+            }
             height += ctx->inputs[i]->h;
         }
-    } else {
-        for (i = 1; i < s->nb_inputs; i++) {
+    } else if (s->is_horizontal) {
+        width = 0;
+        for (i = 0; i < s->nb_inputs; i++) {
             if (ctx->inputs[i]->h != height) {
                 av_log(ctx, AV_LOG_ERROR, "Input %d height %d does not match input %d height %d.\n", i, ctx->inputs[i]->h, 0, height);
                 return AVERROR(EINVAL);
             }
+            if ((ret = fill_item(ctx, &s->items[i], ctx->inputs[i], 0, 0)) < 0)
+                return ret;
+            for (p = 0; p < s->nb_planes; p++) {
+                s->items[i].x[p] = offset[p];
+                offset[p] += s->items[i].linesize[p];
+            }
             width += ctx->inputs[i]->w;
         }
-    }
+    } else {
+        char *layout = av_strdup(s->layout);
+        char *arg, *str = layout, *saveptr = NULL;
+        int *pos;
+        int64_t area = 0;
 
-    s->desc = av_pix_fmt_desc_get(outlink->format);
-    if (!s->desc)
-        return AVERROR_BUG;
-    s->nb_planes = av_pix_fmt_count_planes(outlink->format);
+        if (!layout)
+            return AVERROR(ENOMEM);
+        pos = av_malloc_array(s->nb_inputs, 2 * sizeof(*pos));
+        if (!pos) {
+            av_free(layout);
+            return AVERROR(ENOMEM);
+        }
+
+        width = height = 0;
+        s->overlap = 0;
+        for (i = 0; i < s->nb_inputs; i++) {
+            AVFilterLink *inlink = ctx->inputs[i];
+            int x, y, j;
+
+            if (!(arg = av_strtok(str, "|", &saveptr)) ||
+                parse_position(ctx, arg, i, &x, &y) < 0) {
+                av_log(ctx, AV_LOG_ERROR, "Invalid or missing layout for input %d.\n", i);
+                av_free(layout);
+                av_free(pos);
+                return AVERROR(EINVAL);
+            }
+            str = NULL;
+
+            if ((ret = fill_item(ctx, &s->items[i], inlink, x, y)) < 0) {
+                av_free(layout);
+                av_free(pos);
+                return ret;
+            }
+
+            for (j = 0; j < i; j++) {
+                AVFilterLink *prev = ctx->inputs[j];
+
+                if (x < pos[2 * j] + prev->w && pos[2 * j] < x + inlink->w &&
+                    y < pos[2 * j + 1] + prev->h && pos[2 * j + 1] < y + inlink->h)
+                    s->overlap = 1;
+            }
+            pos[2 * i    ] = x;
+            pos[2 * i + 1] = y;
+            area += (int64_t)inlink->w * inlink->h;
+
+            width  = FFMAX(width,  inlink->w + x);
+            height = FFMAX(height, inlink->h + y);
+        }
+        av_free(layout);
+        av_free(pos);
+
+        /* without overlaps, the inputs cover the whole output only if their
+         * areas add up to it */
+        s->fill = s->overlap || area < (int64_t)width * height;
+        if (s->overlap)
+            av_log(ctx, AV_LOG_VERBOSE, "Overlapping inputs, copying them in input order.\n");
+    }
 
     outlink->w          = width;
     outlink->h          = height;
@@ -206,6 +378,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     ff_framesync_uninit(&s->fs);
     av_freep(&s->frames);
+    av_freep(&s->items);
 
     for (i = 0; i < ctx->nb_inputs; i++)
         av_freep(&ctx->input_pads[i].name);
@@ -249,7 +422,7 @@ AVFilter ff_vf_hstack = {
     .init          = init,
     .uninit        = uninit,
     .activate      = activate,
-    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
 
 #endif /* CONFIG_HSTACK_FILTER */
@@ -269,7 +442,33 @@ AVFilter ff_vf_vstack = {
     .init          = init,
     .uninit        = uninit,
     .activate      = activate,
-    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
 };
 
 #endif /* CONFIG_VSTACK_FILTER */
+
+#if CONFIG_XSTACK_FILTER
+
+static const AVOption xstack_options[] = {
+    { "inputs", "set number of inputs", OFFSET(nb_inputs), AV_OPT_TYPE_INT, {.i64=2}, 2, INT_MAX, .flags = FLAGS },
+    { "layout", "set custom layout", OFFSET(layout), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, .flags = FLAGS },
+    { "shortest", "force termination when the shortest input terminates", OFFSET(shortest), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, .flags = FLAGS },
+    { NULL },
+};
+
+AVFILTER_DEFINE_CLASS(xstack);
+
+AVFilter ff_vf_xstack = {
+    .name          = "xstack",
+    .description   = NULL_IF_CONFIG_SMALL("Stack video inputs into custom layout."),
+    .priv_size     = sizeof(StackContext),
+    .priv_class    = &xstack_class,
+    .query_formats = query_formats,
+    .outputs       = outputs,
+    .init          = init,
+    .uninit        = uninit,
+    .activate      = activate,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
+};
+
+#endif /* CONFIG_XSTACK_FILTER */
@@ -76,8 +76,20 @@ typedef struct TonemapContext {
     double peak;
 
     const LumaCoefficients *coeffs;
+
+    double curve_peak;      ///< peak the curve parameters below were computed for
+    float hable_peak;       ///< hable(peak)
+    float mobius_a, mobius_b;
+    float mobius_scale;
+    double gamma_low;       ///< scale of the linear part of the gamma curve
 } TonemapContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    const AVPixFmtDescriptor *desc, *odesc;
+    double peak;
+} ThreadData;
+
 static const enum AVPixelFormat pix_fmts[] = {
     AV_PIX_FMT_GBRPF32,
     AV_PIX_FMT_GBRAPF32,
@@ -145,22 +157,42 @@ static float hable(float in)
     return (in * (in * a + b * c) + d * e) / (in * (in * a + b) + d * f) - e / f;
 }
 
-static float mobius(float in, float j, double peak)
+static float mobius(TonemapContext *s, float in, float j)
 {
-    float a, b;
-
     if (in <= j)
         return in;
 
+    return s->mobius_scale * (in + s->mobius_a) / (in + s->mobius_b);
+}
+
+/**
+ * Compute the parts of the curves which only depend on the peak, once
+ * instead of for every pixel.
+ */
+static void update_curve(TonemapContext *s, double peak)
+{
+    float j = s->param;
+    float a, b;
+
+    if (peak == s->curve_peak)
+        return;
+
+    s->hable_peak = hable(peak);
+
     a = -j * j * (peak - 1.0f) / (j * j - 2.0f * j + peak);
     b = (j * j - 2.0f * j * peak + peak) / FFMAX(peak - 1.0f, 1e-6);
+    s->mobius_a = a;
+    s->mobius_b = b;
+    s->mobius_scale = (b * b + 2.0f * b * j + j * j) / (b - a);
+
+    s->gamma_low = pow(0.05f / peak, 1.0f / s->param);
 
-    return (b * b + 2.0f * b * j + j * j) / (b - a) * (in + a) / (in + b);
+    s->curve_peak = peak;
 }
 
 #define MIX(x,y,a) (x) * (1 - (a)) + (y) * (a)
-static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
-                    const AVPixFmtDescriptor *desc, int x, int y, double peak)
+static av_always_inline void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
+                                     const AVPixFmtDescriptor *desc, int x, int y, double peak)
 {
     const float *r_in = (const float *)(in->data[0] + x * desc->comp[0].step + y * in->linesize[0]);
     const float *b_in = (const float *)(in->data[1] + x * desc->comp[1].step + y * in->linesize[1]);
@@ -200,19 +232,19 @@ static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
         break;
     case TONEMAP_GAMMA:
         sig = sig > 0.05f ? pow(sig / peak, 1.0f / s->param)
-                          : sig * pow(0.05f / peak, 1.0f / s->param) / 0.05f;
+                          : sig * s->gamma_low / 0.05f;
         break;
     case TONEMAP_CLIP:
         sig = av_clipf(sig * s->param, 0, 1.0f);
         break;
     case TONEMAP_HABLE:
-        sig = hable(sig) / hable(peak);
+        sig = hable(sig) / s->hable_peak;
         break;
     case TONEMAP_REINHARD:
         sig = sig / (sig + s->param) * (peak + s->param) / peak;
         break;
     case TONEMAP_MOBIUS:
-        sig = mobius(sig, s->param, peak);
+        sig = mobius(s, sig, s->param);
         break;
     }
 
@@ -223,14 +255,50 @@ static void tonemap(TonemapContext *s, AVFrame *out, const AVFrame *in,
     *b_out *= sig / sig_orig;
 }
 
+static int tonemap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    TonemapContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    AVFrame *out = td->out;
+    const AVPixFmtDescriptor *desc = td->desc;
+    const AVPixFmtDescriptor *odesc = td->odesc;
+    const int slice_start = (out->height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (out->height * (jobnr + 1)) / nb_jobs;
+    int x, y;
+
+    /* do the tone map */
+    for (y = slice_start; y < slice_end; y++)
+        for (x = 0; x < out->width; x++)
+            tonemap(s, out, in, desc, x, y, td->peak);
+
+    /* copy/generate alpha if needed */
+    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+        av_image_copy_plane(out->data[3] + slice_start * out->linesize[3], out->linesize[3],
+                            in->data[3] + slice_start * in->linesize[3], in->linesize[3],
+                            out->linesize[3], slice_end - slice_start);
+    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
+        for (y = slice_start; y < slice_end; y++) {
+            for (x = 0; x < out->width; x++) {
+                AV_WN32(out->data[3] + x * odesc->comp[3].step + y * out->linesize[3],
+                        av_float2int(1.0f));
+            }
+        }
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
-    TonemapContext *s = link->dst->priv;
-    AVFilterLink *outlink = link->dst->outputs[0];
+    AVFilterContext *ctx = link->dst;
+    TonemapContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    ThreadData td;
     AVFrame *out;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
     const AVPixFmtDescriptor *odesc = av_pix_fmt_desc_get(outlink->format);
-    int ret, x, y;
+    int ret;
     double peak = s->peak;
 
     if (!desc || !odesc) {
@@ -276,24 +344,15 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
         s->desat = 0;
     }
 
-    /* do the tone map */
-    for (y = 0; y < out->height; y++)
-        for (x = 0; x < out->width; x++)
-            tonemap(s, out, in, desc, x, y, peak);
+    update_curve(s, peak);
 
-    /* copy/generate alpha if needed */
-    if (desc->flags & AV_PIX_FMT_FLAG_ALPHA && odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        av_image_copy_plane(out->data[3], out->linesize[3],
-                            in->data[3], in->linesize[3],
-                            out->linesize[3], outlink->h);
-    } else if (odesc->flags & AV_PIX_FMT_FLAG_ALPHA) {
-        for (y = 0; y < out->height; y++) {
-            for (x = 0; x < out->width; x++) {
-                AV_WN32(out->data[3] + x * odesc->comp[3].step + y * out->linesize[3],
-                        av_float2int(1.0f));
-            }
-        }
-    }
+    td.in    = in;
+    td.out   = out;
+    td.desc  = desc;
+    td.odesc = odesc;
+    td.peak  = peak;
+    ctx->internal->execute(ctx, tonemap_slice, &td, NULL,
+                           FFMIN(outlink->h, ff_filter_get_nb_threads(ctx)));
 
     av_frame_free(&in);
 
@@ -351,4 +410,5 @@ AVFilter ff_vf_tonemap = {
     .priv_class      = &tonemap_class,
     .inputs          = tonemap_inputs,
     .outputs         = tonemap_outputs,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
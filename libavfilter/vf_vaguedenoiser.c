@@ -51,6 +51,8 @@ typedef struct VagueDenoiserContext {
     float *in;
     float *out;
     float *tmp;
+    int buf_size;       ///< size of the per-thread line buffers in, out and tmp
+    int nb_threads;
 
     int hlowsize[4][32];
     int hhighsize[4][32];
@@ -142,10 +144,13 @@ static int config_input(AVFilterLink *inlink)
     s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
     s->planewidth[0]  = s->planewidth[3]  = inlink->w;
 
+    s->nb_threads = ff_filter_get_nb_threads(inlink->dst);
+    s->buf_size   = 32 + FFMAX(inlink->w, inlink->h);
+
     s->block = av_malloc_array(inlink->w * inlink->h, sizeof(*s->block));
-    s->in    = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->in));
-    s->out   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->out));
-    s->tmp   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->tmp));
+    s->in    = av_malloc_array(s->buf_size * s->nb_threads, sizeof(*s->in));
+    s->out   = av_malloc_array(s->buf_size * s->nb_threads, sizeof(*s->out));
+    s->tmp   = av_malloc_array(s->buf_size * s->nb_threads, sizeof(*s->tmp));
 
     if (!s->block || !s->in || !s->out || !s->tmp)
         return AVERROR(ENOMEM);
@@ -390,9 +395,87 @@ static void qian_thresholding(float *block, const int width, const int height,
     }
 }
 
-static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
+typedef struct ThreadData {
+    float *block;
+    int stride;
+    int nb_lines;   ///< number of rows or columns to transform
+    int size;       ///< number of samples in each row or column
+    int low_size;
+    int vertical;
+} ThreadData;
+
+static int transform_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = (td->nb_lines *  jobnr     ) / nb_jobs;
+    const int slice_end   = (td->nb_lines * (jobnr + 1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->buf_size;
+    float *out = s->out + jobnr * s->buf_size;
+    int j;
+
+    for (j = slice_start; j < slice_end; j++) {
+        if (td->vertical) {
+            float *input = td->block + j;
+            copyv(input, td->stride, in + NPAD, td->size);
+            transform_step(in, out, td->size, td->low_size, s);
+            copyh(out + NPAD, input, td->stride, td->size);
+        } else {
+            float *input = td->block + j * td->stride;
+            copy(input, in + NPAD, td->size);
+            transform_step(in, out, td->size, td->low_size, s);
+            copy(out + NPAD, input, td->size);
+        }
+    }
+    return 0;
+}
+
+static int invert_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = (td->nb_lines *  jobnr     ) / nb_jobs;
+    const int slice_end   = (td->nb_lines * (jobnr + 1)) / nb_jobs;
+    float *in  = s->in  + jobnr * s->buf_size;
+    float *out = s->out + jobnr * s->buf_size;
+    float *tmp = s->tmp + jobnr * s->buf_size;
+    int i;
+
+    for (i = slice_start; i < slice_end; i++) {
+        if (td->vertical) {
+            float *idx3 = td->block + i;
+            copyv(idx3, td->stride, in + NPAD, td->size);
+            invert_step(in, out, tmp, td->size, s);
+            copyh(out + NPAD, idx3, td->stride, td->size);
+        } else {
+            float *idx3 = td->block + i * td->stride;
+            copy(idx3, in + NPAD, td->size);
+            invert_step(in, out, tmp, td->size, s);
+            copy(out + NPAD, idx3, td->size);
+        }
+    }
+    return 0;
+}
+
+static void execute_lines(AVFilterContext *ctx, int (*func)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs),
+                          float *block, int stride, int nb_lines, int size, int low_size, int vertical)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData td;
+
+    td.block    = block;
+    td.stride   = stride;
+    td.nb_lines = nb_lines;
+    td.size     = size;
+    td.low_size = low_size;
+    td.vertical = vertical;
+    ctx->internal->execute(ctx, func, &td, NULL, FFMIN(nb_lines, s->nb_threads));
+}
+
+static void filter(AVFilterContext *ctx, AVFrame *in, AVFrame *out)
 {
-    int p, y, x, i, j;
+    VagueDenoiserContext *s = ctx->priv;
+    int p, y, x;
 
     for (p = 0; p < s->nb_planes; p++) {
         const int height = s->planeheight[p];
@@ -431,23 +514,10 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
         }
 
         while (nsteps_transform--) {
-            int low_size = (h_low_size0 + 1) >> 1;
-            float *input = s->block;
-            for (j = 0; j < v_low_size0; j++) {
-                copy(input, s->in + NPAD, h_low_size0);
-                transform_step(s->in, s->out, h_low_size0, low_size, s);
-                copy(s->out + NPAD, input, h_low_size0);
-                input += width;
-            }
-
-            low_size = (v_low_size0 + 1) >> 1;
-            input = s->block;
-            for (j = 0; j < h_low_size0; j++) {
-                copyv(input, width, s->in + NPAD, v_low_size0);
-                transform_step(s->in, s->out, v_low_size0, low_size, s);
-                copyh(s->out + NPAD, input, width, v_low_size0);
-                input++;
-            }
+            execute_lines(ctx, transform_slice, s->block, width, v_low_size0,
+                          h_low_size0, (h_low_size0 + 1) >> 1, 0);
+            execute_lines(ctx, transform_slice, s->block, width, h_low_size0,
+                          v_low_size0, (v_low_size0 + 1) >> 1, 1);
 
             h_low_size0 = (h_low_size0 + 1) >> 1;
             v_low_size0 = (v_low_size0 + 1) >> 1;
@@ -458,21 +528,9 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
         while (nsteps_invert--) {
             const int idx = s->vlowsize[p][nsteps_invert]  + s->vhighsize[p][nsteps_invert];
             const int idx2 = s->hlowsize[p][nsteps_invert] + s->hhighsize[p][nsteps_invert];
-            float * idx3 = s->block;
-            for (i = 0; i < idx2; i++) {
-                copyv(idx3, width, s->in + NPAD, idx);
-                invert_step(s->in, s->out, s->tmp, idx, s);
-                copyh(s->out + NPAD, idx3, width, idx);
-                idx3++;
-            }
 
-            idx3 = s->block;
-            for (i = 0; i < idx; i++) {
-                copy(idx3, s->in + NPAD, idx2);
-                invert_step(s->in, s->out, s->tmp, idx2, s);
-                copy(s->out + NPAD, idx3, idx2);
-                idx3 += width;
-            }
+            execute_lines(ctx, invert_slice, s->block, width, idx2, idx, 0, 1);
+            execute_lines(ctx, invert_slice, s->block, width, idx, idx2, 0, 0);
         }
 
         if (s->depth <= 8) {
@@ -496,7 +554,6 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx  = inlink->dst;
-    VagueDenoiserContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
     int direct = av_frame_is_writable(in);
@@ -513,7 +570,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
     }
 
-    filter(s, in, out);
+    filter(ctx, in, out);
 
     if (!direct)
         av_frame_free(&in);
@@ -579,5 +636,5 @@ AVFilter ff_vf_vaguedenoiser = {
     .query_formats = query_formats,
     .inputs        = vaguedenoiser_inputs,
     .outputs       = vaguedenoiser_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,116 @@
+;*****************************************************************************
+;* x86-optimized functions for overlay filter
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;*****************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION_RODATA
+
+pw_128: times 8 dw 128
+pw_255: times 8 dw 255
+pw_257: times 8 dw 257
+
+SECTION .text
+
+; m2 = alpha words, m4 = 0, m5 = pw_255, m6 = pw_128, m7 = pw_257
+%macro OVERLAY_BLEND 0
+    movh            m0, [dstq + wq]
+    movh            m1, [srcq + wq]
+    punpcklbw       m0, m4
+    punpcklbw       m1, m4
+    pmullw          m1, m2               ; s * alpha
+    pxor            m2, m5               ; 255 - alpha
+    pmullw          m0, m2               ; d * (255 - alpha)
+    paddw           m0, m1
+    paddw           m0, m6
+    pmulhuw         m0, m7               ; (x + 128) * 257 >> 16
+    packuswb        m0, m0
+    movh   [dstq + wq], m0
+    add             wq, mmsize / 2
+%endmacro
+
+%macro OVERLAY_INIT 0
+    pxor            m4, m4
+    mova            m5, [pw_255]
+    mova            m6, [pw_128]
+    mova            m7, [pw_257]
+%endmacro
+
+INIT_XMM sse2
+cglobal overlay_row_44, 4, 4, 8, dst, src, a, w
+    movsxdifnidn    wq, wd
+    add           dstq, wq
+    add           srcq, wq
+    add             aq, wq
+    neg             wq
+    OVERLAY_INIT
+
+.loop:
+    movh            m2, [aq + wq]
+    punpcklbw       m2, m4
+    OVERLAY_BLEND
+    jl .loop
+REP_RET
+
+cglobal overlay_row_22, 4, 4, 8, dst, src, a, w
+    movsxdifnidn    wq, wd
+    add           dstq, wq
+    add           srcq, wq
+    lea             aq, [aq + 2 * wq]
+    neg             wq
+    OVERLAY_INIT
+
+.loop:
+    movu            m2, [aq + 2 * wq]
+    mova            m3, m2
+    pand            m2, m5               ; a[0]
+    psrlw           m3, 8                ; a[1]
+    paddw           m3, m2
+    psrlw           m3, 1
+    paddw           m2, m3
+    psrlw           m2, 1                ; (a[0] + ((a[0] + a[1]) >> 1)) >> 1
+    OVERLAY_BLEND
+    jl .loop
+REP_RET
+
+cglobal overlay_row_20, 5, 5, 8, dst, src, a, w, a1
+    movsxdifnidn    wq, wd
+    add           dstq, wq
+    add           srcq, wq
+    lea             aq, [aq + 2 * wq]
+    add            a1q, aq               ; next alpha line
+    neg             wq
+    OVERLAY_INIT
+
+.loop:
+    movu            m2, [aq  + 2 * wq]
+    movu            m3, [a1q + 2 * wq]
+    mova            m0, m2
+    mova            m1, m3
+    psrlw           m2, 8
+    psrlw           m3, 8
+    pand            m0, m5
+    pand            m1, m5
+    paddw           m2, m0
+    paddw           m3, m1
+    paddw           m2, m3
+    psrlw           m2, 2                ; (a[0] + a[1] + a[ls] + a[ls + 1]) >> 2
+    OVERLAY_BLEND
+    jl .loop
+REP_RET
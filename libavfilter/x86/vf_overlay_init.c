@@ -0,0 +1,40 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "libavutil/x86/cpu.h"
+#include "libavfilter/overlay.h"
+
+void ff_overlay_row_44_sse2(uint8_t *d, const uint8_t *s, const uint8_t *a,
+                            int w, ptrdiff_t alinesize);
+void ff_overlay_row_22_sse2(uint8_t *d, const uint8_t *s, const uint8_t *a,
+                            int w, ptrdiff_t alinesize);
+void ff_overlay_row_20_sse2(uint8_t *d, const uint8_t *s, const uint8_t *a,
+                            int w, ptrdiff_t alinesize);
+
+av_cold void ff_overlay_init_x86(OverlayDSPContext *dsp)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (EXTERNAL_SSE2(cpu_flags)) {
+        dsp->blend_row[0][0] = ff_overlay_row_44_sse2;
+        dsp->blend_row[1][0] = ff_overlay_row_22_sse2;
+        dsp->blend_row[1][1] = ff_overlay_row_20_sse2;
+    }
+}
@@ -61,6 +61,9 @@ typedef struct VideoDemuxData {
     int start_number_range;
     int frame_size;
     int ts_from_file;
+    int readahead;          /**< number of files to read ahead, set by a private option */
+    struct ImageReadaheadSlot *readahead_slots;
+    int nb_readahead_slots;
 } VideoDemuxData;
 
 typedef struct IdStrMap {
@@ -29,6 +29,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/thread.h"
 #include "avformat.h"
 #include "avio_internal.h"
 #include "internal.h"
@@ -157,6 +158,223 @@ fail:
     return -1;
 }
 
+#if HAVE_THREADS
+static int get_image_filename(VideoDemuxData *s, char *buf, int buf_size,
+                              int number)
+{
+    if (s->use_glob) {
+#if HAVE_GLOB
+        av_strlcpy(buf, s->globstate.gl_pathv[number], buf_size);
+#endif
+    } else if (av_get_frame_filename(buf, buf_size, s->path, number) < 0 &&
+               number > 1) {
+        return AVERROR(EIO);
+    }
+    return 0;
+}
+
+enum ReadaheadState {
+    READAHEAD_IDLE,
+    READAHEAD_REQUESTED,
+    READAHEAD_DONE,
+};
+
+/**
+ * A slot holding one image file read by a background thread. Image number
+ * n is always read through slot n % nb_readahead_slots.
+ */
+typedef struct ImageReadaheadSlot {
+    AVFormatContext *s1;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int thread_started;
+    int abort;
+
+    enum ReadaheadState state;
+    int number;             ///< image number requested, -1 if none
+    char filename[1024];
+    AVBufferRef *buf;       ///< file contents, padded
+    int size;
+    int ret;
+} ImageReadaheadSlot;
+
+static int read_image_file(AVFormatContext *s1, const char *filename,
+                           AVBufferRef **pbuf, int *psize)
+{
+    AVIOContext *pb = NULL;
+    AVBufferRef *buf = NULL;
+    int64_t size;
+    int ret;
+
+    if (s1->io_open(s1, &pb, filename, AVIO_FLAG_READ, NULL) < 0) {
+        av_log(s1, AV_LOG_ERROR, "Could not open file : %s\n", filename);
+        return AVERROR(EIO);
+    }
+
+    size = avio_size(pb);
+    if (size < 0 || size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE) {
+        ret = size < 0 ? size : AVERROR(ERANGE);
+        goto end;
+    }
+
+    buf = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    ret = avio_read(pb, buf->data, size);
+    if (ret >= 0 && ret < size)
+        memset(buf->data + ret, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    if (ret <= 0) {
+        av_buffer_unref(&buf);
+        ret = ret ? ret : AVERROR_EOF;
+    }
+
+end:
+    ff_format_io_close(s1, &pb);
+    *pbuf  = buf;
+    *psize = ret > 0 ? ret : 0;
+    return ret;
+}
+
+static void *readahead_thread(void *arg)
+{
+    ImageReadaheadSlot *slot = arg;
+    char filename[1024];
+    AVBufferRef *buf;
+    int size, ret;
+
+    pthread_mutex_lock(&slot->mutex);
+    for (;;) {
+        while (slot->state != READAHEAD_REQUESTED && !slot->abort)
+            pthread_cond_wait(&slot->cond, &slot->mutex);
+        if (slot->abort)
+            break;
+        av_strlcpy(filename, slot->filename, sizeof(filename));
+        pthread_mutex_unlock(&slot->mutex);
+
+        ret = read_image_file(slot->s1, filename, &buf, &size);
+
+        pthread_mutex_lock(&slot->mutex);
+        slot->buf   = buf;
+        slot->size  = size;
+        slot->ret   = ret;
+        slot->state = READAHEAD_DONE;
+        pthread_cond_signal(&slot->cond);
+    }
+    pthread_mutex_unlock(&slot->mutex);
+
+    return NULL;
+}
+
+/* Must be called with the slot mutex locked and the slot not being read. */
+static void readahead_request(VideoDemuxData *s, ImageReadaheadSlot *slot,
+                              int number)
+{
+    av_buffer_unref(&slot->buf);
+    slot->number = number;
+    if (get_image_filename(s, slot->filename, sizeof(slot->filename), number) < 0) {
+        slot->ret   = AVERROR(EIO);
+        slot->state = READAHEAD_DONE;
+        return;
+    }
+    slot->state = READAHEAD_REQUESTED;
+    pthread_cond_signal(&slot->cond);
+}
+
+static int readahead_get(AVFormatContext *s1, int number,
+                         AVBufferRef **pbuf, int *psize)
+{
+    VideoDemuxData *s = s1->priv_data;
+    ImageReadaheadSlot *slot;
+    int i, ret;
+
+    /* Make sure the following images are being read. Slots holding other
+     * images are left as they are while they are still being read. */
+    for (i = 0; i < s->nb_readahead_slots && number + i <= s->img_last; i++) {
+        slot = &s->readahead_slots[(number + i) % s->nb_readahead_slots];
+        pthread_mutex_lock(&slot->mutex);
+        if (slot->number != number + i && slot->state != READAHEAD_REQUESTED)
+            readahead_request(s, slot, number + i);
+        pthread_mutex_unlock(&slot->mutex);
+    }
+
+    slot = &s->readahead_slots[number % s->nb_readahead_slots];
+    pthread_mutex_lock(&slot->mutex);
+    while (slot->number != number && slot->state == READAHEAD_REQUESTED)
+        pthread_cond_wait(&slot->cond, &slot->mutex);
+    if (slot->number != number)
+        readahead_request(s, slot, number);
+    while (slot->state != READAHEAD_DONE)
+        pthread_cond_wait(&slot->cond, &slot->mutex);
+
+    *pbuf  = slot->buf;
+    *psize = slot->size;
+    ret    = slot->ret;
+    slot->buf    = NULL;
+    slot->number = -1;
+    slot->state  = READAHEAD_IDLE;
+    pthread_mutex_unlock(&slot->mutex);
+
+    return ret;
+}
+
+static void readahead_uninit(VideoDemuxData *s)
+{
+    int i;
+
+    for (i = 0; i < s->nb_readahead_slots; i++) {
+        ImageReadaheadSlot *slot = &s->readahead_slots[i];
+
+        if (!slot->thread_started)
+            break;
+        pthread_mutex_lock(&slot->mutex);
+        slot->abort = 1;
+        pthread_cond_signal(&slot->cond);
+        pthread_mutex_unlock(&slot->mutex);
+        pthread_join(slot->thread, NULL);
+        pthread_cond_destroy(&slot->cond);
+        pthread_mutex_destroy(&slot->mutex);
+        av_buffer_unref(&slot->buf);
+    }
+    av_freep(&s->readahead_slots);
+    s->nb_readahead_slots = 0;
+}
+
+static int readahead_init(AVFormatContext *s1)
+{
+    VideoDemuxData *s = s1->priv_data;
+    int i, ret;
+
+    s->readahead_slots = av_mallocz_array(s->readahead, sizeof(*s->readahead_slots));
+    if (!s->readahead_slots)
+        return AVERROR(ENOMEM);
+    s->nb_readahead_slots = s->readahead;
+
+    for (i = 0; i < s->nb_readahead_slots; i++) {
+        ImageReadaheadSlot *slot = &s->readahead_slots[i];
+
+        slot->s1     = s1;
+        slot->number = -1;
+        pthread_mutex_init(&slot->mutex, NULL);
+        pthread_cond_init(&slot->cond, NULL);
+        ret = pthread_create(&slot->thread, NULL, readahead_thread, slot);
+        if (ret) {
+            pthread_cond_destroy(&slot->cond);
+            pthread_mutex_destroy(&slot->mutex);
+            readahead_uninit(s);
+            return AVERROR(ret);
+        }
+        slot->thread_started = 1;
+    }
+
+    return 0;
+}
+#endif
+
 static int img_read_probe(AVProbeData *p)
 {
     if (p->filename && ff_guess_image2_codec(p->filename)) {
@@ -366,6 +584,18 @@ int ff_img_read_header(AVFormatContext *s1)
         pix_fmt != AV_PIX_FMT_NONE)
         st->codecpar->format = pix_fmt;
 
+    if (s->readahead && !s->is_pipe && !s->split_planes &&
+        s->pattern_type != PT_NONE) {
+#if HAVE_THREADS
+        int ret = readahead_init(s1);
+        if (ret < 0)
+            return ret;
+#else
+        av_log(s1, AV_LOG_WARNING,
+               "Reading ahead is not supported without threads, ignoring\n");
+#endif
+    }
+
     return 0;
 }
 
@@ -377,6 +607,7 @@ int ff_img_read_packet(AVFormatContext *s1, AVPacket *pkt)
     int i, res;
     int size[3]           = { 0 }, ret[3] = { 0 };
     AVIOContext *f[3]     = { NULL };
+    AVBufferRef *buf      = NULL;
     AVCodecParameters *par = s1->streams[0]->codecpar;
 
     if (!s->is_pipe) {
@@ -398,7 +629,14 @@ int ff_img_read_packet(AVFormatContext *s1, AVPacket *pkt)
                                   s->img_number) < 0 && s->img_number > 1)
             return AVERROR(EIO);
         }
-        for (i = 0; i < 3; i++) {
+#if HAVE_THREADS
+        if (s->nb_readahead_slots) {
+            res = readahead_get(s1, s->img_number, &buf, &size[0]);
+            if (res < 0)
+                return res;
+        }
+#endif
+        for (i = 0; i < 3 && !buf; i++) {
             if (s1->pb &&
                 !strcmp(filename_bytes, s->path) &&
                 !s->loop &&
@@ -425,11 +663,16 @@ int ff_img_read_packet(AVFormatContext *s1, AVPacket *pkt)
             int ret;
             int score = 0;
 
-            ret = avio_read(f[0], header, PROBE_BUF_MIN);
-            if (ret < 0)
-                return ret;
+            if (buf) {
+                ret = FFMIN(size[0], PROBE_BUF_MIN);
+                memcpy(header, buf->data, ret);
+            } else {
+                ret = avio_read(f[0], header, PROBE_BUF_MIN);
+                if (ret < 0)
+                    return ret;
+                avio_skip(f[0], -ret);
+            }
             memset(header + ret, 0, sizeof(header) - ret);
-            avio_skip(f[0], -ret);
             pd.buf = header;
             pd.buf_size = ret;
             pd.filename = filename;
@@ -456,9 +699,17 @@ int ff_img_read_packet(AVFormatContext *s1, AVPacket *pkt)
         }
     }
 
-    res = av_new_packet(pkt, size[0] + size[1] + size[2]);
-    if (res < 0) {
-        goto fail;
+    if (buf) {
+        av_init_packet(pkt);
+        pkt->buf  = buf;
+        pkt->data = buf->data;
+        pkt->size = size[0];
+        buf = NULL;
+    } else {
+        res = av_new_packet(pkt, size[0] + size[1] + size[2]);
+        if (res < 0) {
+            goto fail;
+        }
     }
     pkt->stream_index = 0;
     pkt->flags       |= AV_PKT_FLAG_KEY;
@@ -478,6 +729,14 @@ int ff_img_read_packet(AVFormatContext *s1, AVPacket *pkt)
         pkt->pts      = s->pts;
     }
 
+    if (!f[0]) {
+        /* the data was read ahead */
+        s->img_count++;
+        s->img_number++;
+        s->pts++;
+        return 0;
+    }
+
     if (s->is_pipe)
         pkt->pos = avio_tell(f[0]);
 
@@ -529,8 +788,11 @@ fail:
 
 static int img_read_close(struct AVFormatContext* s1)
 {
-#if HAVE_GLOB
     VideoDemuxData *s = s1->priv_data;
+#if HAVE_THREADS
+    readahead_uninit(s);
+#endif
+#if HAVE_GLOB
     if (s->use_glob) {
         globfree(&s->globstate);
     }
@@ -579,6 +841,7 @@ const AVOption ff_img_options[] = {
     { "none", "none",                   0, AV_OPT_TYPE_CONST,    {.i64 = 0   }, 0, 2,       DEC, "ts_type" },
     { "sec",  "second precision",       0, AV_OPT_TYPE_CONST,    {.i64 = 1   }, 0, 2,       DEC, "ts_type" },
     { "ns",   "nano second precision",  0, AV_OPT_TYPE_CONST,    {.i64 = 2   }, 0, 2,       DEC, "ts_type" },
+    { "readahead",    "set number of image files to read ahead in parallel", OFFSET(readahead), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, DEC },
     { NULL },
 };
 
@@ -448,6 +448,21 @@ int ff_framehash_write_header(AVFormatContext *s);
  */
 int ff_read_packet(AVFormatContext *s, AVPacket *pkt);
 
+/**
+ * Like av_get_packet(), but read the data into a buffer taken from a
+ * buffer pool instead of allocating a new one for every packet. This
+ * avoids the allocation and page faulting costs of large uncompressed
+ * frames, and the refcounted buffer can be wrapped by decoders without
+ * copying.
+ *
+ * The pool is created on the first call. All calls with the same pool
+ * must use the same size.
+ *
+ * @param pool pointer to the buffer pool, freed with av_buffer_pool_uninit()
+ * @return >0 (read size) if OK, AVERROR_xxx otherwise
+ */
+int ff_get_pool_packet(AVIOContext *s, AVBufferPool **pool, AVPacket *pkt, int size);
+
 /**
  * Interleave a packet per dts in an output media file.
  *
@@ -99,11 +99,13 @@ typedef const struct EbmlSyntax {
 
 typedef struct EbmlList {
     int nb_elem;
+    unsigned int alloc_elem_size;
     void *elem;
 } EbmlList;
 
 typedef struct EbmlBin {
     int      size;
+    AVBufferRef *buf;
     uint8_t *data;
     int64_t  pos;
 } EbmlBin;
@@ -963,14 +965,18 @@ static int ebml_read_ascii(AVIOContext *pb, int size, char **str)
  */
 static int ebml_read_binary(AVIOContext *pb, int length, EbmlBin *bin)
 {
-    av_fast_padded_malloc(&bin->data, &bin->size, length);
-    if (!bin->data)
+    av_buffer_unref(&bin->buf);
+    bin->buf = av_buffer_alloc(length + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!bin->buf)
         return AVERROR(ENOMEM);
+    memset(bin->buf->data + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
+    bin->data = bin->buf->data;
     bin->size = length;
     bin->pos  = avio_tell(pb);
     if (avio_read(pb, bin->data, length) != length) {
-        av_freep(&bin->data);
+        av_buffer_unref(&bin->buf);
+        bin->data = NULL;
         bin->size = 0;
         return AVERROR(EIO);
     }
@@ -1173,7 +1179,12 @@ static int ebml_parse_elem(MatroskaDemuxContext *matroska,
     data = (char *) data + syntax->data_offset;
     if (syntax->list_elem_size) {
         EbmlList *list = data;
-        newelem = av_realloc_array(list->elem, list->nb_elem + 1, syntax->list_elem_size);
+        /* Lists such as the blocks of a cluster grow one element at a
+         * time, so over-allocate to avoid a reallocation per element. */
+        if ((unsigned)list->nb_elem + 1 >= UINT_MAX / syntax->list_elem_size)
+            return AVERROR(ENOMEM);
+        newelem = av_fast_realloc(list->elem, &list->alloc_elem_size,
+                                  (list->nb_elem + 1) * syntax->list_elem_size);
         if (!newelem)
             return AVERROR(ENOMEM);
         list->elem = newelem;
@@ -1253,7 +1264,8 @@ static void ebml_free(EbmlSyntax *syntax, void *data)
             av_freep(data_off);
             break;
         case EBML_BIN:
-            av_freep(&((EbmlBin *) data_off)->data);
+            av_buffer_unref(&((EbmlBin *) data_off)->buf);
+            ((EbmlBin *) data_off)->data = NULL;
             break;
         case EBML_LEVEL1:
         case EBML_NEST:
@@ -1265,6 +1277,7 @@ static void ebml_free(EbmlSyntax *syntax, void *data)
                     ebml_free(syntax[i].def.n, ptr);
                 av_freep(&list->elem);
                 list->nb_elem = 0;
+                list->alloc_elem_size = 0;
             } else
                 ebml_free(syntax[i].def.n, data_off);
         default:
@@ -2030,12 +2043,13 @@ static int get_qt_codec(MatroskaTrack *track, uint32_t *fourcc, enum AVCodecID *
      * by expanding/shifting the data by 4 bytes and storing the data
      * size at the start. */
     if (ff_codec_get_id(codec_tags, AV_RL32(track->codec_priv.data))) {
-        uint8_t *p = av_realloc(track->codec_priv.data,
-                                track->codec_priv.size + 4);
-        if (!p)
-            return AVERROR(ENOMEM);
-        memmove(p + 4, p, track->codec_priv.size);
-        track->codec_priv.data = p;
+        int ret = av_buffer_realloc(&track->codec_priv.buf,
+                                    track->codec_priv.size + 4 + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (ret < 0)
+            return ret;
+        track->codec_priv.data = track->codec_priv.buf->data;
+        memmove(track->codec_priv.data + 4, track->codec_priv.data,
+                track->codec_priv.size);
         track->codec_priv.size += 4;
         AV_WB32(track->codec_priv.data, track->codec_priv.size);
     }
@@ -2148,8 +2162,19 @@ static int matroska_parse_tracks(AVFormatContext *s)
                            "Failed to decode codec private data\n");
                 }
 
-                if (codec_priv != track->codec_priv.data)
-                    av_free(codec_priv);
+                if (codec_priv != track->codec_priv.data) {
+                    av_buffer_unref(&track->codec_priv.buf);
+                    if (track->codec_priv.data) {
+                        track->codec_priv.buf = av_buffer_create(track->codec_priv.data,
+                                                                 track->codec_priv.size,
+                                                                 NULL, NULL, 0);
+                        if (!track->codec_priv.buf) {
+                            av_freep(&track->codec_priv.data);
+                            track->codec_priv.size = 0;
+                            return AVERROR(ENOMEM);
+                        }
+                    }
+                }
             }
         }
 
@@ -3137,7 +3162,7 @@ static int matroska_parse_webvtt(MatroskaDemuxContext *matroska,
 
 static int matroska_parse_frame(MatroskaDemuxContext *matroska,
                                 MatroskaTrack *track, AVStream *st,
-                                uint8_t *data, int pkt_size,
+                                AVBufferRef *buf, uint8_t *data, int pkt_size,
                                 uint64_t timecode, uint64_t lace_duration,
                                 int64_t pos, int is_keyframe,
                                 uint8_t *additional, uint64_t additional_id, int additional_size,
@@ -3177,23 +3202,38 @@ static int matroska_parse_frame(MatroskaDemuxContext *matroska,
             av_freep(&pkt_data);
         return AVERROR(ENOMEM);
     }
-    /* XXX: prevent data copy... */
-    if (av_new_packet(pkt, pkt_size + offset) < 0) {
-        av_free(pkt);
-        res = AVERROR(ENOMEM);
-        goto fail;
-    }
 
-    if (st->codecpar->codec_id == AV_CODEC_ID_PRORES && offset == 8) {
-        uint8_t *buf = pkt->data;
-        bytestream_put_be32(&buf, pkt_size);
-        bytestream_put_be32(&buf, MKBETAG('i', 'c', 'p', 'f'));
-    }
+    /* Reference the block data directly if it is used unmodified and is
+     * followed by the zeroed padding of the block buffer, i.e. it is the
+     * only or last lace of the block. */
+    if (buf && pkt_data == data && !offset &&
+        data + pkt_size == buf->data + buf->size - AV_INPUT_BUFFER_PADDING_SIZE) {
+        av_init_packet(pkt);
+        pkt->buf = av_buffer_ref(buf);
+        if (!pkt->buf) {
+            av_free(pkt);
+            return AVERROR(ENOMEM);
+        }
+        pkt->data = data;
+        pkt->size = pkt_size;
+    } else {
+        if (av_new_packet(pkt, pkt_size + offset) < 0) {
+            av_free(pkt);
+            res = AVERROR(ENOMEM);
+            goto fail;
+        }
 
-    memcpy(pkt->data + offset, pkt_data, pkt_size);
+        if (st->codecpar->codec_id == AV_CODEC_ID_PRORES && offset == 8) {
+            uint8_t *p = pkt->data;
+            bytestream_put_be32(&p, pkt_size);
+            bytestream_put_be32(&p, MKBETAG('i', 'c', 'p', 'f'));
+        }
 
-    if (pkt_data != data)
-        av_freep(&pkt_data);
+        memcpy(pkt->data + offset, pkt_data, pkt_size);
+
+        if (pkt_data != data)
+            av_freep(&pkt_data);
+    }
 
     pkt->flags        = is_keyframe;
     pkt->stream_index = st->index;
@@ -3256,8 +3296,8 @@ fail:
     return res;
 }
 
-static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
-                                int size, int64_t pos, uint64_t cluster_time,
+static int matroska_parse_block(MatroskaDemuxContext *matroska,
+                                AVBufferRef *buf, uint8_t *data, int size, int64_t pos, uint64_t cluster_time,
                                 uint64_t block_duration, int is_keyframe,
                                 uint8_t *additional, uint64_t additional_id, int additional_size,
                                 int64_t cluster_pos, int64_t discard_padding)
@@ -3374,7 +3414,7 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
             if (res)
                 goto end;
         } else {
-            res = matroska_parse_frame(matroska, track, st, data, lace_size[n],
+            res = matroska_parse_frame(matroska, track, st, buf, data, lace_size[n],
                                        timecode, lace_duration, pos,
                                        !n ? is_keyframe : 0,
                                        additional, additional_id, additional_size,
@@ -3438,7 +3478,8 @@ static int matroska_parse_cluster_incremental(MatroskaDemuxContext *matroska)
                                     blocks[i].additional.data : NULL;
             if (!blocks[i].non_simple)
                 blocks[i].duration = 0;
-            res = matroska_parse_block(matroska, blocks[i].bin.data,
+            res = matroska_parse_block(matroska, blocks[i].bin.buf,
+                                       blocks[i].bin.data,
                                        blocks[i].bin.size, blocks[i].bin.pos,
                                        matroska->current_cluster.timecode,
                                        blocks[i].duration, is_keyframe,
@@ -3472,7 +3513,8 @@ static int matroska_parse_cluster(MatroskaDemuxContext *matroska)
     for (i = 0; i < blocks_list->nb_elem; i++)
         if (blocks[i].bin.size > 0 && blocks[i].bin.data) {
             int is_keyframe = blocks[i].non_simple ? blocks[i].reference == INT64_MIN : -1;
-            res = matroska_parse_block(matroska, blocks[i].bin.data,
+            res = matroska_parse_block(matroska, blocks[i].bin.buf,
+                                       blocks[i].bin.data,
                                        blocks[i].bin.size, blocks[i].bin.pos,
                                        cluster.timecode, blocks[i].duration,
                                        is_keyframe, NULL, 0, 0, pos,
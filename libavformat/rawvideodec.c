@@ -31,6 +31,7 @@ typedef struct RawVideoDemuxerContext {
     int width, height;        /**< Integers describing video size, set by a private option. */
     char *pixel_format;       /**< Set by a private option. */
     AVRational framerate;     /**< AVRational describing framerate, set by a private option. */
+    AVBufferPool *pool;       /**< Pool of frame-sized packet buffers. */
 } RawVideoDemuxerContext;
 
 
@@ -73,9 +74,10 @@ static int rawvideo_read_header(AVFormatContext *ctx)
 
 static int rawvideo_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
+    RawVideoDemuxerContext *r = s->priv_data;
     int ret;
 
-    ret = av_get_packet(s->pb, pkt, s->packet_size);
+    ret = ff_get_pool_packet(s->pb, &r->pool, pkt, s->packet_size);
     pkt->pts = pkt->dts = pkt->pos / s->packet_size;
 
     pkt->stream_index = 0;
@@ -84,6 +86,14 @@ static int rawvideo_read_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
+static int rawvideo_read_close(AVFormatContext *s)
+{
+    RawVideoDemuxerContext *r = s->priv_data;
+
+    av_buffer_pool_uninit(&r->pool);
+    return 0;
+}
+
 #define OFFSET(x) offsetof(RawVideoDemuxerContext, x)
 #define DEC AV_OPT_FLAG_DECODING_PARAM
 static const AVOption rawvideo_options[] = {
@@ -106,6 +116,7 @@ AVInputFormat ff_rawvideo_demuxer = {
     .priv_data_size = sizeof(RawVideoDemuxerContext),
     .read_header    = rawvideo_read_header,
     .read_packet    = rawvideo_read_packet,
+    .read_close     = rawvideo_read_close,
     .flags          = AVFMT_GENERIC_INDEX,
     .extensions     = "yuv,cif,qcif,rgb",
     .raw_codec_id   = AV_CODEC_ID_RAWVIDEO,
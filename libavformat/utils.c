@@ -296,6 +296,44 @@ int av_get_packet(AVIOContext *s, AVPacket *pkt, int size)
     return append_packet_chunked(s, pkt, size);
 }
 
+int ff_get_pool_packet(AVIOContext *s, AVBufferPool **pool, AVPacket *pkt, int size)
+{
+    int ret;
+
+    av_init_packet(pkt);
+    pkt->data = NULL;
+    pkt->size = 0;
+    pkt->pos  = avio_tell(s);
+
+    if (size < 0 || size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR(EINVAL);
+
+    if (!*pool) {
+        *pool = av_buffer_pool_init(size + AV_INPUT_BUFFER_PADDING_SIZE, NULL);
+        if (!*pool)
+            return AVERROR(ENOMEM);
+    }
+
+    pkt->buf = av_buffer_pool_get(*pool);
+    if (!pkt->buf)
+        return AVERROR(ENOMEM);
+    pkt->data = pkt->buf->data;
+
+    /* return values and flags are the same as av_get_packet(): a short
+     * read is flagged corrupt by append_packet_chunked() as well */
+    ret = avio_read(s, pkt->data, size);
+    if (ret <= 0) {
+        av_packet_unref(pkt);
+        return ret;
+    }
+    if (ret < size)
+        pkt->flags |= AV_PKT_FLAG_CORRUPT;
+    pkt->size = ret;
+    memset(pkt->data + ret, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    return ret;
+}
+
 int av_append_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
     if (!pkt->size)
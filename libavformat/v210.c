@@ -30,6 +30,7 @@ typedef struct V210DemuxerContext {
     const AVClass *class;     /**< Class for private options. */
     int width, height;        /**< Integers describing video size, set by a private option. */
     AVRational framerate;     /**< AVRational describing framerate, set by a private option. */
+    AVBufferPool *pool;       /**< Pool of frame-sized packet buffers. */
 } V210DemuxerContext;
 
 // v210 frame width is padded to multiples of 48
@@ -68,9 +69,10 @@ static int v210_read_header(AVFormatContext *ctx)
 
 static int v210_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
+    V210DemuxerContext *v210 = s->priv_data;
     int ret;
 
-    ret = av_get_packet(s->pb, pkt, s->packet_size);
+    ret = ff_get_pool_packet(s->pb, &v210->pool, pkt, s->packet_size);
     pkt->pts = pkt->dts = pkt->pos / s->packet_size;
 
     pkt->stream_index = 0;
@@ -79,6 +81,14 @@ static int v210_read_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
+static int v210_read_close(AVFormatContext *s)
+{
+    V210DemuxerContext *v210 = s->priv_data;
+
+    av_buffer_pool_uninit(&v210->pool);
+    return 0;
+}
+
 #define OFFSET(x) offsetof(V210DemuxerContext, x)
 #define DEC AV_OPT_FLAG_DECODING_PARAM
 static const AVOption v210_options[] = {
@@ -101,6 +111,7 @@ AVInputFormat ff_v210_demuxer = {
     .priv_data_size = sizeof(V210DemuxerContext),
     .read_header    = v210_read_header,
     .read_packet    = v210_read_packet,
+    .read_close     = v210_read_close,
     .flags          = AVFMT_GENERIC_INDEX,
     .extensions     = "v210",
     .raw_codec_id   = AV_CODEC_ID_V210,
@@ -122,6 +133,7 @@ AVInputFormat ff_v210x_demuxer = {
     .priv_data_size = sizeof(V210DemuxerContext),
     .read_header    = v210_read_header,
     .read_packet    = v210_read_packet,
+    .read_close     = v210_read_close,
     .flags          = AVFMT_GENERIC_INDEX,
     .extensions     = "yuv10",
     .raw_codec_id   = AV_CODEC_ID_V210X,
@@ -29,6 +29,10 @@
 #define MAX_YUV4_HEADER 80
 #define MAX_FRAME_HEADER 80
 
+typedef struct YUV4MPEGDemuxContext {
+    AVBufferPool *pool;
+} YUV4MPEGDemuxContext;
+
 static int yuv4_read_header(AVFormatContext *s)
 {
     char header[MAX_YUV4_HEADER + 10];  // Include headroom for
@@ -270,6 +274,7 @@ static int yuv4_read_header(AVFormatContext *s)
 
 static int yuv4_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
+    YUV4MPEGDemuxContext *y4m = s->priv_data;
     int i;
     char header[MAX_FRAME_HEADER+1];
     int ret;
@@ -292,7 +297,8 @@ static int yuv4_read_packet(AVFormatContext *s, AVPacket *pkt)
     if (strncmp(header, Y4M_FRAME_MAGIC, strlen(Y4M_FRAME_MAGIC)))
         return AVERROR_INVALIDDATA;
 
-    ret = av_get_packet(s->pb, pkt, s->packet_size - Y4M_FRAME_MAGIC_LEN);
+    ret = ff_get_pool_packet(s->pb, &y4m->pool, pkt,
+                             s->packet_size - Y4M_FRAME_MAGIC_LEN);
     if (ret < 0)
         return ret;
     else if (ret != s->packet_size - Y4M_FRAME_MAGIC_LEN) {
@@ -305,6 +311,14 @@ static int yuv4_read_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
+static int yuv4_read_close(AVFormatContext *s)
+{
+    YUV4MPEGDemuxContext *y4m = s->priv_data;
+
+    av_buffer_pool_uninit(&y4m->pool);
+    return 0;
+}
+
 static int yuv4_read_seek(AVFormatContext *s, int stream_index,
                           int64_t pts, int flags)
 {
@@ -325,9 +339,11 @@ static int yuv4_probe(AVProbeData *pd)
 AVInputFormat ff_yuv4mpegpipe_demuxer = {
     .name           = "yuv4mpegpipe",
     .long_name      = NULL_IF_CONFIG_SMALL("YUV4MPEG pipe"),
+    .priv_data_size = sizeof(YUV4MPEGDemuxContext),
     .read_probe     = yuv4_probe,
     .read_header    = yuv4_read_header,
     .read_packet    = yuv4_read_packet,
+    .read_close     = yuv4_read_close,
     .read_seek      = yuv4_read_seek,
     .extensions     = "y4m",
 };
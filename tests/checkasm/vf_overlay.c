@@ -0,0 +1,85 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include "checkasm.h"
+#include "libavfilter/overlay.h"
+#include "libavutil/common.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+
+#define WIDTH 256
+#define ALINESIZE (2 * WIDTH + 16)
+
+static void randomize_buffers(uint8_t *buf, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        buf[i] = rnd();
+}
+
+static void check_blend_row(OverlayDSPContext *dsp, int hsub, int vsub)
+{
+    LOCAL_ALIGNED_16(uint8_t, dst0, [WIDTH]);
+    LOCAL_ALIGNED_16(uint8_t, dst1, [WIDTH]);
+    LOCAL_ALIGNED_16(uint8_t, src,  [WIDTH + 16]);
+    LOCAL_ALIGNED_16(uint8_t, a,    [2 * ALINESIZE]);
+    int i;
+
+    declare_func(void, uint8_t *d, const uint8_t *s, const uint8_t *a,
+                 int w, ptrdiff_t alinesize);
+
+    if (check_func(dsp->blend_row[hsub][vsub], "overlay_row_%d%d",
+                   4 >> hsub, vsub ? 0 : 4 >> hsub)) {
+        for (i = 0; i < 4; i++) {
+            int w = (WIDTH >> i) & ~15;
+            int off = i; /* test unaligned overlay rows */
+
+            randomize_buffers(dst0, WIDTH);
+            memcpy(dst1, dst0, WIDTH);
+            randomize_buffers(src, WIDTH + 16);
+            randomize_buffers(a, 2 * ALINESIZE);
+            /* make sure the fully opaque and transparent cases are covered */
+            a[off] = 0;
+            a[off + 1] = 255;
+
+            call_ref(dst0, src + off, a + off, w, ALINESIZE);
+            call_new(dst1, src + off, a + off, w, ALINESIZE);
+            if (memcmp(dst0, dst1, WIDTH))
+                fail();
+        }
+        bench_new(dst1, src, a, WIDTH, ALINESIZE);
+    }
+}
+
+void checkasm_check_overlay(void)
+{
+    OverlayDSPContext dsp;
+
+    ff_overlay_init(&dsp);
+
+    check_blend_row(&dsp, 0, 0);
+    report("blend_row_444");
+
+    check_blend_row(&dsp, 1, 0);
+    report("blend_row_422");
+
+    check_blend_row(&dsp, 1, 1);
+    report("blend_row_420");
+}
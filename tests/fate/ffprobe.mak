@@ -29,6 +29,10 @@ FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_xml
 fate-ffprobe_xml: $(FFPROBE_TEST_FILE)
 fate-ffprobe_xml: CMD = run $(FFPROBE_COMMAND) -of xml
 
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_cbor
+fate-ffprobe_cbor: $(FFPROBE_TEST_FILE)
+fate-ffprobe_cbor: CMD = probemd5 $(FFPROBE_COMMAND) -of cbor
+
 FATE_FFPROBE += $(FATE_FFPROBE-yes)
 
 fate-ffprobe: $(FATE_FFPROBE)
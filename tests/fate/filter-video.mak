@@ -228,6 +228,9 @@ FATE_FILTER_VSYNTH-$(call ALLYES, SPLIT_FILTER SCALE_FILTER PAD_FILTER OVERLAY_F
 fate-filter-overlay_yuv444: tests/data/filtergraphs/overlay_yuv444
 fate-filter-overlay_yuv444: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/overlay_yuv444
 
+FATE_FILTER_VSYNTH-$(call ALLYES, SPLIT_FILTER FORMAT_FILTER NEGATE_FILTER ALPHAMERGE_FILTER CROP_FILTER OVERLAY_FILTER) += fate-filter-overlay_yuva420_oddy
+fate-filter-overlay_yuva420_oddy: CMD = framecrc -c:v pgmyuv -i $(SRC) -filter_threads 4 -filter_complex "[0:v]split=4[m][ma][o][oa];[ma]format=gray,negate[mal];[m][mal]alphamerge,format=yuva420p[main];[o]crop=161:117:5:9[oc];[oa]crop=161:117:20:3,format=gray[oal];[oc][oal]alphamerge,format=yuva420p[over];[main][over]overlay=x=-5:y=-3:format=yuv420,format=yuva420p"
+
 FATE_FILTER_OVERLAY_ALPHA += fate-filter-overlay_yuv420_yuva420  fate-filter-overlay_yuv422_yuva422  fate-filter-overlay_yuv444_yuva444  fate-filter-overlay_rgb_rgba  fate-filter-overlay_gbrp_gbrap
 FATE_FILTER_OVERLAY_ALPHA += fate-filter-overlay_yuva420_yuva420 fate-filter-overlay_yuva422_yuva422 fate-filter-overlay_yuva444_yuva444 fate-filter-overlay_rgba_rgba fate-filter-overlay_gbrap_gbrap
 $(FATE_FILTER_OVERLAY_ALPHA): SRC = $(TARGET_SAMPLES)/png1/lena-rgba.png